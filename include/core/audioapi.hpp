@@ -1,6 +1,8 @@
 #ifndef _audioapi__hpp__included__
 #define _audioapi__hpp__included__
 
+#include "library/sincresample.hpp"
+#include "library/spscring.hpp"
 #include "library/threads.hpp"
 
 #include <map>
@@ -78,8 +80,7 @@ public:
 		//After call, either insize or outsize is zero.
 		void resample(float*& in, size_t& insize, float*& out, size_t& outsize, double ratio, bool stereo);
 	private:
-		double position;
-		double vAl, vBl, vCl, vDl, vAr, vBr, vCr, vDr;
+		sincresample::resampler sinc;
 	};
 /**
  * Ctor.
@@ -96,6 +97,14 @@ public:
  * Parameter rate: Rate of buffer in samples per second.
  */
 	void submit_buffer(int16_t* samples, size_t count, bool stereo, double rate);
+/**
+ * Discard buffers submitted for music channel, instead of playing and dumping them.
+ *
+ * Parameter enable: If true, discard buffers. If false, play them.
+ *
+ * Note: This should only be called from the emulator thread.
+ */
+	void discard_music(bool enable) { music_discard = enable; }
 /**
  * Get the voice channel playback/record rate.
  *
@@ -255,19 +264,21 @@ private:
 	const static unsigned voicep_bufsize = 65536;
 	const static unsigned voicer_bufsize = 65536;
 	const static unsigned music_bufsize = 8192;
-	float voicep_buffer[voicep_bufsize];
-	float voicer_buffer[voicer_bufsize];
-	int16_t music_buffer[MUSIC_BUFFERS * music_bufsize];
-	volatile bool music_stereo[MUSIC_BUFFERS];
-	volatile double music_rate[MUSIC_BUFFERS];
-	volatile size_t music_size[MUSIC_BUFFERS];
+	struct music_block
+	{
+		int16_t samples[music_bufsize];
+		bool stereo;
+		double rate;
+		size_t size;
+	};
+	//Emulator thread -> sound driver.
+	spscring::ring<music_block> music_ring;
+	//Voice thread -> sound driver.
+	spscring::ring<float> voicep_ring;
+	//Sound driver -> voice thread.
+	spscring::ring<float> voicer_ring;
 	unsigned music_ptr;
-	unsigned last_complete_music_seen;
-	volatile unsigned last_complete_music;
-	volatile unsigned voicep_get;
-	volatile unsigned voicep_put;
-	volatile unsigned voicer_get;
-	volatile unsigned voicer_put;
+	bool music_empty;	//Last get_music() had no buffer, so played samples were silence.
 	volatile unsigned voice_rate_play;
 	volatile unsigned orig_voice_rate_play;
 	volatile unsigned voice_rate_rec;
@@ -279,6 +290,7 @@ private:
 	volatile float _voicer_volume;
 	resampler music_resampler;
 	bool last_adjust;	//Adjusting consequtively is too hard.
+	bool music_discard;
 	static bool vu_disabled;
 };
 
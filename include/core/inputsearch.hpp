@@ -0,0 +1,97 @@
+#ifndef _inputsearch__hpp__included__
+#define _inputsearch__hpp__included__
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "library/portctrl-data.hpp"
+
+/**
+ * Parameters of input search.
+ */
+struct input_search_params
+{
+/**
+ * Ctor.
+ */
+	input_search_params();
+/**
+ * The candidate inputs to try on every frame.
+ */
+	std::vector<portctrl::frame> candidates;
+/**
+ * Expression to maximize. Memory watches can be referred to by name.
+ */
+	std::string score;
+/**
+ * Number of frames to search.
+ */
+	unsigned depth;
+/**
+ * Maximum number of states kept on each depth (0 => Unlimited).
+ */
+	size_t beam;
+/**
+ * Maximum number of frames to emulate (0 => Unlimited).
+ */
+	uint64_t max_nodes;
+/**
+ * Number of worker processes to search with (0 => Use the search-workers setting, 1 => Search in this process).
+ */
+	unsigned workers;
+};
+
+/**
+ * Result of input search.
+ */
+struct input_search_result
+{
+/**
+ * Ctor.
+ */
+	input_search_result();
+/**
+ * The inputs leading to the best score, one per frame. Empty if starting state is best.
+ */
+	std::vector<portctrl::frame> inputs;
+/**
+ * The best score.
+ */
+	int64_t score;
+/**
+ * Number of frames emulated.
+ */
+	uint64_t explored;
+/**
+ * Number of states pruned as duplicates of already seen state.
+ */
+	uint64_t duplicates;
+/**
+ * Error message, empty if search succeeded.
+ */
+	std::string error;
+};
+
+/**
+ * Queue an input search.
+ *
+ * The search is run at the next point where core state can be saved (at end of the current frame), starting from
+ * the state there. The emulator state is unchanged afterwards.
+ *
+ * Parameter params: The search parameters.
+ * Parameter done: Function to call with the result.
+ * Throws std::runtime_error: Search is already pending.
+ */
+void input_search_queue(const input_search_params& params, std::function<void(const input_search_result& r)> done)
+	throw(std::bad_alloc, std::runtime_error);
+/**
+ * Is there an input search pending?
+ */
+bool input_search_pending() throw();
+/**
+ * Run the pending input search, if any. Called by the main loop at save point.
+ */
+void input_search_run_pending() throw(std::bad_alloc);
+
+#endif
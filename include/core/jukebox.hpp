@@ -52,6 +52,14 @@ public:
  * Get save as binary flag.
  */
 	bool save_binary();
+/**
+ * Get save as quicksave flag.
+ */
+	bool save_quick();
+/**
+ * Get save as deduplicated quicksave flag.
+ */
+	bool save_dedup();
 /**
  * Get name of current jukebox slot.
  *
@@ -165,6 +165,14 @@ struct memwatch_set
  * Get value of specified memory watch as a string.
  */
 	std::string get_value(const std::string& name);
+/**
+ * Parse an expression, where variables refer to the memory watches.
+ *
+ * Parameter expr: The expression to parse.
+ * Returns: The parsed expression. Call reset() on it before evaluating again.
+ * Throws std::runtime_error: Bad expression or no such memory watch.
+ */
+	GC::pointer<mathexpr::mathexpr> parse_expression(const std::string& expr);
 /**
  * Watch all the items.
  *
@@ -34,6 +34,8 @@ std::string resolve_relative_path(const std::string& path);
 std::pair<std::string, std::string> split_author(const std::string& author) throw(std::bad_alloc,
 	std::runtime_error);
 
+//Binary is -1 for default format, 0 for zip, 1 for binary, 2 for quicksave and 3 for deduplicated quicksave (states
+//only).
 void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc, std::runtime_error);
 void do_save_movie(const std::string& filename, int binary) throw(std::bad_alloc, std::runtime_error);
 void do_load_rom() throw(std::bad_alloc, std::runtime_error);
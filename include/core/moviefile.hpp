@@ -75,6 +75,14 @@ struct dynamic_state
  * Swap the dynamic state with another.
  */
 	void swap(dynamic_state& s) throw();
+/**
+ * Copy the state from another, reusing the memory already allocated and skipping unchanged screenshot and SRAM.
+ */
+	void copy_from(const dynamic_state& s) throw(std::bad_alloc);
+/**
+ * Get the approximate size of the state in bytes.
+ */
+	size_t get_size() const throw();
 };
 
 /**
@@ -100,6 +108,7 @@ struct moviefile
 	private:
 		void load(zip::reader& r);
 		void binary_io(int s);
+		void load_quick(const std::string& filename);
 	};
 /**
  * Extract branches.
@@ -133,6 +142,10 @@ struct moviefile
  * Identify if file is movie/savestate file or not.
  */
 	static bool is_movie_or_savestate(const std::string& filename);
+/**
+ * Identify if file is a quicksave or not.
+ */
+	static bool is_quicksave(const std::string& filename);
 /**
  * This constructor construct movie structure with default settings.
  *
@@ -168,15 +181,50 @@ struct moviefile
  * parameter compression: The compression level 0-9. 0 is uncompressed.
  * parameter binary: Save in binary form if true.
  * parameter rrd: The rerecords data.
+ * parameter method: The ZIP compression method for members (ignored for binary form).
  * throws std::bad_alloc: Not enough memory.
  * throws std::runtime_error: Can't save the movie file.
  */
-	void save(const std::string& filename, unsigned compression, bool binary, rrdata_set& rrd, bool as_state)
-		throw(std::bad_alloc, std::runtime_error);
+	void save(const std::string& filename, unsigned compression, bool binary, rrdata_set& rrd, bool as_state,
+		uint16_t method = zip::METHOD_DEFLATE) throw(std::bad_alloc, std::runtime_error);
 /**
  * Reads this movie structure and saves it to stream (uncompressed ZIP).
  */
 	void save(std::ostream& outstream, rrdata_set& rrd, bool as_state) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Save the dynamic state of this movie as quicksave.
+ *
+ * Quicksaves only contain the dynamic state and a reference (length and hash) to the input up to the save point,
+ * so they can only be loaded on top of the same movie.
+ *
+ * If deduplicating, the file is only a manifest and the data (including the input) goes to the chunk store of the
+ * project in the same directory. Chunks left unreferenced by overwriting an existing file are deleted by
+ * collect_quick_chunks().
+ *
+ * parameter filename: The file to save to.
+ * parameter rrd: The rerecords data (only the count is saved).
+ * parameter dedup: Deduplicate the data.
+ * throws std::bad_alloc: Not enough memory.
+ * throws std::runtime_error: Can't save the quicksave.
+ */
+	void save_quick(const std::string& filename, rrdata_set& rrd, bool dedup = false) throw(std::bad_alloc,
+		std::runtime_error);
+/**
+ * Load dynamic state from quicksave. This structure should be a copy of the movie the quicksave was made from.
+ *
+ * parameter filename: The file to load.
+ * throws std::bad_alloc: Not enough memory.
+ * throws std::runtime_error: Can't load the quicksave, or it does not match the movie.
+ */
+	void load_quick(const std::string& filename) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Delete the chunks no longer referenced by deduplicated quicksaves, in chunk stores that had quicksaves
+ * overwritten since the last call.
+ *
+ * Returns: The number of chunks deleted.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	static size_t collect_quick_chunks() throw(std::bad_alloc);
 /**
  * Force loading as corrupt.
  */
@@ -0,0 +1,21 @@
+#ifndef _profiler__hpp__included__
+#define _profiler__hpp__included__
+
+#include <string>
+#include <stdexcept>
+
+/**
+ * Write recorded profiling spans as Chrome trace event JSON.
+ *
+ * Parameter filename: The file to write.
+ * Throws std::runtime_error: Can't write the file.
+ */
+void profiler_write_trace(const std::string& filename) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Format summary of recorded profiling spans as text table, most expensive first.
+ *
+ * Returns: The summary.
+ */
+std::string profiler_summary() throw(std::bad_alloc);
+
+#endif
@@ -3,9 +3,12 @@
 
 #include "library/exrethrow.hpp"
 #include "library/keyboard.hpp"
+#include "library/mpscring.hpp"
 #include "library/threads.hpp"
+#include <atomic>
 #include <functional>
 #include <deque>
+#include <memory>
 
 namespace command
 {
@@ -60,16 +63,30 @@ struct input_queue
 	{
 		std::function<void()> fn;
 		std::function<void(std::exception& e)> onerror;
+		//Set for synchronous calls, signaled when done.
+		std::shared_ptr<std::atomic<bool>> done;
+	};
+
+/**
+ * Lock-free queue, falling back to locked overflow list when full, so nothing queued is ever dropped.
+ */
+	template<typename T> struct channel
+	{
+		channel(size_t capacity) : ring(capacity), overflowed(false) {}
+		void push(T& item);
+		bool pull(T& item);
+		bool pending() const { return !ring.empty() || overflowed.load(std::memory_order_relaxed); }
+	private:
+		mpscring::ring<T> ring;
+		std::atomic<bool> overflowed;
+		threads::lock overflow_lock;
+		std::deque<T> overflow;
 	};
 
 	//Queue stuff.
-	threads::lock queue_lock;
-	threads::cv queue_condition;
-	std::deque<keypress_info> keypresses;
-	std::deque<std::pair<const char*, std::string>> commands;
-	std::deque<function_queue_entry> functions;
-	volatile uint64_t functions_executed;
-	volatile uint64_t next_function;
+	channel<keypress_info> keypresses;
+	channel<std::pair<const char*, std::string>> commands;
+	channel<function_queue_entry> functions;
 	volatile bool system_thread_available;
 	bool queue_function_run;
 /**
@@ -136,10 +153,32 @@ struct input_queue
 	}
 /**
  * Run internal queues.
+ *
+ * - Must be called from the thread consuming the queues.
  */
-	void run_queue(bool unlocked) throw();
+	void run_queue() throw();
+/**
+ * Wait for something to get queued.
+ *
+ * - Must be called from the thread consuming the queues.
+ *
+ * Parameter usec: Maximum time to wait (in microseconds).
+ */
+	void wait(uint64_t usec) throw();
+/**
+ * Wake up the thread waiting in wait(). If no thread is waiting, the next wait() returns immediately.
+ */
+	void wake() throw();
 private:
+	void queued() throw();
+	bool pending() const;
 	command::group& command;
+	std::atomic<bool> consumer_waiting;
+	std::atomic<bool> wake_requested;	//Set and cleared under queue_lock.
+	threads::lock queue_lock;
+	threads::cv queue_condition;
+	threads::lock sync_lock;
+	threads::cv sync_condition;
 };
 
 #endif
@@ -48,6 +48,14 @@ struct loaded_rom
  * throws std::bad_alloc: Not enough memory.
  */
 	std::vector<char> save_core_state(bool nochecksum = false) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Saves core state into existing buffer, reusing its memory. WARNING: This takes emulated time.
+ *
+ * parameter out: The buffer to save the state to.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	void save_core_state(std::vector<char>& out, bool nochecksum = false) throw(std::bad_alloc,
+		std::runtime_error);
 
 /**
  * Loads core state from buffer.
@@ -0,0 +1,92 @@
+#ifndef _library__chunkstore__hpp__included__
+#define _library__chunkstore__hpp__included__
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * Content-addressed store of data chunks.
+ *
+ * Data is split into variable-size chunks at content-defined boundaries, so inserting or changing bytes only
+ * affects the chunks around the change. Each chunk is stored once, as file named after its hash.
+ */
+namespace chunkstore
+{
+/**
+ * Identifier of a chunk (128-bit hash of its content).
+ */
+struct chunk_id
+{
+	uint8_t id[16];
+	bool operator<(const chunk_id& x) const { return memcmp(id, x.id, 16) < 0; }
+	bool operator==(const chunk_id& x) const { return !memcmp(id, x.id, 16); }
+/**
+ * Get the identifier in hexadecimal.
+ */
+	std::string str() const throw(std::bad_alloc);
+};
+
+/**
+ * Split data into chunks at content-defined boundaries.
+ *
+ * Parameter data: The data to split.
+ * Parameter size: The size of data.
+ * Returns: Sizes of the chunks, in order.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+std::vector<size_t> split(const char* data, size_t size) throw(std::bad_alloc);
+
+/**
+ * A chunk store on disk.
+ */
+class store
+{
+public:
+/**
+ * Open a chunk store, creating the directory if needed.
+ *
+ * Parameter dir: The directory for chunks.
+ * Throws std::runtime_error: Can't create the directory.
+ */
+	store(const std::string& dir) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Store data, writing the chunks that are not yet present.
+ *
+ * Parameter data: The data to store.
+ * Parameter size: The size of data.
+ * Returns: The chunks making up the data, in order.
+ * Throws std::runtime_error: Can't write a chunk.
+ */
+	std::vector<chunk_id> put(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Read back data stored with put().
+ *
+ * Parameter ids: The chunks making up the data.
+ * Parameter out: The data is appended here.
+ * Throws std::runtime_error: Chunk missing or damaged.
+ */
+	void get(const std::vector<chunk_id>& ids, std::vector<char>& out) throw(std::bad_alloc,
+		std::runtime_error);
+/**
+ * Delete all chunks not in given set.
+ *
+ * Parameter live: The chunks still referenced.
+ * Returns: Number of chunks deleted.
+ */
+	size_t collect(const std::set<chunk_id>& live) throw(std::bad_alloc);
+/**
+ * Get the number of bytes written by put() since the store was opened (bytes actually hitting the disk).
+ */
+	uint64_t get_written() { return written; }
+private:
+	std::string chunk_path(const chunk_id& id);
+	std::string dir;
+	uint64_t written;
+};
+}
+
+#endif
@@ -5,6 +5,9 @@
 #include <map>
 #include <set>
 #include <list>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 #include <functional>
 #include "threads.hpp"
 
@@ -49,6 +52,9 @@ private:
 
 /**
  * Dispatch source (event generator).
+ *
+ * The targets are kept in an immutable snapshot that is replaced on connect/disconnect, so sending an event does
+ * not take any locks. Old snapshots are freed once no event is being sent.
  */
 template<typename... T> struct source
 {
@@ -69,35 +75,54 @@ template<typename... T> struct source
  */
 	~source()
 	{
-		delete _targets;
+		delete current.load();
+		current = NULL;
+		for(auto i : retired)
+			delete i;
+		retired.clear();
 		delete lck;
 		lck = NULL;
 	}
 /**
  * Send an event.
  *
+ * Targets connected while the event is being sent are called too, and targets disconnected are not called
+ * anymore, exactly as if the target list was re-read before each call.
+ *
  * Parameter args: The arguments to send.
  */
 	void operator()(T... args)
 	{
 		init();
+		//Snapshots seen while senders is nonzero are not freed.
+		senders++;
+		const snapshot* s = current.load();
+		size_t idx = 0;
 		uint64_t k = 0;
-		typename std::map<uint64_t, target<T...>*>::iterator i;
-		lck->lock();
-		i = targets().lower_bound(k);
-		while(i != targets().end()) {
-			k = i->first + 1;
-			target<T...>* t = i->second;
-			lck->unlock();
+		while(s) {
+			const snapshot* c = current.load();
+			if(c != s) {
+				//Targets changed. Resume from the next sequence number in the new list.
+				s = c;
+				if(!s)
+					break;
+				idx = std::lower_bound(s->entries.begin(), s->entries.end(), std::make_pair(k,
+					(target<T...>*)NULL)) - s->entries.begin();
+			}
+			if(idx >= s->entries.size())
+				break;
+			k = s->entries[idx].first + 1;
+			target<T...>* t = s->entries[idx++].second;
 			try {
 				t->call(args...);
 			} catch(std::exception& e) {
 				(*errstrm) << name << ": Error in handler: " << e.what() << std::endl;
 			}
-			lck->lock();
-			i = targets().lower_bound(k);
 		}
-		lck->unlock();
+		if(--senders == 0 && has_retired) {
+			threads::alock h(*lck);
+			reclaim();
+		}
 	}
 /**
  * Connect a new target.
@@ -108,7 +133,10 @@ template<typename... T> struct source
 	{
 		init();
 		threads::alock h(*lck);
-		targets()[next_cbseq++] = &target;
+		const snapshot* old = current.load();
+		snapshot* n = old ? new snapshot(*old) : new snapshot;
+		n->entries.push_back(std::make_pair(next_cbseq++, &target));
+		replace(n);
 		target.set_source(this);
 	}
 /**
@@ -122,11 +150,15 @@ template<typename... T> struct source
 		if(!lck)
 			return;
 		threads::alock h(*lck);
-		for(auto i = targets().begin(); i != targets().end(); i++)
-			if(i->second == &target) {
-				targets().erase(i);
-				break;
-			}
+		const snapshot* old = current.load();
+		if(old)
+			for(auto i = old->entries.begin(); i != old->entries.end(); i++)
+				if(i->second == &target) {
+					snapshot* n = new snapshot(*old);
+					n->entries.erase(n->entries.begin() + (i - old->entries.begin()));
+					replace(n);
+					break;
+				}
 		target.set_source(NULL);
 	}
 /**
@@ -139,6 +171,11 @@ template<typename... T> struct source
 		errstrm = to ? to : &std::cerr;
 	}
 private:
+	struct snapshot
+	{
+		//Sorted by sequence number.
+		std::vector<std::pair<uint64_t, target<T...>*>> entries;
+	};
 	void init()
 	{
 		if(inited)
@@ -149,17 +186,38 @@ private:
 		errstrm = &std::cerr;
 		next_cbseq = 0;
 		name = "(unknown)";
-		_targets = NULL;
+		current = NULL;
+		senders = 0;
+		has_retired = false;
 		lck = new threads::lock;
 		inited = true;
 	}
-	threads::lock* lck;
-	std::map<uint64_t, target<T...>*>& targets()
+	//Called with lck held.
+	void replace(snapshot* n)
+	{
+		retired.push_back(current.load());
+		current = n;
+		has_retired = true;
+		reclaim();
+	}
+	//Called with lck held.
+	void reclaim()
 	{
-		if(!_targets) _targets = new std::map<uint64_t, target<T...>*>;
-		return *_targets;
+		//The ordering between this load and the store to current (and the increment of senders and load of
+		//current on send side) is sequentially consistent, so sender either sees the new snapshot or this sees
+		//the sender.
+		if(senders.load() != 0)
+			return;
+		for(auto i : retired)
+			delete i;
+		retired.clear();
+		has_retired = false;
 	}
-	std::map<uint64_t, target<T...>*>* _targets;
+	threads::lock* lck;
+	std::atomic<const snapshot*> current;
+	std::atomic<unsigned> senders;
+	std::atomic<bool> has_retired;
+	std::vector<const snapshot*> retired;
 	uint64_t next_cbseq;
 	std::ostream* errstrm;
 	const char* name;
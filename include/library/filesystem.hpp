@@ -3,7 +3,9 @@
 
 #include <cstdint>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <fstream>
 #include "threads.hpp"
 
@@ -15,6 +17,12 @@
 
 /**
  * A filesystem.
+ *
+ * Changes to cluster tables are first written to a log (the backing file name with ".wal" appended), so each
+ * operation either fully happens or not at all, even if the program crashes. The log is replayed on open.
+ *
+ * Each log record costs a sync, so operations that belong together (e.g. writing one packet) should be grouped
+ * with begin_group() and end_group(). A group is then committed with one record.
  */
 class filesystem
 {
@@ -23,8 +31,14 @@ public:
  * Create a new filesystem or open existing one, backed by specified file.
  *
  * Parameters backingfile: The backing file name.
+ * Parameters use_mmap: If true, the backing file is memory-mapped, so reads don't need any I/O calls. Ignored if
+ *	memory mapping is not supported on this system.
+ */
+	filesystem(const std::string& backingfile, bool use_mmap = true);
+/**
+ * Close the filesystem.
  */
-	filesystem(const std::string& backingfile);
+	~filesystem();
 /**
  * Allocate a new file.
  *
@@ -76,6 +90,17 @@ public:
  */
 	void write_data(uint32_t& cluster, uint32_t& ptr, const void* data, uint32_t length,
 		uint32_t& real_cluster, uint32_t& real_ptr);
+/**
+ * Start a group of operations that are committed together. Groups nest, and the changes are committed when the
+ * outermost group ends.
+ *
+ * Note: If the program crashes, the operations in uncommitted groups are lost.
+ */
+	void begin_group();
+/**
+ * End a group of operations started by begin_group().
+ */
+	void end_group();
 /**
  * A reference-counted refernece to a filesystem.
  */
@@ -197,6 +222,52 @@ public:
 			threads::alock m(*mlock);
 			fs->write_data(cluster, ptr, data, length, real_cluster, real_ptr);
 		}
+/**
+ * Call begin_group() on underlying filesystem.
+ *
+ * Note: See filesystem::begin_group() for description.
+ */
+		void begin_group()
+		{
+			threads::alock m(*mlock);
+			fs->begin_group();
+		}
+/**
+ * Call end_group() on underlying filesystem.
+ *
+ * Note: See filesystem::end_group() for description.
+ */
+		void end_group()
+		{
+			threads::alock m(*mlock);
+			fs->end_group();
+		}
+/**
+ * A group of operations, ended when the object is destroyed or commit() is called.
+ */
+		class group
+		{
+		public:
+/**
+ * Start a group on filesystem.
+ */
+			group(ref& _fs) : fs(_fs), active(true) { fs.begin_group(); }
+/**
+ * End the group, if not already committed. Errors are ignored.
+ */
+			~group() { try { if(active) fs.end_group(); } catch(...) {} }
+/**
+ * End the group.
+ *
+ * Throws std::runtime_error: Committing the changes failed.
+ */
+			void commit() { active = false; fs.end_group(); }
+		private:
+			group(const group&);
+			group& operator=(const group&);
+			ref& fs;
+			bool active;
+		};
 	private:
 		filesystem* fs;
 		unsigned* refcnt;
@@ -205,17 +276,49 @@ public:
 private:
 	filesystem(const filesystem&);
 	filesystem& operator=(const filesystem&);
+	uint32_t _allocate_cluster();
+	void _free_cluster_chain(uint32_t cluster);
+	void _write_data(uint32_t& cluster, uint32_t& ptr, const void* data, uint32_t length,
+		uint32_t& real_cluster, uint32_t& real_ptr);
 	void link_cluster(uint32_t cluster, uint32_t linkto);
+	//Commit at end of public operation, unless in a group.
+	void end_operation();
+	//Write the changed cluster tables, via the log.
+	void commit_tables();
+	//Append a record to the log and sync it.
+	void append_log(const std::vector<char>& record);
+	//Close and remove the log.
+	void remove_log();
+	//Apply complete log left over from earlier, and remove it.
+	void replay_log();
+	//Raw access to backing file.
+	void read_raw(uint64_t offset, void* data, size_t length);
+	void write_raw(uint64_t offset, const void* data, size_t length);
+	void sync_raw();
 	struct supercluster
 	{
 		unsigned free_clusters;
 		uint32_t clusters[CLUSTERS_PER_SUPER];
-		void load(std::fstream& s, uint32_t index);
-		void save(std::fstream& s, uint32_t index);
+		void load(const char* buffer);
+		void save(char* buffer);
 	};
 	uint32_t supercluster_count;
 	std::map<uint32_t, supercluster> superclusters;
+	//Superclusters with cluster table not yet written.
+	std::set<uint32_t> dirty;
+	std::string logfile;
+	uint64_t log_size;
+	unsigned group_depth;
+	//Log file, kept open between records. The stream is used if there is no mmap.
+	int logfd;
+	std::ofstream logstream;
+	uint64_t backing_size;
+	//Used if not memory-mapped.
 	std::fstream backing;
+	//Used if memory-mapped (fd >= 0).
+	int fd;
+	char* mapping;
+	uint64_t mapping_size;
 };
 
 
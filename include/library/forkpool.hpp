@@ -0,0 +1,82 @@
+#ifndef _library__forkpool__hpp__included__
+#define _library__forkpool__hpp__included__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <stdexcept>
+#include "threads.hpp"
+
+/**
+ * Pool of forked worker processes.
+ *
+ * Each worker is a copy of the process at the time the pool was created (including the emulator state), and
+ * talks to the creating process over pipes. This allows running multiple copies of process-global code (like
+ * emulator cores) in parallel.
+ *
+ * Only the thread creating the pool is copied to the workers. Any lock some other thread held at the time stays
+ * locked forever in the workers, so the worker function must not take locks other threads might hold, except the
+ * ones passed to the constructor.
+ *
+ * Only available on systems with fork().
+ */
+namespace forkpool
+{
+/**
+ * Function run in workers for each job.
+ *
+ * Parameter in: The job data.
+ * Parameter out: The reply data is written here (initially empty).
+ * Throws std::exception: The job failed (the message is passed back).
+ */
+typedef std::function<void(const std::vector<char>& in, std::vector<char>& out)> worker_fn;
+
+class pool
+{
+public:
+/**
+ * Fork the workers.
+ *
+ * Parameter workers: The number of workers.
+ * Parameter fn: The function to run in the workers for each job.
+ * Parameter hold: Locks the workers need. These are held while forking, so they are free in the workers. Must not
+ *	be held by the calling thread.
+ * Throws std::runtime_error: Can't create workers.
+ */
+	pool(unsigned workers, worker_fn fn, const std::vector<threads::lock*>& hold = std::vector<threads::lock*>())
+		throw(std::bad_alloc, std::runtime_error);
+/**
+ * Shut down the workers and wait for them to exit.
+ */
+	~pool() throw();
+/**
+ * Run jobs, in parallel on the workers.
+ *
+ * Parameter jobs: The jobs.
+ * Parameter results: The replies, in the same order as the jobs.
+ * Throws std::runtime_error: A job failed, or a worker died.
+ */
+	void run(const std::vector<std::vector<char>>& jobs, std::vector<std::vector<char>>& results)
+		throw(std::bad_alloc, std::runtime_error);
+/**
+ * Get the number of workers.
+ */
+	unsigned size() { return children.size(); }
+/**
+ * Is forking workers supported on this system?
+ */
+	static bool supported() throw();
+private:
+	struct child
+	{
+		int pid;
+		int fd;
+	};
+	pool(const pool&);
+	pool& operator=(const pool&);
+	void shutdown() throw();
+	std::vector<child> children;
+};
+}
+
+#endif
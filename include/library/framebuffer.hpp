@@ -481,6 +481,11 @@ struct color_mod
 	color_mod(const std::string& name, std::function<void(int64_t&)> fn);
 };
 
+/**
+ * Number of glyphs that can be looked up without searching.
+ */
+#define FONT_FAST_GLYPHS 256
+
 /**
  * Bitmap font (8x16).
  */
@@ -599,12 +604,16 @@ struct font
  */
 	void render(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl);
 private:
+	font(const font&);
+	font& operator=(const font&);
 	glyph bad_glyph;
 	uint32_t bad_glyph_data[4];
 	std::map<uint32_t, glyph> glyphs;
+	const glyph* fast_glyphs[FONT_FAST_GLYPHS];
 	size_t tabstop;
 	std::vector<uint32_t> memory;
 	void load_hex_glyph(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error);
+	void update_fast_glyphs() throw();
 };
 
 
@@ -0,0 +1,67 @@
+#ifndef _library__hash128__hpp__included__
+#define _library__hash128__hpp__included__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Fast non-cryptographic 128-bit hash (MurmurHash3 x64-128).
+ *
+ * This is meant for content addressing and change detection, not for anything adversarial.
+ */
+class hash128
+{
+public:
+/**
+ * Create new hash context, initially containing empty data.
+ *
+ * Parameter seed: The seed to use.
+ */
+	hash128(uint64_t seed = 0) throw();
+/**
+ * Append data to be hashed. Don't call after calling read().
+ *
+ * Parameter data: The data to write.
+ * Parameter datalen: The length of data written.
+ */
+	void write(const uint8_t* data, size_t datalen) throw();
+	void write(const char* data, size_t datalen) throw()
+	{
+		write(reinterpret_cast<const uint8_t*>(data), datalen);
+	}
+/**
+ * Read the hash of data written. Can be called multiple times, but after the first call, data can't be appended
+ * anymore.
+ *
+ * Parameter hashout: 16-byte buffer to store the hash to.
+ */
+	void read(uint8_t* hashout) throw();
+/**
+ * Similar to read(uint8_t*) but returns the hash as hexadecimal string.
+ *
+ * Returns: The hash in hex form.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	std::string read() throw(std::bad_alloc);
+/**
+ * Hash a single buffer.
+ *
+ * Parameter hashout: 16-byte buffer to store the hash to.
+ * Parameter data: The data to hash.
+ * Parameter datalen: The length of data.
+ * Parameter seed: The seed to use.
+ */
+	static void hash(uint8_t* hashout, const uint8_t* data, size_t datalen, uint64_t seed = 0) throw();
+private:
+	void block(const uint8_t* data) throw();
+	uint64_t h1;
+	uint64_t h2;
+	uint64_t total;
+	uint8_t buffer[16];
+	size_t buffer_fill;
+	bool finished;
+	uint8_t finalhash[16];
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <functional>
 #include <set>
 #include <list>
+#include <vector>
 #include <cassert>
 #include "string.hpp"
 #include "utf8.hpp"
@@ -455,20 +456,34 @@ public:
 		void _register(state& L);	//Reads callback from top of lua stack.
 		void _unregister(state& L);	//Reads callback from top of lua stack.
 		template<typename... T> bool callback(T... args) {
-			bool any = L.callback(callbacks, args...);
+			bool any;
+			//Callbacks may unregister callbacks, which must not invalidate the list being walked.
+			dispatching++;
+			try {
+				any = L.callback(callbacks, args...);
+			} catch(...) {
+				end_dispatch();
+				throw;
+			}
+			end_dispatch();
 			if(fn_cbname != "" && L.callback(fn_cbname, args...))
 				any = true;
 			return any;
 		}
 		const std::string& get_name() { return name; }
+		const char* get_profile_name() { return profile_name; }	//"lua." + name, interned.
 		void clear() { callbacks.clear(); }
 	private:
 		callback_list(const callback_list&);
 		callback_list& operator=(const callback_list&);
+		void end_dispatch();	//Erases callbacks unregistered during dispatch.
 		std::list<char> callbacks;
+		unsigned dispatching;
+		std::vector<char*> unregistered;
 		state& L;
 		std::string name;
 		std::string fn_cbname;
+		const char* profile_name;
 	};
 /**
  * Enumerate all callbacks.
@@ -77,9 +77,9 @@ template<class T> struct class_binding
  */
 	state* _state;
 /**
- * The name of the method to pass.
+ * The name of the method to pass (owned by the class object, so calls don't need to copy it).
  */
-	char fname[];
+	const std::string* fname;
 };
 
 /**
@@ -193,12 +193,20 @@ public:
  * Get name of class.
  */
 	const std::string& get_name() { return name; }
+/**
+ * Get full name (class::method) of static method.
+ *
+ * Parameter method: The name of method.
+ * Returns: The full name. Stays valid as long as the class exists.
+ */
+	const std::string& static_method_name(const char* method);
 protected:
 	void delayed_register();
 	void register_static(state& L);
 private:
 	class_group& group;
 	std::string name;
+	std::set<std::string> smethod_names;
 	bool registered;
 };
 
@@ -244,8 +252,8 @@ template<class T> class _class : public class_base
 	static int class_bind_trampoline(state& L)
 	{
 		class_binding<T>* b = (class_binding<T>*)L.touserdata(L.trampoline_upval(1));
-		T* p = _class<T>::get(L, 1, b->fname);
-		lua::parameters P(L, b->fname);
+		T* p = _class<T>::get(L, 1, *b->fname);
+		lua::parameters P(L, *b->fname);
 		return (p->*(b->fn))(L, P);
 	}
 
@@ -297,12 +305,11 @@ badtype:
 		load_metatable(_state);
 		_state.pushstring(keyname);
 		std::string fname = name + std::string("::") + keyname;
-		void* ptr = _state.newuserdata(sizeof(class_binding<T>) + fname.length() + 1);
+		void* ptr = _state.newuserdata(sizeof(class_binding<T>));
 		class_binding<T>* bdata = reinterpret_cast<class_binding<T>*>(ptr);
 		bdata->fn = fn;
 		bdata->_state = &_state.get_master();
-		std::copy(fname.begin(), fname.end(), bdata->fname);
-		bdata->fname[fname.length()] = 0;
+		bdata->fname = &*method_names.insert(fname).first;
 		_state.push_trampoline(class_bind_trampoline, 1);
 		_state.rawset(-3);
 		_state.pop(1);
@@ -507,6 +514,7 @@ again:
 		}
 	}
 	std::string name;
+	std::set<std::string> method_names;
 	std::list<static_method> smethods;
 	std::list<class_method<T>> cmethods;
 	std::string (T::*printmeth)();
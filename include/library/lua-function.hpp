@@ -108,6 +108,7 @@ private:
 		int invoke(state& L);
 	private:
 		std::function<int(state& L, parameters& P)> func;
+		int (*direct)(state& L, parameters& P);
 	};
 	functions(const functions&);
 	functions& operator=(const functions&);
@@ -4,6 +4,7 @@
 #include "lua-base.hpp"
 #include "lua-framebuffer.hpp"
 #include "lua-class.hpp"
+#include <utility>
 
 namespace lua
 {
@@ -62,7 +63,6 @@ template<> void arg_helper(state& L, framebuffer::color& x, int idx, const std::
 
 template<> void arg_helper(state& L, skipped_parameter_tag& x, int idx, const std::string& fname)
 {
-	delete &x;
 }
 
 template<> void arg_helper(state& L, function_parameter_tag& x, int idx, const std::string& fname)
@@ -70,7 +70,6 @@ template<> void arg_helper(state& L, function_parameter_tag& x, int idx, const s
 	if(L.type(idx) != LUA_TFUNCTION)
 		(stringfmt() << "Expected function as argument #" << idx << " to " << fname).throwex();
 	x.idx = idx;
-	delete &x;
 }
 
 template<> void arg_helper(state& L, table_parameter_tag& x, int idx, const std::string& fname)
@@ -78,7 +77,6 @@ template<> void arg_helper(state& L, table_parameter_tag& x, int idx, const std:
 	if(L.type(idx) != LUA_TTABLE)
 		(stringfmt() << "Expected table as argument #" << idx << " to " << fname).throwex();
 	x.idx = idx;
-	delete &x;
 }
 
 template<typename T, typename U> void arg_helper(state& L, optional_parameter_tag<T, U>& x, int idx,
@@ -86,44 +84,45 @@ template<typename T, typename U> void arg_helper(state& L, optional_parameter_ta
 {
 	x.target = x.dflt;
 	L.get_numeric_argument<T>(idx, x.target, fname);
-	delete &x;
 }
 
 template<typename U> void arg_helper(state& L, optional_parameter_tag<bool, U>& x, int idx, const std::string& fname)
 {
 	x.target = (L.type(idx) == LUA_TNIL || L.type(idx) == LUA_TNONE) ? x.dflt : L.get_bool(idx, fname);
-	delete &x;
 }
 
 template<typename U> void arg_helper(state& L, optional_parameter_tag<std::string, U>& x, int idx,
 	const std::string& fname)
 {
 	x.target = (L.type(idx) == LUA_TNIL || L.type(idx) == LUA_TNONE) ? x.dflt : L.get_string(idx, fname);
-	delete &x;
 }
 
 template<typename U> void arg_helper(state& L, optional_parameter_tag<framebuffer::color, U>& x, int idx,
 	const std::string& fname)
 {
 	x.target = get_fb_color(L, idx, fname, x.dflt);
-	delete &x;
 }
 
 template<typename T, typename U> void arg_helper(state& L, optional_parameter_tag<T*, U>& x, int idx,
 	const std::string& fname)
 {
 	x.target = _class<T>::get(L, idx, fname, true);
-	delete &x;
 }
 
 /**
  * Parameters for Lua function.
+ *
+ * This is constructed on every call, so it must not allocate. The tags are temporaries living until the end of
+ * the argument read.
  */
 class parameters
 {
 public:
 /**
  * Make
+ *
+ * Parameter _L: The Lua state.
+ * Parameter _fname: The name of function. Must outlive this object.
  */
 	parameters(state& _L, const std::string& _fname)
 		: L(_L), fname(_fname), next(1)
@@ -161,7 +160,8 @@ public:
 	template<typename T> T arg_opt(T d, int i = 0)
 	{
 		T tmp;
-		arg_helper(L, optional<T>(tmp, d), i ? i : next, fname);
+		optional_parameter_tag<T, T> tag(tmp, d);
+		arg_helper(L, tag, i ? i : next, fname);
 		if(!i) next++;
 		return tmp;
 	}
@@ -218,11 +218,11 @@ public:
 /**
  * Read multiple at once.
  */
-	template<typename T, typename... U> void operator()(T& x, U&... args)
+	template<typename T, typename... U> void operator()(T&& x, U&&... args)
 	{
 		arg_helper(L, x, next, fname);
 		next++;
-		(*this)(args...);
+		(*this)(std::forward<U>(args)...);
 	}
 	void operator()()
 	{
@@ -230,36 +230,36 @@ public:
 /**
  * Optional tag.
  */
-	template<typename T, typename U> optional_parameter_tag<T, U>& optional(T& value, U dflt)
+	template<typename T, typename U> optional_parameter_tag<T, U> optional(T& value, U dflt)
 	{
-		return *new optional_parameter_tag<T, U>(value, dflt);
+		return optional_parameter_tag<T, U>(value, dflt);
 	}
 /**
  * Optional tag, reference default value.
  */
-	template<typename T, typename U> optional_parameter_tag<T, const U&>& optional2(T& value, const U& dflt)
+	template<typename T, typename U> optional_parameter_tag<T, const U&> optional2(T& value, const U& dflt)
 	{
-		return *new optional_parameter_tag<T, const U&>(value, dflt);
+		return optional_parameter_tag<T, const U&>(value, dflt);
 	}
 /**
  * Skipped tag.
  */
-	skipped_parameter_tag& skipped() { return *new skipped_parameter_tag(); }
+	skipped_parameter_tag skipped() { return skipped_parameter_tag(); }
 /**
  * Function tag.
  */
-	function_parameter_tag& function(int& fnidx) { return *new function_parameter_tag(fnidx); }
+	function_parameter_tag function(int& fnidx) { return function_parameter_tag(fnidx); }
 /**
  * Table tag.
  */
-	table_parameter_tag& table(int& fnidx) { return *new table_parameter_tag(fnidx); }
+	table_parameter_tag table(int& fnidx) { return table_parameter_tag(fnidx); }
 /**
  * Get Lua state.
  */
 	state& get_state() { return L; }
 private:
 	state& L;
-	std::string fname;
+	const std::string& fname;
 	int next;
 };
 }
@@ -0,0 +1,68 @@
+#ifndef _library__memoryfingerprint__hpp__included__
+#define _library__memoryfingerprint__hpp__included__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+class memory_space;
+
+/**
+ * Fast fingerprint of the writable memory in memory space.
+ *
+ * The fingerprint is 128-bit hash of contents of all regions that are neither read-only nor special. It is meant
+ * for telling states apart quickly (e.g. duplicate detection when searching), not for anything adversarial.
+ *
+ * Memory is hashed in pages. In incremental mode, a shadow copy of memory is kept, and only pages that changed
+ * since the last call are rehashed. The fingerprint does not depend on the mode.
+ */
+class memory_fingerprint
+{
+public:
+/**
+ * Create a new fingerprinter.
+ *
+ * Parameter incremental: If true, track changed pages between calls.
+ */
+	memory_fingerprint(bool incremental = false);
+/**
+ * Compute the fingerprint.
+ *
+ * Parameter mspace: The memory space to fingerprint.
+ * Parameter out: 16-byte buffer to store the fingerprint to.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	void compute(memory_space& mspace, uint8_t* out) throw(std::bad_alloc);
+/**
+ * Compute the fingerprint as hexadecimal string.
+ *
+ * Parameter mspace: The memory space to fingerprint.
+ * Returns: The fingerprint in hex form.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	std::string compute(memory_space& mspace) throw(std::bad_alloc);
+/**
+ * Forget the tracked state, so the next call rehashes everything.
+ */
+	void reset() throw();
+/**
+ * Get the number of bytes hashed by the last call.
+ */
+	uint64_t get_hashed() { return hashed; }
+private:
+	struct tracked_region
+	{
+		std::string name;
+		uint64_t size;
+		std::vector<char> shadow;
+		std::vector<uint8_t> hashes;
+		bool primed;
+	};
+	bool incremental;
+	uint64_t hashed;
+	std::vector<tracked_region> tracked;
+	std::vector<char> buffer;
+};
+
+#endif
@@ -145,6 +145,13 @@ public:
  * Returns: The region, or NULL if index is invalid.
  */
 	region* lookup_n(size_t n);
+/**
+ * Lookup region with specified name.
+ *
+ * Parameter name: The name to look up.
+ * Returns: The region, or NULL if there is no such region.
+ */
+	region* lookup_name(const char* name);
 /**
  * Get number of regions.
  */
@@ -194,6 +201,19 @@ public:
  * Parameter bsize: Size of buffer.
  */
 	void read_range(uint64_t address, void* buffer, size_t bsize);
+/**
+ * Read equally spaced elements (not across regions) into packed buffer.
+ *
+ * Only one region lookup is done for the whole read. Elements not backed by the region read as zeroes.
+ *
+ * Parameter address: Address of the first element.
+ * Parameter stride: Distance between starts of consecutive elements.
+ * Parameter count: Number of elements.
+ * Parameter esize: Size of each element.
+ * Parameter buffer: Buffer to store the data to (count * esize bytes).
+ * Returns: The endianess of the region (0 if address is not mapped).
+ */
+	int read_strided(uint64_t address, uint64_t stride, size_t count, size_t esize, void* buffer);
 /**
  * Write a byte range (not across regions).
  *
@@ -248,6 +268,10 @@ public:
  * Returns: The textual address.
  */
 	std::string address_to_textual(uint64_t addr);
+/**
+ * Get the lock protecting the memory map.
+ */
+	threads::lock& get_lock() { return mlock; }
 private:
 	threads::lock mlock;
 	std::vector<region*> u_regions;
@@ -0,0 +1,114 @@
+#ifndef _library_mpscring__hpp__included__
+#define _library_mpscring__hpp__included__
+
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+#include "spscring.hpp"
+
+namespace mpscring
+{
+/**
+ * Lock-free bounded multi-producer single-consumer queue.
+ *
+ * The elements are preallocated, so queueing does not allocate (beyond what moving the element does). Producer
+ * methods may be called from any number of threads at once, consumer methods from one thread at a time.
+ */
+template<typename T> class ring
+{
+public:
+/**
+ * Create a queue.
+ *
+ * Parameter capacity: The number of elements the queue can hold. Rounded up to power of two.
+ */
+	ring(size_t capacity)
+	{
+		size_t cap = 1;
+		while(cap < capacity)
+			cap <<= 1;
+		cells = std::vector<cell>(cap);
+		for(size_t i = 0; i < cap; i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		mask = cap - 1;
+		wptr.store(0, std::memory_order_relaxed);
+		rptr = 0;
+	}
+/**
+ * Get the capacity of queue.
+ */
+	size_t capacity() const { return mask + 1; }
+/**
+ * Producer: Queue an element.
+ *
+ * Parameter item: The element. Moved from only if queueing succeeds.
+ * Returns: True if queued, false if queue is full.
+ */
+	bool push(T& item)
+	{
+		size_t w = wptr.load(std::memory_order_relaxed);
+		while(true) {
+			cell& c = cells[w & mask];
+			size_t seq = c.seq.load(std::memory_order_acquire);
+			if(seq == w) {
+				//Free slot. Try to claim it.
+				if(wptr.compare_exchange_weak(w, w + 1, std::memory_order_relaxed))
+					break;
+			} else if(seq < w)
+				return false;	//Full.
+			else
+				w = wptr.load(std::memory_order_relaxed);
+		}
+		cell& c = cells[w & mask];
+		c.data = std::move(item);
+		c.seq.store(w + 1, std::memory_order_release);
+		return true;
+	}
+/**
+ * Consumer: Dequeue the oldest element.
+ *
+ * Parameter item: The element is moved here.
+ * Returns: True if element was dequeued, false if queue is empty.
+ */
+	bool pull(T& item)
+	{
+		cell& c = cells[rptr & mask];
+		if(c.seq.load(std::memory_order_acquire) != rptr + 1)
+			return false;
+		item = std::move(c.data);
+		c.data = T();
+		c.seq.store(rptr + capacity(), std::memory_order_release);
+		rptr++;
+		return true;
+	}
+/**
+ * Consumer: Is there anything to dequeue?
+ */
+	bool empty() const
+	{
+		return cells[rptr & mask].seq.load(std::memory_order_acquire) != rptr + 1;
+	}
+private:
+	struct cell
+	{
+		cell() {}
+		cell(const cell& c) : seq(c.seq.load()), data(c.data) {}
+		cell& operator=(const cell& c) { seq.store(c.seq.load()); data = c.data; return *this; }
+		std::atomic<size_t> seq;
+		T data;
+	};
+	ring(const ring&);
+	ring& operator=(const ring&);
+	std::vector<cell> cells;
+	size_t mask;
+	char pad0[SPSCRING_CACHELINE];
+	//Shared by producers.
+	std::atomic<size_t> wptr;
+	char pad1[SPSCRING_CACHELINE];
+	//Consumer only.
+	size_t rptr;
+	char pad2[SPSCRING_CACHELINE];
+};
+}
+
+#endif
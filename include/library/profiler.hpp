@@ -0,0 +1,132 @@
+#ifndef _library__profiler__hpp__included__
+#define _library__profiler__hpp__included__
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+
+/**
+ * Lightweight span profiler.
+ *
+ * Spans are recorded into per-thread ring buffers (oldest spans are overwritten) while profiling is enabled. When
+ * profiling is disabled, a span costs one atomic load. Recording does not take locks. The buffer of a thread that
+ * exits is reused by the next thread that records spans.
+ */
+namespace profiler
+{
+/**
+ * Statistics for one span name.
+ */
+struct stats
+{
+/**
+ * Number of times span was recorded.
+ */
+	uint64_t count;
+/**
+ * Total time spent in span (nanoseconds).
+ */
+	uint64_t total;
+/**
+ * Longest time spent in span (nanoseconds).
+ */
+	uint64_t max;
+};
+
+extern std::atomic<bool> _enabled;
+
+/**
+ * Is profiling enabled?
+ */
+inline bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+/**
+ * Enable or disable profiling.
+ */
+void set_enabled(bool enable);
+/**
+ * Set size of per-thread buffers. Takes effect on next clear().
+ *
+ * Parameter events: The number of events per thread to keep.
+ */
+void set_buffer_size(size_t events);
+/**
+ * Discard all recorded events.
+ */
+void clear();
+/**
+ * Get current time.
+ *
+ * Returns: Monotonic time in nanoseconds.
+ */
+uint64_t now();
+/**
+ * Record a span on current thread.
+ *
+ * Parameter name: The name of span. Must stay valid until clear() (e.g. string literal or from intern()).
+ * Parameter start: The start time (as returned by now()).
+ * Parameter end: The end time (as returned by now()).
+ */
+void record(const char* name, uint64_t start, uint64_t end);
+/**
+ * Mark start of a new frame. Events are tagged with the latest frame number.
+ *
+ * Parameter frame: The frame number.
+ */
+void mark_frame(uint64_t frame);
+/**
+ * Get a copy of name that is valid until program exits.
+ */
+const char* intern(const std::string& name);
+/**
+ * Set name of current thread for trace output.
+ */
+void set_thread_name(const std::string& name);
+/**
+ * Get statistics of recorded spans.
+ *
+ * Parameter frames: The number of frames covered by recorded events is written here (if not NULL).
+ * Returns: Statistics for each span name.
+ */
+std::map<std::string, stats> summary(uint64_t* frames = NULL);
+/**
+ * Write recorded events as Chrome trace event format JSON.
+ *
+ * Parameter out: The stream to write to.
+ */
+void write_chrome_trace(std::ostream& out);
+
+/**
+ * Scoped span. Recorded when it goes out of scope, if profiling was enabled when it was created.
+ */
+class span
+{
+public:
+	span(const char* _name)
+	{
+		name = _name;
+		active = enabled();
+		if(active) start = now();
+	}
+	~span()
+	{
+		if(active) record(name, start, now());
+	}
+private:
+	span(const span&);
+	span& operator=(const span&);
+	const char* name;
+	uint64_t start;
+	bool active;
+};
+}
+
+#define PROFILE_SPAN_CAT2(a, b) a##b
+#define PROFILE_SPAN_CAT(a, b) PROFILE_SPAN_CAT2(a, b)
+/**
+ * Profile rest of current scope as span name.
+ */
+#define PROFILE_SPAN(name) profiler::span PROFILE_SPAN_CAT(_profile_span_, __LINE__)(name)
+
+#endif
@@ -4,6 +4,8 @@
 #include <string>
 #include <map>
 #include <set>
+#include <atomic>
+#include <type_traits>
 #include "threads.hpp"
 #include "string.hpp"
 #include <string>
@@ -17,6 +19,13 @@ class set;
 class superbase;
 
 threads::rlock& get_setting_lock();
+/**
+ * Get the settings layout generation.
+ *
+ * This is changed whenever any setting is registered to or unregistered from any group (including when group is
+ * destroyed). Changing values of settings does not change it.
+ */
+uint64_t get_generation();
 
 /**
  * A settings listener.
@@ -331,6 +340,84 @@ protected:
 	bool is_dynamic;
 };
 
+/**
+ * Storage for value of setting. Scalar values are read without taking the settings lock.
+ */
+template<typename T, bool scalar = std::is_scalar<T>::value> class value_slot
+{
+public:
+	T load() const
+	{
+		threads::arlock h(get_setting_lock());
+		return value;
+	}
+	void store(const T& v)
+	{
+		threads::arlock h(get_setting_lock());
+		value = v;
+	}
+private:
+	T value;
+};
+
+template<typename T> class value_slot<T, true>
+{
+public:
+	T load() const { return value.load(std::memory_order_acquire); }
+	void store(const T& v) { value.store(v, std::memory_order_release); }
+private:
+	std::atomic<T> value;
+};
+
+/**
+ * Cache of group to setting resolution for supervariable.
+ *
+ * Lookups are lock-free. The cached entry is valid as long as the settings layout generation has not changed.
+ */
+class handle_cache
+{
+public:
+/**
+ * Constructor.
+ */
+	handle_cache();
+/**
+ * Look up cached setting.
+ *
+ * Parameter grp: The group.
+ * Returns: The setting, or NULL if not cached.
+ */
+	base* lookup(group& grp)
+	{
+		uint64_t gen = get_generation();
+		unsigned s1 = seq.load(std::memory_order_acquire);
+		if(s1 & 1)
+			return NULL;	//Being updated.
+		group* g = cgroup.load(std::memory_order_relaxed);
+		base* b = cbase.load(std::memory_order_relaxed);
+		uint64_t cg = cgen.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(seq.load(std::memory_order_relaxed) != s1 || g != &grp || cg != gen)
+			return NULL;
+		return b;
+	}
+/**
+ * Store setting to cache.
+ *
+ * Parameter grp: The group.
+ * Parameter b: The setting.
+ * Parameter gen: The generation the setting was looked up in.
+ *
+ * Note: Must be called with settings lock held.
+ */
+	void update(group& grp, base* b, uint64_t gen);
+private:
+	std::atomic<unsigned> seq;
+	std::atomic<group*> cgroup;
+	std::atomic<base*> cbase;
+	std::atomic<uint64_t> cgen;
+};
+
 /**
  * Setting variable.
  */
@@ -347,7 +434,7 @@ public:
 		valtype_t defaultvalue, bool dynamic = false)
 		: base(sgroup, iname, hname, dynamic)
 	{
-		value = defaultvalue;
+		value.store(defaultvalue);
 	}
 /**
  * Destructor.
@@ -360,10 +447,7 @@ public:
  */
 	void str(const std::string& val) throw(std::runtime_error, std::bad_alloc)
 	{
-		{
-			threads::arlock h(get_setting_lock());
-			value = model::read(val);
-		}
+		value.store(model::read(val));
 		sgroup->fire_listener(*this);
 	}
 /**
@@ -371,20 +455,16 @@ public:
  */
 	std::string str() const throw(std::runtime_error, std::bad_alloc)
 	{
-		threads::arlock h(get_setting_lock());
-		return model::write(value);
+		return model::write(value.load());
 	}
 /**
  * Set setting.
  */
 	void set(valtype_t _value) throw(std::runtime_error, std::bad_alloc)
 	{
-		{
-			threads::arlock h(get_setting_lock());
-			if(!model::valid(value))
-				throw std::runtime_error("Invalid value");
-			value = _value;
-		}
+		if(!model::valid(_value))
+			throw std::runtime_error("Invalid value");
+		value.store(_value);
 		sgroup->fire_listener(*this);
 	}
 /**
@@ -392,8 +472,7 @@ public:
  */
 	valtype_t get() const throw(std::bad_alloc)
 	{
-		threads::arlock h(get_setting_lock());
-		return model::transform(value);
+		return model::transform(value.load());
 	}
 /**
  * Get setting.
@@ -410,7 +489,7 @@ public:
 		return description_get(dummy);
 	}
 private:
-	valtype_t value;
+	value_slot<valtype_t> value;
 	model dummy;
 };
 
@@ -453,24 +532,30 @@ public:
  */
 	valtype_t operator()(group& grp)
 	{
-		base* b = &grp[iname];
-		variable<model>* m = dynamic_cast<variable<model>*>(b);
-		if(!m)
-			throw std::runtime_error("No such setting in target group");
-		return m->get();
+		return resolve(grp).get();
 	}
 /**
  * Write value in instance.
  */
 	void operator()(group& grp, valtype_t val)
 	{
-		base* b = &grp[iname];
-		variable<model>* m = dynamic_cast<variable<model>*>(b);
+		resolve(grp).set(val);
+	}
+private:
+	variable<model>& resolve(group& grp)
+	{
+		base* b = handles.lookup(grp);
+		if(b)
+			return *static_cast<variable<model>*>(b);
+		threads::arlock h(get_setting_lock());
+		uint64_t gen = get_generation();
+		variable<model>* m = dynamic_cast<variable<model>*>(&grp[iname]);
 		if(!m)
 			throw std::runtime_error("No such setting in target group");
-		m->set(val);
+		handles.update(grp, m, gen);
+		return *m;
 	}
-private:
+	handle_cache handles;
 	set& s;
 	std::string iname;
 	std::string hname;
@@ -0,0 +1,97 @@
+#ifndef _library__sincresample__hpp__included__
+#define _library__sincresample__hpp__included__
+
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Polyphase windowed-sinc sample rate conversion.
+ */
+namespace sincresample
+{
+/**
+ * Quality preset.
+ */
+enum quality
+{
+/**
+ * 8 taps, 64 phases. About the cost of cubic interpolation.
+ */
+	QUALITY_FAST,
+/**
+ * 16 taps, 128 phases.
+ */
+	QUALITY_NORMAL,
+/**
+ * 32 taps, 256 phases.
+ */
+	QUALITY_BEST,
+};
+
+/**
+ * Streaming resampler for mono or stereo float samples.
+ *
+ * The signal is internally always stereo (mono input is sent to both channels), so the stream can switch between
+ * mono and stereo without glitches.
+ */
+class resampler
+{
+public:
+/**
+ * Create a resampler.
+ *
+ * Parameter q: The quality preset.
+ */
+	resampler(quality q = QUALITY_NORMAL);
+/**
+ * Change the quality preset. Clears the history.
+ *
+ * Parameter q: The new quality preset.
+ */
+	void set_quality(quality q);
+/**
+ * Clear the history (as if only silence has been seen so far).
+ */
+	void reset();
+/**
+ * Resample a block.
+ *
+ * After call, either insize or outsize is zero.
+ *
+ * Parameter in: The input samples. Advanced past samples consumed.
+ * Parameter insize: The number of input samples (frames if stereo). Decremented by samples consumed.
+ * Parameter out: The output buffer. Advanced past samples written.
+ * Parameter outsize: Size of output buffer in samples (frames if stereo). Decremented by samples written.
+ * Parameter ratio: Output rate divided by input rate.
+ * Parameter stereo: If true, the samples are stereo, with L and R interleaved.
+ */
+	void resample(const float*& in, size_t& insize, float*& out, size_t& outsize, double ratio, bool stereo);
+/**
+ * Get the delay of the resampler.
+ *
+ * Returns: The number of input samples needed to flush out all the history.
+ */
+	size_t latency() { return taps / 2; }
+private:
+	void build_table(double cutoff);
+	void push(float l, float r)
+	{
+		hist[2 * hpos + 0] = hist[2 * (hpos + taps) + 0] = l;
+		hist[2 * hpos + 1] = hist[2 * (hpos + taps) + 1] = r;
+		if(++hpos == taps) hpos = 0;
+	}
+	unsigned taps;
+	unsigned phases;
+	double rolloff;
+	double position;
+	double table_cutoff;
+	//Coefficients and differences to the next phase, duplicated for both channels. phases * 2 * taps each.
+	std::vector<float> coeffs;
+	std::vector<float> deltas;
+	//History, 2 * taps stereo frames. Each frame is stored twice, so the last taps frames are contiguous.
+	std::vector<float> hist;
+	unsigned hpos;
+};
+}
+
+#endif
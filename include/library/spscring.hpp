@@ -0,0 +1,175 @@
+#ifndef _library_spscring__hpp__included__
+#define _library_spscring__hpp__included__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+//Assumed cache line size. The indices are padded apart by this much.
+#define SPSCRING_CACHELINE 64
+
+namespace spscring
+{
+/**
+ * Lock-free single-producer single-consumer ring buffer.
+ *
+ * Producer methods may only be called from one thread at a time, and consumer methods from one thread at a time
+ * (which may be different from the producer thread). Neither side ever waits for the other.
+ */
+template<typename T> class ring
+{
+public:
+/**
+ * Create a ring.
+ *
+ * Parameter capacity: The number of elements the ring can hold. Rounded up to power of two.
+ */
+	ring(size_t capacity)
+	{
+		size_t cap = 1;
+		while(cap < capacity)
+			cap <<= 1;
+		data.resize(cap);
+		mask = cap - 1;
+		wptr = 0;
+		rptr = 0;
+		rptr_cache = 0;
+		wptr_cache = 0;
+	}
+/**
+ * Get the capacity of ring.
+ */
+	size_t capacity() const { return mask + 1; }
+/**
+ * Get the number of elements that can be read.
+ *
+ * Note: Exact if called by the consumer, a lower bound if called by the producer.
+ */
+	size_t available() const
+	{
+		return wptr.load(std::memory_order_acquire) - rptr.load(std::memory_order_acquire);
+	}
+/**
+ * Get the number of elements that can be written.
+ *
+ * Note: Exact if called by the producer, a lower bound if called by the consumer.
+ */
+	size_t space() const
+	{
+		return capacity() - available();
+	}
+/**
+ * Producer: Write elements.
+ *
+ * Parameter items: The elements to write.
+ * Parameter count: The number of elements to write.
+ * Returns: The number of elements written (less than count if ring got full).
+ */
+	size_t push(const T* items, size_t count)
+	{
+		size_t w = wptr.load(std::memory_order_relaxed);
+		if(count > capacity() - (w - rptr_cache))
+			rptr_cache = rptr.load(std::memory_order_acquire);
+		size_t n = std::min(count, capacity() - (w - rptr_cache));
+		size_t off = w & mask;
+		size_t first = std::min(n, capacity() - off);
+		std::copy(items, items + first, &data[off]);
+		std::copy(items + first, items + n, &data[0]);
+		wptr.store(w + n, std::memory_order_release);
+		return n;
+	}
+/**
+ * Consumer: Read elements.
+ *
+ * Parameter items: The elements read are stored here. If NULL, the elements are just discarded.
+ * Parameter count: The maximum number of elements to read.
+ * Returns: The number of elements read (less than count if ring got empty).
+ */
+	size_t pull(T* items, size_t count)
+	{
+		size_t r = rptr.load(std::memory_order_relaxed);
+		if(count > wptr_cache - r)
+			wptr_cache = wptr.load(std::memory_order_acquire);
+		size_t n = std::min(count, wptr_cache - r);
+		if(items) {
+			size_t off = r & mask;
+			size_t first = std::min(n, capacity() - off);
+			std::copy(&data[off], &data[off] + first, items);
+			std::copy(&data[0], &data[0] + (n - first), items + first);
+		}
+		rptr.store(r + n, std::memory_order_release);
+		return n;
+	}
+/**
+ * Producer: Get the next element to write in place.
+ *
+ * Returns: The element, or NULL if the ring is full. Not visible to consumer until commit().
+ */
+	T* write_slot()
+	{
+		size_t w = wptr.load(std::memory_order_relaxed);
+		if(w - rptr_cache == capacity())
+			rptr_cache = rptr.load(std::memory_order_acquire);
+		if(w - rptr_cache == capacity())
+			return NULL;
+		return &data[w & mask];
+	}
+/**
+ * Producer: Publish the element written via write_slot().
+ */
+	void commit()
+	{
+		wptr.store(wptr.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+/**
+ * Consumer: Get the oldest element in place.
+ *
+ * Returns: The element, or NULL if the ring is empty. Stays valid until release().
+ */
+	T* read_slot()
+	{
+		size_t r = rptr.load(std::memory_order_relaxed);
+		if(wptr_cache == r)
+			wptr_cache = wptr.load(std::memory_order_acquire);
+		if(wptr_cache == r)
+			return NULL;
+		return &data[r & mask];
+	}
+/**
+ * Consumer: Remove the oldest element.
+ */
+	void release()
+	{
+		rptr.store(rptr.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+/**
+ * Empty the ring.
+ *
+ * Note: Not thread-safe, neither producer nor consumer may be active.
+ */
+	void reset()
+	{
+		wptr = 0;
+		rptr = 0;
+		rptr_cache = 0;
+		wptr_cache = 0;
+	}
+private:
+	ring(const ring&);
+	ring& operator=(const ring&);
+	std::vector<T> data;
+	size_t mask;
+	char pad0[SPSCRING_CACHELINE];
+	//Written by producer only.
+	std::atomic<size_t> wptr;
+	size_t rptr_cache;
+	char pad1[SPSCRING_CACHELINE];
+	//Written by consumer only.
+	std::atomic<size_t> rptr;
+	size_t wptr_cache;
+	char pad2[SPSCRING_CACHELINE];
+};
+}
+
+#endif
@@ -8,12 +8,26 @@
 #include <set>
 #include <map>
 #include <functional>
+#include <vector>
+#include <stdexcept>
 #include "minmax.hpp"
 #include <cstring>
 
 namespace streamcompress
 {
 std::map<std::string, std::string> parse_attributes(const std::string& val);
+/**
+ * Train a zstd dictionary from samples (e.g. core savestates).
+ *
+ * The resulting dictionary can be saved to file and given to "zstd" compressor as "dict" attribute.
+ *
+ * Parameter samples: The samples to train from.
+ * Parameter maxsize: Maximum size of the dictionary.
+ * Returns: The trained dictionary.
+ * Throws std::runtime_error: Training failed, or no zstd support.
+ */
+std::vector<char> zstd_train_dictionary(const std::vector<std::vector<char>>& samples, size_t maxsize)
+	throw(std::bad_alloc, std::runtime_error);
 
 class base
 {
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <set>
 #include <list>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <boost/lexical_cast.hpp>
@@ -231,6 +232,63 @@ private:
 regex_results regex(const std::string& regex, const std::string& str, const char* ex = NULL)
 	throw(std::bad_alloc, std::runtime_error);
 
+/**
+ * Flags for regex_pattern.
+ */
+enum regex_pattern_flags
+{
+	REGEX_FLAG_ICASE = 1,
+	REGEX_FLAG_NOSUBS = 2,
+};
+
+/**
+ * A compiled regexp that can be applied many times.
+ *
+ * Compiled patterns are shared through a bounded cache keyed by pattern and flags, so creating a regex_pattern for
+ * a recently used pattern does not recompile it. Applying the pattern is safe from multiple threads at once.
+ *
+ * Hot paths should hold the pattern in a static, e.g. static regex_pattern p("([0-9]+)[ \t]+(.*)");
+ */
+class regex_pattern
+{
+public:
+/**
+ * Compile a regexp (or get it from cache).
+ *
+ * Parameter pattern: The regexp (POSIX extended syntax).
+ * Parameter flags: Bitwise OR of REGEX_FLAG_* flags.
+ * Throws std::runtime_error: The regexp is invalid.
+ */
+	regex_pattern(const std::string& pattern, unsigned flags = 0) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Match a string against the regexp and return the captures.
+ *
+ * Parameter str: The string to match. The entire string must match.
+ * Parameter ex: If non-null and string does not match, throw this as std::runtime_error.
+ * Returns: The captures.
+ */
+	regex_results operator()(const std::string& str, const char* ex = NULL) const throw(std::bad_alloc,
+		std::runtime_error);
+/**
+ * Match a string against the regexp without captures.
+ *
+ * Parameter str: The string to match. The entire string must match.
+ * Returns: True if matches, false if not.
+ */
+	bool match(const std::string& str) const throw(std::bad_alloc);
+/**
+ * Get the pattern.
+ */
+	const std::string& get_pattern() const { return pattern; }
+/**
+ * Compiled form, opaque.
+ */
+	struct compiled;
+private:
+	std::string pattern;
+	std::shared_ptr<const compiled> re;
+};
+
 enum regex_match_mode
 {
 	REGEX_MATCH_REGEX = 0,
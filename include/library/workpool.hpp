@@ -0,0 +1,62 @@
+#ifndef _library_workpool__hpp__included__
+#define _library_workpool__hpp__included__
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <vector>
+#include "threads.hpp"
+
+/**
+ * A pool of worker threads running independent jobs.
+ *
+ * Note: All methods are thread-safe.
+ */
+class workpool
+{
+public:
+/**
+ * Constructor.
+ *
+ * Parameter threads: Number of worker threads. 0 means number of hardware threads.
+ */
+	workpool(unsigned threads = 0);
+/**
+ * Destructor. Waits for all queued jobs to finish.
+ */
+	~workpool();
+/**
+ * Queue a job. The job should not throw, exceptions from it are discarded.
+ *
+ * Parameter job: The job to run.
+ */
+	void submit(std::function<void()> job);
+/**
+ * Get number of worker threads.
+ */
+	unsigned get_threads() { return workers.size(); }
+/**
+ * Get the number of hardware threads (at least 1).
+ */
+	static unsigned hardware_threads();
+/**
+ * Get the shared pool sized to number of hardware threads.
+ */
+	static workpool& shared();
+private:
+	workpool(const workpool&);
+	workpool& operator=(const workpool&);
+	struct reflector
+	{
+		int operator()(workpool* x);
+	};
+	void worker();
+	threads::lock mlock;
+	threads::cv condition;
+	std::list<std::function<void()>> queue;
+	std::vector<threads::thread*> workers;
+	reflector _reflector;
+	bool quitting;
+};
+
+#endif
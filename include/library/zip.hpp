@@ -4,12 +4,14 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <iostream>
 #include <iterator>
+#include <list>
 #include <string>
 #include <map>
 #include <fstream>
 #include <sstream>
 #include <zlib.h>
 #include "string.hpp"
+#include "threads.hpp"
 
 namespace zip
 {
@@ -255,6 +257,43 @@ public:
  */
 	void read_raw_file(const std::string& member, std::vector<char>& out) throw(std::bad_alloc,
 		std::runtime_error);
+/**
+ * Get the uncompressed size of a member.
+ *
+ * Parameter member: Name of the member.
+ * Returns: The size in bytes.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: No such member or error reading file.
+ */
+	uint64_t member_size(const std::string& member) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Get direct view of a stored (uncompressed) member without copying it.
+ *
+ * The archive is memory-mapped on first use. The view stays valid for the lifetime of the reader.
+ *
+ * Parameter member: Name of the member.
+ * Returns: Pointer and size of the contents, or (NULL, 0) if the member is compressed or the archive can't be
+ *	mapped.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: No such member or error reading file.
+ */
+	std::pair<const char*, size_t> stored_span(const std::string& member) throw(std::bad_alloc,
+		std::runtime_error);
+/**
+ * Read a member into caller-supplied buffer in one call, decompressing it if needed.
+ *
+ * If the archive can be memory-mapped, stored members are copied and deflated members are inflated directly
+ * from the mapping, without going through stream buffers.
+ *
+ * Parameter member: Name of the member.
+ * Parameter buf: The buffer to read to.
+ * Parameter bufsize: Size of the buffer. Must be at least member_size(member).
+ * Returns: Number of bytes read (same as member size).
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: No such member, buffer too small or error reading file.
+ */
+	size_t read_into(const std::string& member, char* buf, size_t bufsize) throw(std::bad_alloc,
+		std::runtime_error);
 /**
  * Reads a file consisting of single numeric constant.
  *
@@ -278,9 +317,14 @@ public:
 private:
 	reader(reader&);
 	reader& operator=(reader&);
+	bool map_archive();
 	std::map<std::string, uint64_t> offsets;
 	std::ifstream* zipstream;
 	size_t* refcnt;
+	std::string filename;
+	const char* mapbase;
+	size_t mapsize;
+	bool map_tried;
 };
 
 /**
@@ -333,6 +377,21 @@ std::string resolverel(const std::string& name, const std::string& referencing_p
  */
 bool file_exists(const std::string& name) throw(std::bad_alloc);
 
+/**
+ * ZIP compression method numbers.
+ */
+const uint16_t METHOD_STORE = 0;
+const uint16_t METHOD_DEFLATE = 8;
+const uint16_t METHOD_ZSTD = 93;
+
+/**
+ * Is the specified compression method supported for writing?
+ *
+ * Parameter method: The method number.
+ * Returns: True if supported, false if not.
+ */
+bool method_supported(uint16_t method) throw();
+
 /**
  * This class handles writing a ZIP archives.
  */
@@ -342,14 +401,20 @@ public:
 /**
  * Creates new empty ZIP archive. The members will be compressed according to specified compression.
  *
+ * If compressing and there is more than one hardware thread, members are compressed on the shared worker pool
+ * after close_file() and written out in order they complete.
+ *
  * parameter zipfile: The zipfile to create.
  * parameter stream: The stream to write the ZIP to.
- * parameter _compression: Compression. 0 is uncompressed, 1-9 are deflate compression levels.
+ * parameter _compression: Compression. 0 is uncompressed, 1-9 are compression levels.
+ * parameter _method: Compression method to use if compressing (METHOD_DEFLATE or METHOD_ZSTD).
  * throws std::bad_alloc: Not enough memory.
  * throws std::runtime_error: Can't open archive or invalid argument.
  */
-	writer(const std::string& zipfile, unsigned _compression) throw(std::bad_alloc, std::runtime_error);
-	writer(std::ostream& stream, unsigned _compression) throw(std::bad_alloc, std::runtime_error);
+	writer(const std::string& zipfile, unsigned _compression, uint16_t _method = METHOD_DEFLATE)
+		throw(std::bad_alloc, std::runtime_error);
+	writer(std::ostream& stream, unsigned _compression, uint16_t _method = METHOD_DEFLATE)
+		throw(std::bad_alloc, std::runtime_error);
 /**
  * Destroys ZIP writer, aborting the transaction (unless commit() has been called).
  */
@@ -427,8 +492,22 @@ private:
 		uint32_t offset;
 	};
 
+	struct pending_member
+	{
+		std::string name;
+		std::vector<char> data;
+		uint32_t crc;
+		uint32_t uncompressed_size;
+		bool oom;
+		std::string error;
+		void compress(unsigned level, uint16_t method);
+	};
+
 	writer(writer&);
 	writer& operator=(writer&);
+	void write_member(const std::string& name, uint32_t crc32, uint32_t ucs, const std::vector<char>& data);
+	void flush_completed(bool all);
+	void drain_pending() throw();
 	std::ostream* zipstream;
 	bool system_stream;
 	std::string temp_path;
@@ -438,9 +517,16 @@ private:
 	std::vector<char> current_compressed_file;
 	std::map<std::string, file_info> files;
 	unsigned compression;
+	uint16_t method;
+	bool collect_raw;
 	boost::iostreams::filtering_ostream* s;
 	uint32_t basepos;
 	bool committed;
+	bool parallel;
+	threads::lock plock;
+	threads::cv pcond;
+	size_t pending_count;
+	std::list<pending_member*> completed;
 };
 }
 #endif
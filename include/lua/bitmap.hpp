@@ -9,6 +9,7 @@
 #include "library/lua-class.hpp"
 #include "library/lua-params.hpp"
 #include "library/framebuffer.hpp"
+#include "library/minmax.hpp"
 #include "library/range.hpp"
 #include "library/threads.hpp"
 #include "library/string.hpp"
@@ -121,11 +122,12 @@ public:
 	{
 		p.palette_mutex.unlock();
 	}
-	void draw(size_t bmpidx, typename framebuffer::fb<T>::element_t& target)
+	void draw_row(size_t bmpidx, typename framebuffer::fb<T>::element_t* target, size_t w)
 	{
-		uint16_t i = b.pixels[bmpidx];
-		if(i < pallim)
-			palette[i].apply(target);
+		const uint16_t* s = b.pixels + bmpidx;
+		for(size_t i = 0; i < w; i++)
+			if(s[i] < pallim)
+				palette[s[i]].apply(target[i]);
 	}
 private:
 	lua_bitmap& b;
@@ -141,9 +143,11 @@ public:
 	size_t stride() { return d.width; }
 	void lock() {}
 	void unlock() {}
-	void draw(size_t bmpidx, typename framebuffer::fb<T>::element_t& target)
+	void draw_row(size_t bmpidx, typename framebuffer::fb<T>::element_t* target, size_t w)
 	{
-		d.pixels[bmpidx].apply(target);
+		framebuffer::color* s = d.pixels + bmpidx;
+		for(size_t i = 0; i < w; i++)
+			s[i].apply(target[i]);
 	}
 private:
 	lua_dbitmap& d;
@@ -159,19 +163,19 @@ template<bool T, class B> void lua_bitmap_composite(struct framebuffer::fb<T>& s
 
 	for(uint32_t r = Y.low(); r != Y.high(); r++) {
 		typename framebuffer::fb<T>::element_t* rptr = scr.rowptr(yp + r);
-		size_t eptr = xp + X.low();
-		uint32_t xmin = X.low();
 		bool cut = outside && sY.in(r);
-		if(cut && sX.in(xmin)) {
-			xmin = sX.high();
-		eptr += (sX.high() - X.low());
-		}
-		for(uint32_t c = xmin; c < X.high(); c++, eptr++) {
-			if(__builtin_expect(cut && c == sX.low(), 0)) {
-				c += sX.size();
-				eptr += sX.size();
+		//Draw the row in runs, skipping the part cut out by the screen.
+		uint32_t c = X.low();
+		while(c != X.high()) {
+			uint32_t n = X.high() - c;
+			if(cut && sX.in(c)) {
+				c += min(n, sX.high() - c);
+				continue;
 			}
-			bmp.draw(r * stride + c, rptr[eptr]);
+			if(cut && sX.size() && sX.low() - c < n)
+				n = sX.low() - c;
+			bmp.draw_row(r * stride + c, rptr + xp + c, n);
+			c += n;
 		}
 	}
 	bmp.unlock();
@@ -10,6 +10,7 @@
 #include "library/framebuffer.hpp"
 #include "library/lua-base.hpp"
 #include "library/lua-framebuffer.hpp"
+#include "library/lua-pin.hpp"
 #include "library/memtracker.hpp"
 #include "library/settingvar.hpp"
 
@@ -20,6 +21,8 @@ namespace keyboard { class key; }
 #define LUA_TIMED_HOOK_TIMER 1
 
 class emulator_instance;
+struct input_search_result;
+struct lua_unsaferewind;
 
 void init_lua(emulator_instance& inst) throw();
 void quit_lua(emulator_instance& inst) throw();
@@ -56,6 +59,7 @@ struct lua_state
 	lua::state::callback_list* on_post_rewind;
 	lua::state::callback_list* on_set_rewind;
 	lua::state::callback_list* on_latch;
+	lua::state::callback_list* on_input_search;
 
 	void callback_do_paint(struct lua::render_context* ctx, bool non_synthethic) throw();
 	void callback_do_video(struct lua::render_context* ctx, bool& kill_frame, uint32_t& hscl, uint32_t& vscl)
@@ -81,6 +85,7 @@ struct lua_state
 	bool callback_do_button(uint32_t port, uint32_t controller, uint32_t index, const char* type);
 	void callback_movie_lost(const char* what);
 	void callback_do_latch(std::list<std::string>& args);
+	void callback_input_search(const input_search_result& r);
 	void run_startup_scripts();
 	void add_startup_script(const std::string& file);
 
@@ -108,6 +113,8 @@ struct lua_state
 	bool renderq_redirect;
 	void set_memory_limit(size_t max_mb);
 
+	//Unsafe rewind object to save the next unsafe rewind into (instead of creating a new one).
+	lua::objpin<lua_unsaferewind> rewind_reuse;
 	std::list<std::string> startup_scripts;
 	std::map<std::string, std::u32string> watch_vars;
 private:
@@ -2,6 +2,7 @@
 #define _lua__unsaferewind__hpp__included__
 
 #include "library/lua-base.hpp"
+#include "library/lua-params.hpp"
 #include "library/string.hpp"
 #include "core/moviefile.hpp"
 
@@ -13,6 +14,8 @@ struct lua_unsaferewind
 	dynamic_state console_state;
 	//Extra state variable involved in fast movie restore. It is not part of normal console state.
 	uint64_t ptr;
+	int reuse(lua::state& L, lua::parameters& P);
+	int size(lua::state& L, lua::parameters& P);
 	std::string print()
 	{
 		return (stringfmt() << "to frame " << console_state.save_frame).str();
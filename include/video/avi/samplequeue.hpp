@@ -1,14 +1,16 @@
 #ifndef _avi__samplequeue__hpp__included__
 #define _avi__samplequeue__hpp__included__
 
-#include <deque>
+#include <atomic>
 #include <cstdint>
 #include <vector>
 #include <cstdlib>
-#include "library/threads.hpp"
+#include "library/spscring.hpp"
 
 /**
  * Sample queue.
+ *
+ * The queue is lock-free, but only one thread may push and one thread pull at a time.
  */
 class sample_queue
 {
@@ -17,6 +19,10 @@ public:
  * Construct new sample queue.
  */
 	sample_queue();
+/**
+ * Destroy a sample queue.
+ */
+	~sample_queue();
 /**
  * Push samples into queue.
  *
@@ -42,13 +48,19 @@ public:
  */
 	size_t available();
 private:
-	size_t _available();
-	std::vector<int16_t> data;
-	bool blank;
-	size_t rptr;
-	size_t wptr;
-	size_t size;
-	threads::lock mlock;
+	//The queue is a chain of rings. When the last ring gets full, a bigger one is appended.
+	struct segment
+	{
+		segment(size_t capacity) : ring(capacity), next(NULL) {}
+		spscring::ring<int16_t> ring;
+		std::atomic<segment*> next;
+	};
+	sample_queue(const sample_queue&);
+	sample_queue& operator=(const sample_queue&);
+	//Owned by the puller.
+	segment* head;
+	//Owned by the pusher.
+	segment* tail;
 };
 
 struct frame_object
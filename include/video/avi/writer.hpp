@@ -1,6 +1,7 @@
 #ifndef _avi__avi_writer__hpp__included__
 #define _avi__avi_writer__hpp__included__
 
+#include <deque>
 #include <string>
 #include <fstream>
 #include "video/avi/codec.hpp"
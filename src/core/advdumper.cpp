@@ -2,6 +2,7 @@
 #include "core/instance.hpp"
 #include "core/misc.hpp"
 #include "library/globalwrap.hpp"
+#include "library/profiler.hpp"
 #include "library/string.hpp"
 #include "lua/lua.hpp"
 
@@ -257,6 +258,7 @@ unsigned master_dumper::get_dumper_count() throw()
 
 void master_dumper::on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
 {
+	PROFILE_SPAN("dump.frame");
 	threads::arlock h(lock);
 	for(auto i : sdumpers)
 		try {
@@ -42,83 +42,25 @@ int audioapi_instance::dummy_cb_proc::operator()()
 	return 0;
 }
 
-namespace
-{
-//  | -1  1 -1  1 | 1  0  0  0 |
-//  |  0  0  0  1 | 0  1  0  0 |
-//  |  1  1  1  1 | 0  0  1  0 |
-//  |  8  4  2  1 | 0  0  0  1 |
-
-
-//  |  6  0  0  0 |-1  4 -3  1 |           |-1  3 -3  1|
-//  |  0  6  0  0 | 3 -6  3  0 |      1/6  | 3 -6  3  0|
-//  |  0  0  6  0 |-2 -4  6 -1 |           |-2 -3  6 -1|
-//  |  0  0  0  6 | 0  6  0  0 |           | 0  6  0  0|
-
-
-
-	void cubicitr_solve(double v1, double v2, double v3, double v4, double& A, double& B, double& C, double& D)
-	{
-		A = (-v1 + 3 * v2 - 3 * v3 + v4) / 6;
-		B = (v1 - 2 * v2 + v3) / 2;
-		C = (-2 * v1 - 3 * v2 + 6 * v3 - v4) / 6;
-		D = v2;
-	}
-}
-
 audioapi_instance::resampler::resampler()
+	: sinc(sincresample::QUALITY_NORMAL)
 {
-	position = 0;
-	vAl = vBl = vCl = vDl = 0;
-	vAr = vBr = vCr = vDr = 0;
 }
 
 void audioapi_instance::resampler::resample(float*& in, size_t& insize, float*& out, size_t& outsize, double ratio,
 	bool stereo)
 {
-	double iratio = 1 / ratio;
-	while(outsize) {
-		double newpos = position + iratio;
-		while(newpos >= 1) {
-			//Gotta load a new sample.
-			if(!insize)
-				goto exit;
-			vAl = vBl; vBl = vCl; vCl = vDl; vDl = in[0];
-			vAr = vBr; vBr = vCr; vCr = vDr; vDr = in[stereo ? 1 : 0];
-			--insize;
-			in += (stereo ? 2 : 1);
-			newpos = newpos - 1;
-		}
-		position = newpos;
-		double A, B, C, D;
-		cubicitr_solve(vAl, vBl, vCl, vDl, A, B, C, D);
-		*(out++) = ((A * position + B) * position + C) * position + D;
-		if(stereo) {
-			cubicitr_solve(vAr, vBr, vCr, vDr, A, B, C, D);
-			*(out++) = ((A * position + B) * position + C) * position + D;
-		}
-		--outsize;
-	}
-exit:
-	;
+	const float* _in = in;
+	sinc.resample(_in, insize, out, outsize, ratio, stereo);
+	in += (_in - in);
 }
 
 audioapi_instance::audioapi_instance()
-	: dummyproc(*this)
+	: dummyproc(*this), music_ring(MUSIC_BUFFERS), voicep_ring(voicep_bufsize), voicer_ring(voicer_bufsize)
 {
 	dummythread = NULL;
 	music_ptr = 0;
-	last_complete_music_seen = MUSIC_BUFFERS + 1;
-	last_complete_music = MUSIC_BUFFERS;
-	for(unsigned i = 0; i < MUSIC_BUFFERS; i++) {
-		music_size[i] = 0;
-		music_rate[i] = 48000;
-		music_stereo[i] = false;
-	}
-	voicep_get = 0;
-	voicep_put = 0;
-	voicer_get = 0;
-	voicer_put = 0;
+	music_empty = true;
 	voice_rate_play = 40000;
 	orig_voice_rate_play = 40000;
 	voice_rate_rec = 40000;
@@ -129,6 +71,7 @@ audioapi_instance::audioapi_instance()
 	_voicep_volume = 32767.0;
 	_voicer_volume = 1.0/32768;
 	last_adjust = false;
+	music_discard = false;
 }
 
 audioapi_instance::~audioapi_instance()
@@ -162,58 +105,35 @@ void audioapi_instance::voice_rate(unsigned rate_rec, unsigned rate_play)
 
 unsigned audioapi_instance::voice_p_status()
 {
-	unsigned p = voicep_put;
-	unsigned g = voicep_get;
-	if(g > p)
-		return g - p - 1;
-	else
-		return voicep_bufsize - (p - g) - 1;
+	return voicep_ring.space();
 }
 
 unsigned audioapi_instance::voice_p_status2()
 {
-	unsigned p = voicep_put;
-	unsigned g = voicep_get;
-	if(g > p)
-		return voicep_bufsize - (g - p);
-	else
-		return (p - g);
+	return voicep_ring.available();
 }
 
 unsigned audioapi_instance::voice_r_status()
 {
-	unsigned p = voicer_put;
-	unsigned g = voicer_get;
-	if(g > p)
-		return voicer_bufsize - (g - p);
-	else
-		return (p - g);
+	return voicer_ring.available();
 }
 
 void audioapi_instance::play_voice(float* samples, size_t count)
 {
-	unsigned ptr = voicep_put;
-	for(size_t i = 0; i < count; i++) {
-		voicep_buffer[ptr++] = samples[i];
-		if(ptr == voicep_bufsize)
-			ptr = 0;
-	}
-	voicep_put = ptr;
+	voicep_ring.push(samples, count);
 }
 
 void audioapi_instance::record_voice(float* samples, size_t count)
 {
-	unsigned ptr = voicer_get;
-	for(size_t i = 0; i < count; i++) {
-		samples[i] = voicer_buffer[ptr++];
-		if(ptr == voicer_bufsize)
-			ptr = 0;
-	}
-	voicer_get = ptr;
+	size_t got = voicer_ring.pull(samples, count);
+	for(size_t i = got; i < count; i++)
+		samples[i] = 0;
 }
 
 void audioapi_instance::submit_buffer(int16_t* samples, size_t count, bool stereo, double rate)
 {
+	if(music_discard)
+		return;
 	if(stereo)
 		for(unsigned i = 0; i < count; i++)
 			CORE().mdumper->on_sample(samples[2 * i + 0], samples[2 * i + 1]);
@@ -223,20 +143,20 @@ void audioapi_instance::submit_buffer(int16_t* samples, size_t count, bool stere
 	//Limit buffers to avoid overrunning.
 	if(count > music_bufsize / (stereo ? 2 : 1))
 		count = music_bufsize / (stereo ? 2 : 1);
-	unsigned bidx = last_complete_music;
-	bidx = (bidx > (MUSIC_BUFFERS - 2)) ? 0 : bidx + 1;
-	memcpy(music_buffer + bidx * music_bufsize, samples, count * (stereo ? 2 : 1) * sizeof(int16_t));
-	music_stereo[bidx] = stereo;
-	music_rate[bidx] = rate;
-	music_size[bidx] = count;
-	last_complete_music = bidx;
+	music_block* blk = music_ring.write_slot();
+	if(!blk)
+		return;		//Sound driver is way behind, it skips buffers to catch up.
+	memcpy(blk->samples, samples, count * (stereo ? 2 : 1) * sizeof(int16_t));
+	blk->stereo = stereo;
+	blk->rate = rate;
+	blk->size = count;
+	music_ring.commit();
 }
 
 struct audioapi_instance::buffer audioapi_instance::get_music(size_t played)
 {
-	unsigned midx = last_complete_music_seen;
-	unsigned midx2 = last_complete_music;
-	if(midx2 >= MUSIC_BUFFERS) {
+	music_block* cur = music_ring.read_slot();
+	if(!cur) {
 		//Special case: No buffer.
 		struct buffer out;
 		out.samples = NULL;
@@ -245,54 +165,54 @@ struct audioapi_instance::buffer audioapi_instance::get_music(size_t played)
 		out.total = 64;
 		out.stereo = false;
 		out.rate = 48000;
+		music_ptr = 0;
+		music_empty = true;
 		return out;
 	}
-	//Handle ACK. If the current buffer is too old, we want to ignore the ACK.
-	if(midx >= MUSIC_BUFFERS) {
-		//Load initial buffer.
-		midx = last_complete_music_seen = 0;
+	//Samples played while there was no buffer were silence, so the first buffer starts from its beginning.
+	if(music_empty)
+		music_empty = false;
+	else
+		music_ptr += played;
+	if(music_ring.available() == music_ring.capacity()) {
+		//The ring is full, so new buffers are being dropped. Bump buffer by one.
+		if(!last_adjust && voice_rate_play > orig_voice_rate_play - MAX_VOICE_ADJUST)
+			voice_rate_play--;
+		last_adjust = true;
+		music_ring.release();
+		cur = music_ring.read_slot();
+		music_ptr = 0;
+	} else if(music_ptr >= cur->size && music_ring.available() > 1) {
+		//Current buffer is finished.
+		music_ring.release();
+		cur = music_ring.read_slot();
 		music_ptr = 0;
+		last_adjust = false;
+	} else if(music_ptr >= cur->size) {
+		if(!last_adjust && voice_rate_play < orig_voice_rate_play + MAX_VOICE_ADJUST)
+			voice_rate_play++;
+		last_adjust = true;
+		//Current buffer is finished, but there is no new buffer.
+		//Send silence.
 	} else {
-		music_ptr += played;
-		//Otherwise, check if current buffer is not next on the line to be overwritten.
-		if((midx2 + 1) % MUSIC_BUFFERS == midx) {
-			//It is, bump buffer by one.
-			if(!last_adjust && voice_rate_play > orig_voice_rate_play - MAX_VOICE_ADJUST)
-				voice_rate_play--;
-			last_adjust = true;
-			midx = last_complete_music_seen = (midx + 1) % MUSIC_BUFFERS;
-			music_ptr = 0;
-		} else if(music_ptr >= music_size[midx] && midx != midx2) {
-			//It isn't, but current buffer is finished.
-			midx = last_complete_music_seen = (midx + 1) % MUSIC_BUFFERS;
-			music_ptr = 0;
-			last_adjust = false;
-		} else if(music_ptr >= music_size[midx] && midx == midx2) {
-			if(!last_adjust && voice_rate_play < orig_voice_rate_play + MAX_VOICE_ADJUST)
-				voice_rate_play++;
-			last_adjust = true;
-			//Current buffer is finished, but there is no new buffer.
-			//Send silence.
-		} else {
-			last_adjust = false;
-			//Can continue.
-		}
+		last_adjust = false;
+		//Can continue.
 	}
 	//Fill the structure.
 	struct buffer out;
-	if(music_ptr < music_size[midx]) {
-		out.samples = music_buffer + midx * music_bufsize;
+	if(music_ptr < cur->size) {
+		out.samples = cur->samples;
 		out.pointer = music_ptr;
-		out.total = music_size[midx];
-		out.stereo = music_stereo[midx];
-		out.rate = music_rate[midx];
+		out.total = cur->size;
+		out.stereo = cur->stereo;
+		out.rate = cur->rate;
 	} else {
 		//Run out of buffers to play.
 		out.samples = NULL;
 		out.pointer = 0;
 		out.total = 64;		//Arbitrary.
-		out.stereo = music_stereo[midx];
-		out.rate = music_rate[midx];
+		out.stereo = cur->stereo;
+		out.rate = cur->rate;
 		if(out.rate < 100)
 			out.rate = 48000;	//Apparently there are buffers with zero rate.
 	}
@@ -301,48 +221,40 @@ struct audioapi_instance::buffer audioapi_instance::get_music(size_t played)
 
 void audioapi_instance::get_voice(float* samples, size_t count)
 {
-	unsigned g = voicep_get;
-	unsigned p = voicep_put;
 	if(samples) {
-		for(size_t i = 0; i < count; i++) {
-			if(g != p)
-				samples[i] = _voicep_volume * voicep_buffer[g++];
-			else
-				samples[i] = 0.0;
-			if(g == voicep_bufsize)
-				g = 0;
-		}
-	} else {
-		for(size_t i = 0; i < count; i++) {
-			if(g != p)
-				g++;
-			if(g == voicep_bufsize)
-				g = 0;
-		}
-	}
-	voicep_get = g;
+		size_t got = voicep_ring.pull(samples, count);
+		for(size_t i = 0; i < got; i++)
+			samples[i] *= _voicep_volume;
+		for(size_t i = got; i < count; i++)
+			samples[i] = 0.0;
+	} else
+		voicep_ring.pull(NULL, count);
 }
 
 void audioapi_instance::put_voice(float* samples, size_t count)
 {
-	unsigned ptr = voicer_put;
+	const size_t tmpbuf_size = 256;
+	float tmpbuf[tmpbuf_size];
 	vu_vin(samples, count, false, voice_rate_rec, _voicer_volume);
-	for(size_t i = 0; i < count; i++) {
-		voicer_buffer[ptr++] = samples ? _voicer_volume * samples[i] : 0.0;
-		if(ptr == voicer_bufsize)
-			ptr = 0;
+	while(count > 0) {
+		size_t n = min(count, tmpbuf_size);
+		for(size_t i = 0; i < n; i++)
+			tmpbuf[i] = samples ? _voicer_volume * samples[i] : 0.0;
+		//If the voice thread is not keeping up, the rest gets dropped.
+		voicer_ring.push(tmpbuf, n);
+		if(samples)
+			samples += n;
+		count -= n;
 	}
-	voicer_put = ptr;
 }
 
 void audioapi_instance::init()
 {
-	voicep_get = 0;
-	voicep_put = 0;
-	voicer_get = 0;
-	voicer_put = 0;
-	last_complete_music = 3;
-	last_complete_music_seen = 4;
+	music_ring.reset();
+	voicep_ring.reset();
+	voicer_ring.reset();
+	music_ptr = 0;
+	music_empty = true;
 	dummy_cb_active_play = true;
 	dummy_cb_active_record = true;
 	dummy_cb_quit = false;
@@ -371,7 +371,8 @@ bool button_mapping::check_button_active(const std::string& name)
 	if(ckey) {
 		auto cb = mapper.get_controllerkeys_kbdkey(ckey);
 		for(auto i : cb) {
-			regex_results r = regex("[^ \t]+[ \t]+([^ \t]+)([ \t]+.*)?", i->get_command());
+			static regex_pattern bindcmd("[^ \t]+[ \t]+([^ \t]+)([ \t]+.*)?");
+			regex_results r = bindcmd(i->get_command());
 			if(!r)
 				continue;
 			if(active_buttons.count(r[1]))
@@ -473,7 +474,8 @@ void button_mapping::do_action(const std::string& name, short state, int mode)
 void button_mapping::do_analog_action(const std::string& a)
 {
 	int _value;
-	regex_results r = regex("([^ \t]+)[ \t]+(-?[0-9]+)[ \t]*", a, "Invalid analog action");
+	static regex_pattern analogcmd("([^ \t]+)[ \t]+(-?[0-9]+)[ \t]*");
+	regex_results r = analogcmd(a, "Invalid analog action");
 	std::string name = r[1];
 	int value = parse_value<int>(r[2]);
 	if(!all_buttons.count(name)) {
@@ -498,8 +500,8 @@ void button_mapping::do_analog_action(const std::string& a)
 
 void button_mapping::do_autofire_action(const std::string& a, int mode)
 {
-	regex_results r = regex("([^ \t]+)(([ \t]+([0-9]+))?[ \t]+([0-9]+))?[ \t]*", a,
-		"Invalid autofire parameters");
+	static regex_pattern autofirecmd("([^ \t]+)(([ \t]+([0-9]+))?[ \t]+([0-9]+))?[ \t]*");
+	regex_results r = autofirecmd(a, "Invalid autofire parameters");
 	std::string name = r[1];
 	std::string _duty = r[4];
 	std::string _cyclelen = r[5];
@@ -19,7 +19,8 @@ namespace
 	command::fnptr<const std::string&> macro_test(lsnes_cmds, CMACRO::test,
 		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
 			auto& core = CORE();
-			regex_results r = regex("([0-9]+)[ \t](.*)", args);
+			static regex_pattern syntax("([0-9]+)[ \t](.*)");
+			regex_results r = syntax(args);
 			if(!r) {
 				messages << "Bad syntax" << std::endl;
 				return;
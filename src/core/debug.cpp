@@ -9,6 +9,7 @@
 #include "core/rom.hpp"
 #include "library/directory.hpp"
 #include "library/memoryspace.hpp"
+#include "library/profiler.hpp"
 
 #include <functional>
 #include <stdexcept>
@@ -101,6 +102,7 @@ void debug_context::remove_callback(uint64_t addr, debug_context::etype type, de
 
 void debug_context::do_callback_read(uint64_t addr, uint64_t value)
 {
+	PROFILE_SPAN("debug.read");
 	params p;
 	p.type = DEBUG_READ;
 	p.rwx.addr = addr;
@@ -119,6 +121,7 @@ void debug_context::do_callback_read(uint64_t addr, uint64_t value)
 
 void debug_context::do_callback_write(uint64_t addr, uint64_t value)
 {
+	PROFILE_SPAN("debug.write");
 	params p;
 	p.type = DEBUG_WRITE;
 	p.rwx.addr = addr;
@@ -137,6 +140,7 @@ void debug_context::do_callback_write(uint64_t addr, uint64_t value)
 
 void debug_context::do_callback_exec(uint64_t addr, uint64_t cpu)
 {
+	PROFILE_SPAN("debug.exec");
 	params p;
 	p.type = DEBUG_EXEC;
 	p.rwx.addr = addr;
@@ -156,6 +160,7 @@ void debug_context::do_callback_exec(uint64_t addr, uint64_t cpu)
 
 void debug_context::do_callback_trace(uint64_t cpu, const char* str, bool true_insn)
 {
+	PROFILE_SPAN("debug.trace");
 	params p;
 	p.type = DEBUG_TRACE;
 	p.trace.cpu = cpu;
@@ -172,6 +177,7 @@ void debug_context::do_callback_trace(uint64_t cpu, const char* str, bool true_i
 
 void debug_context::do_callback_frame(uint64_t frame, bool loadstate)
 {
+	PROFILE_SPAN("debug.frame");
 	params p;
 	p.type = DEBUG_FRAME;
 	p.frame.frame = frame;
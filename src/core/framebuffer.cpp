@@ -15,6 +15,7 @@
 #include "library/framebuffer.hpp"
 #include "library/framebuffer-pixfmt-lrgb.hpp"
 #include "library/minmax.hpp"
+#include "library/profiler.hpp"
 #include "library/triplebuffer.hpp"
 #include "lua/lua.hpp"
 
@@ -136,6 +137,7 @@ void emu_framebuffer::init_special_screens() throw(std::bad_alloc)
 
 void emu_framebuffer::redraw_framebuffer(framebuffer::raw& todraw, bool no_lua, bool spontaneous)
 {
+	PROFILE_SPAN("redraw");
 	uint32_t hscl, vscl;
 	auto g = rom.get_scale_factors(todraw.get_width(), todraw.get_height());
 	hscl = g.first;
@@ -178,6 +180,7 @@ void emu_framebuffer::redraw_framebuffer()
 
 void emu_framebuffer::render_framebuffer()
 {
+	PROFILE_SPAN("render");
 	render_info& ri = buffering.get_read();
 	main_screen.reallocate(ri.fbuf.get_width() * ri.hscl + ri.lgap + ri.rgap, ri.fbuf.get_height() * ri.vscl +
 		ri.tgap + ri.bgap);
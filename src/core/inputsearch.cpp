@@ -0,0 +1,444 @@
+#include "cmdhelp/inputsearch.hpp"
+#include "core/advdumper.hpp"
+#include "core/audioapi.hpp"
+#include "core/command.hpp"
+#include "core/controllerframe.hpp"
+#include "core/inputsearch.hpp"
+#include "core/instance.hpp"
+#include "core/memorywatch.hpp"
+#include "core/messages.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "interface/callbacks.hpp"
+#include "library/forkpool.hpp"
+#include "library/hex.hpp"
+#include "library/memoryfingerprint.hpp"
+#include "library/memoryspace.hpp"
+#include "library/minmax.hpp"
+#include "library/serialization.hpp"
+#include "library/string.hpp"
+#include "library/zip.hpp"
+#include <algorithm>
+#include <memory>
+#include <set>
+
+namespace
+{
+	//Callbacks used while searching: Inputs come from the candidate, and nothing leaks to the outside.
+	struct search_callbacks : public emucore_callbacks
+	{
+		search_callbacks(emucore_callbacks* _parent) : parent(_parent), input(NULL) {}
+		~search_callbacks() throw() {}
+		int16_t get_input(unsigned port, unsigned index, unsigned control)
+		{
+			return input ? input->axis3(port, index, control) : 0;
+		}
+		int16_t set_input(unsigned port, unsigned index, unsigned control, int16_t value)
+		{
+			return value;
+		}
+		void notify_latch(std::list<std::string>& args) {}
+		void timer_tick(uint32_t increment, uint32_t per_second) {}
+		std::string get_firmware_path() { return parent->get_firmware_path(); }
+		std::string get_base_path() { return parent->get_base_path(); }
+		time_t get_time() { return parent->get_time(); }
+		time_t get_randomseed() { return parent->get_randomseed(); }
+		void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d) {}
+		void action_state_updated() {}
+		void memory_read(uint64_t addr, uint64_t value) {}
+		void memory_write(uint64_t addr, uint64_t value) {}
+		void memory_execute(uint64_t addr, uint64_t proc) {}
+		void memory_trace(uint64_t proc, const char* str, bool insn) {}
+		emucore_callbacks* parent;
+		portctrl::frame* input;
+	};
+
+	//Swaps the callbacks and discards the sound for the duration of search. Cores submit sound directly, not
+	//through the callbacks.
+	struct callbacks_swap
+	{
+		callbacks_swap(emucore_callbacks* cb, audioapi_instance& _audio)
+			: old(ecore_callbacks), audio(_audio)
+		{
+			ecore_callbacks = cb;
+			audio.discard_music(true);
+		}
+		~callbacks_swap()
+		{
+			ecore_callbacks = old;
+			audio.discard_music(false);
+		}
+		emucore_callbacks* old;
+		audioapi_instance& audio;
+	};
+
+	struct search_node
+	{
+		size_t parent;		//Index of parent node, meaningless for root.
+		size_t input;		//Index of the candidate leading to this node.
+		unsigned depth;		//Number of frames from root.
+		int64_t score;
+		std::vector<char> state;
+	};
+
+	struct pending_search
+	{
+		input_search_params params;
+		std::function<void(const input_search_result& r)> done;
+	};
+	pending_search* pending;
+
+	settingvar::supervariable<settingvar::model_int<1, 256>> SET_search_workers(lsnes_setgrp, "search-workers",
+		"Movie‣Input search worker processes", 1);
+
+	int64_t evaluate_score(GC::pointer<mathexpr::mathexpr>& expr)
+	{
+		expr->reset();
+		mathexpr::value v = expr->evaluate();
+		return v.type->tosigned(v._value);
+	}
+
+	//State shared by the search and its workers.
+	struct search_context
+	{
+		search_context(emulator_instance& _core, const input_search_params& _p)
+			: core(_core), p(_p), cb(ecore_callbacks), fingerprint(true)
+		{
+			score = core.mwatch->parse_expression(p.score);
+		}
+		//Emulate one frame from given state with given candidate.
+		void step(const std::vector<char>& state, size_t candidate)
+		{
+			core.rom->load_core_state(state, true);
+			portctrl::frame in = p.candidates[candidate];
+			cb.input = &in;
+			core.rom->emulate();
+			cb.input = NULL;
+		}
+		std::vector<char> save()
+		{
+			core.rom->runtosave();
+			return core.rom->save_core_state(true);
+		}
+		//Worker job: 'E' + count + state => Fingerprint and score for each of first count candidates,
+		//'S' + candidate + state => state.
+		void worker(const std::vector<char>& in, std::vector<char>& out)
+		{
+			std::vector<char> state(in.begin() + 9, in.end());
+			if(in[0] == 'S') {
+				step(state, serialization::u64l(&in[1]));
+				out = save();
+				return;
+			}
+			size_t count = min(serialization::u64l(&in[1]), (uint64_t)p.candidates.size());
+			out.resize(24 * count);
+			for(size_t i = 0; i < count; i++) {
+				step(state, i);
+				fingerprint.compute(*core.memory, reinterpret_cast<uint8_t*>(&out[24 * i]));
+				serialization::s64l(&out[24 * i + 16], evaluate_score(score));
+			}
+		}
+		emulator_instance& core;
+		const input_search_params& p;
+		GC::pointer<mathexpr::mathexpr> score;
+		search_callbacks cb;
+		memory_fingerprint fingerprint;
+	};
+
+	//The states kept on one depth, best last.
+	class search_level
+	{
+	public:
+		search_level(std::vector<search_node>& _nodes, size_t& _best, size_t _beam)
+			: nodes(_nodes), best(_best), beam(_beam), cmp()
+		{
+		}
+		//Would a state with this score be kept?
+		bool admit(int64_t s)
+		{
+			return !beam || heap.size() < beam || s > heap.front().first;
+		}
+		//Add a state (that was admitted).
+		void add(search_node& c)
+		{
+			if(beam && heap.size() >= beam) {
+				//Evict the worst state on this level.
+				std::pop_heap(heap.begin(), heap.end(), cmp);
+				std::vector<char>().swap(nodes[heap.back().second].state);
+				heap.pop_back();
+			}
+			nodes.push_back(c);
+			heap.push_back(std::make_pair(c.score, nodes.size() - 1));
+			std::push_heap(heap.begin(), heap.end(), cmp);
+			if(c.score > nodes[best].score)
+				best = nodes.size() - 1;
+		}
+		std::vector<size_t> get()
+		{
+			std::vector<size_t> r;
+			std::sort(heap.begin(), heap.end(), cmp);
+			for(auto i = heap.rbegin(); i != heap.rend(); i++)
+				r.push_back(i->second);
+			return r;
+		}
+	private:
+		std::vector<search_node>& nodes;
+		size_t& best;
+		size_t beam;
+		//Min-heap of (score, node).
+		std::vector<std::pair<int64_t, size_t>> heap;
+		std::greater<std::pair<int64_t, size_t>> cmp;
+	};
+
+	//Expand the frontier in this process. Returns false if node limit was hit.
+	bool expand_serial(search_context& ctx, std::vector<search_node>& nodes, std::vector<size_t>& frontier,
+		search_level& next, unsigned d, std::set<std::string>& seen, input_search_result& r)
+	{
+		auto& p = ctx.p;
+		for(auto n : frontier) {
+			for(size_t i = 0; i < p.candidates.size(); i++) {
+				if(p.max_nodes && r.explored >= p.max_nodes)
+					return false;
+				ctx.step(nodes[n].state, i);
+				r.explored++;
+				if(!seen.insert(ctx.fingerprint.compute(*ctx.core.memory)).second) {
+					r.duplicates++;
+					continue;
+				}
+				int64_t s = evaluate_score(ctx.score);
+				if(!next.admit(s))
+					continue;
+				search_node c;
+				c.parent = n;
+				c.input = i;
+				c.depth = d + 1;
+				c.score = s;
+				c.state = ctx.save();
+				next.add(c);
+			}
+			//States of expanded nodes are not needed anymore.
+			if(n)
+				std::vector<char>().swap(nodes[n].state);
+		}
+		return true;
+	}
+
+	//Expand the frontier on worker processes. First score all children, and then get the states of the ones
+	//that are kept. Returns false if node limit was hit.
+	bool expand_parallel(search_context& ctx, forkpool::pool& workers, std::vector<search_node>& nodes,
+		std::vector<size_t>& frontier, search_level& next, unsigned d, std::set<std::string>& seen,
+		input_search_result& r)
+	{
+		auto& p = ctx.p;
+		size_t count = frontier.size();
+		size_t partial = 0;	//Candidates to expand from the parent after the first count, if node limit hits.
+		bool complete = true;
+		if(p.max_nodes) {
+			uint64_t left = (p.max_nodes > r.explored) ? p.max_nodes - r.explored : 0;
+			if(left / p.candidates.size() < count) {
+				count = left / p.candidates.size();
+				partial = left % p.candidates.size();
+				complete = false;
+			}
+		}
+		std::vector<std::vector<char>> jobs;
+		std::vector<std::vector<char>> results;
+		for(size_t j = 0; j < count + (partial ? 1 : 0); j++) {
+			std::vector<char> job(9, 'E');
+			serialization::u64l(&job[1], (j < count) ? p.candidates.size() : partial);
+			job.insert(job.end(), nodes[frontier[j]].state.begin(), nodes[frontier[j]].state.end());
+			jobs.push_back(job);
+		}
+		workers.run(jobs, results);
+		size_t first = nodes.size();
+		for(size_t j = 0; j < jobs.size(); j++) {
+			for(size_t i = 0; i < results[j].size() / 24; i++) {
+				r.explored++;
+				std::string fp = hex::b_to(reinterpret_cast<uint8_t*>(&results[j][24 * i]), 16);
+				if(!seen.insert(fp).second) {
+					r.duplicates++;
+					continue;
+				}
+				int64_t s = serialization::s64l(&results[j][24 * i + 16]);
+				if(!next.admit(s))
+					continue;
+				search_node c;
+				c.parent = frontier[j];
+				c.input = i;
+				c.depth = d + 1;
+				c.score = s;
+				//Placeholder, so that eviction is not confused with missing state.
+				c.state.resize(1);
+				next.add(c);
+			}
+		}
+		//Recreate the states of kept children.
+		std::vector<size_t> kept;
+		jobs.clear();
+		for(size_t k = first; k < nodes.size(); k++) {
+			if(nodes[k].state.empty())
+				continue;
+			std::vector<char> job(9, 'S');
+			serialization::u64l(&job[1], nodes[k].input);
+			auto& ps = nodes[nodes[k].parent].state;
+			job.insert(job.end(), ps.begin(), ps.end());
+			jobs.push_back(job);
+			kept.push_back(k);
+		}
+		workers.run(jobs, results);
+		for(size_t k = 0; k < kept.size(); k++)
+			std::swap(nodes[kept[k]].state, results[k]);
+		for(size_t j = 0; j < frontier.size(); j++)
+			if(frontier[j])
+				std::vector<char>().swap(nodes[frontier[j]].state);
+		return complete;
+	}
+
+	void run_search(emulator_instance& core, const input_search_params& p, input_search_result& r)
+	{
+		if(p.candidates.empty())
+			throw std::runtime_error("No candidate inputs");
+		if(core.mdumper->get_dumper_count())
+			throw std::runtime_error("Can't search while dumping");
+		search_context ctx(core, p);
+		std::set<std::string> seen;
+		std::vector<search_node> nodes;
+		std::vector<size_t> frontier;
+		unsigned nworkers = p.workers ? p.workers : SET_search_workers(*core.settings);
+
+		core.rom->runtosave();
+		search_node root;
+		root.depth = 0;
+		root.score = evaluate_score(ctx.score);
+		root.state = core.rom->save_core_state(true);
+		seen.insert(ctx.fingerprint.compute(*core.memory));
+		nodes.push_back(root);
+		frontier.push_back(0);
+		size_t best = 0;
+
+		callbacks_swap swap(&ctx.cb, *core.audio);
+		try {
+			std::unique_ptr<forkpool::pool> workers;
+			//The workers read memory, so the memory map must not be locked in them.
+			if(nworkers > 1)
+				workers.reset(new forkpool::pool(nworkers, [&ctx](const std::vector<char>& in,
+					std::vector<char>& out) { ctx.worker(in, out); },
+					std::vector<threads::lock*>(1, &core.memory->get_lock())));
+			for(unsigned d = 0; d < p.depth && !frontier.empty(); d++) {
+				search_level next(nodes, best, p.beam);
+				bool complete;
+				if(workers)
+					complete = expand_parallel(ctx, *workers, nodes, frontier, next, d, seen, r);
+				else
+					complete = expand_serial(ctx, nodes, frontier, next, d, seen, r);
+				frontier = next.get();
+				messages << "Input search: depth " << (d + 1) << ", " << frontier.size() << " states, "
+					<< r.explored << " frames emulated, best score " << nodes[best].score
+					<< std::endl;
+				if(!complete)
+					break;
+			}
+			core.rom->load_core_state(nodes[0].state, true);
+		} catch(...) {
+			core.rom->load_core_state(nodes[0].state, true);
+			throw;
+		}
+		r.score = nodes[best].score;
+		for(size_t i = best; i; i = nodes[i].parent)
+			r.inputs.push_back(p.candidates[nodes[i].input]);
+		std::reverse(r.inputs.begin(), r.inputs.end());
+	}
+
+	void print_result(const input_search_result& r)
+	{
+		if(r.error != "") {
+			messages << "Input search failed: " << r.error << std::endl;
+			return;
+		}
+		messages << "Input search done: " << r.explored << " frames emulated, " << r.duplicates
+			<< " duplicate states, best score " << r.score << " after " << r.inputs.size() << " frames"
+			<< std::endl;
+		for(auto i : r.inputs) {
+			char buf[MAX_SERIALIZED_SIZE];
+			i.serialize(buf);
+			messages << buf << std::endl;
+		}
+	}
+
+	command::fnptr<const std::string&> CMD_search_inputs(lsnes_cmds, CINPUTSEARCH::search,
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			regex_results r = regex("([0-9]+)[ \t]+([0-9]+)[ \t]+([^ \t]+)[ \t]+(.*)", args);
+			if(!r)
+				throw std::runtime_error("Bad syntax");
+			auto& core = CORE();
+			input_search_params p;
+			p.depth = parse_value<unsigned>(r[1]);
+			p.beam = parse_value<size_t>(r[2]);
+			p.score = r[4];
+			std::istream& s = zip::openrel(r[3], "");
+			std::string line;
+			while(std::getline(s, line)) {
+				istrip_CR(line);
+				if(line == "")
+					continue;
+				portctrl::frame f = core.controls->get_blank();
+				f.deserialize(line.c_str());
+				p.candidates.push_back(f);
+			}
+			delete &s;
+			input_search_queue(p, print_result);
+			messages << "Input search will run at end of current frame" << std::endl;
+		});
+}
+
+input_search_params::input_search_params()
+{
+	depth = 1;
+	beam = 0;
+	max_nodes = 0;
+	workers = 0;
+}
+
+input_search_result::input_search_result()
+{
+	score = 0;
+	explored = 0;
+	duplicates = 0;
+}
+
+void input_search_queue(const input_search_params& params, std::function<void(const input_search_result& r)> done)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	if(pending)
+		throw std::runtime_error("Input search already pending");
+	pending = new pending_search;
+	pending->params = params;
+	pending->done = done;
+}
+
+bool input_search_pending() throw()
+{
+	return (pending != NULL);
+}
+
+void input_search_run_pending() throw(std::bad_alloc)
+{
+	if(!pending)
+		return;
+	pending_search* s = pending;
+	pending = NULL;
+	input_search_result r;
+	try {
+		run_search(CORE(), s->params, r);
+	} catch(std::bad_alloc& e) {
+		delete s;
+		throw;
+	} catch(std::exception& e) {
+		r.error = e.what();
+	}
+	try {
+		s->done(r);
+	} catch(...) {
+	}
+	delete s;
+}
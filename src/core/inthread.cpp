@@ -18,6 +18,7 @@
 #include "library/opus-ogg.hpp"
 #include "library/serialization.hpp"
 #include "library/string.hpp"
+#include "library/workpool.hpp"
 #include "library/workthread.hpp"
 
 #include <cstdint>
@@ -25,6 +26,8 @@
 #include <list>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
 #include <sys/time.h>
@@ -60,6 +63,10 @@
 #define PLAY_THRESHOLD_DIV 30
 //Special granule position: None.
 #define GRANULEPOS_NONE 0xFFFFFFFFFFFFFFFFULL
+//Number of blocks encoded by one job when importing.
+#define IMPORT_SEGMENT_BLOCKS 250
+//Number of samples mixed by one job when exporting.
+#define EXPORT_SEGMENT_SAMPLES (10 * OPUS_SAMPLERATE)
 
 namespace
 {
@@ -223,6 +230,78 @@ namespace
 		return s;
 	}
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//Run fn(0), ..., fn(count - 1) in parallel on the worker pool, and wait for all of them to finish.
+	//Can throw (the first error from fn).
+	void run_parallel(size_t count, std::function<void(size_t i)> fn)
+	{
+		threads::lock m;
+		threads::cv c;
+		size_t pending = 0;
+		bool oom = false;
+		std::string error;
+		//Jobs reference these locals, so even if submitting fails, wait for the ones already queued.
+		for(size_t i = 0; i < count; i++) {
+			{
+				threads::alock h(m);
+				pending++;
+			}
+			try {
+				workpool::shared().submit([&m, &c, &pending, &oom, &error, &fn, i]() {
+					bool _oom = false;
+					std::string _error;
+					try {
+						fn(i);
+					} catch(std::bad_alloc& e) {
+						_oom = true;
+					} catch(std::exception& e) {
+						_error = e.what();
+					}
+					threads::alock h(m);
+					oom = oom || _oom;
+					if(error == "")
+						error = _error;
+					pending--;
+					c.notify_all();
+				});
+			} catch(...) {
+				threads::alock h(m);
+				pending--;
+				while(pending)
+					c.wait(h);
+				throw;
+			}
+		}
+		threads::alock h(m);
+		while(pending)
+			c.wait(h);
+		if(oom)
+			throw std::bad_alloc();
+		if(error != "")
+			throw std::runtime_error(error);
+	}
+
+	//Print progress of long operation in 10% steps.
+	struct progress_reporter
+	{
+		progress_reporter(const std::string& _what, uint64_t _total)
+			: what(_what), total(_total), next(1)
+		{
+		}
+		void operator()(uint64_t done)
+		{
+			unsigned step = total ? 10 * done / total : 10;
+			if(step < next)
+				return;
+			messages << what << ": " << 10 * step << "%" << std::endl;
+			next = step + 1;
+		}
+	private:
+		std::string what;
+		uint64_t total;
+		unsigned next;
+	};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Information about individual opus packet in stream.
 	struct opus_packetinfo
@@ -501,6 +580,8 @@ out_parsing:
 		uint64_t datalen = 0;
 		uint64_t last_datalen = 0;
 		uint64_t last_granulepos = 0;
+		//Commit the whole import at once, not per packet.
+		filesystem::ref::group g(fs);
 		try {
 			while(true) {
 				ogg::packet p;
@@ -569,6 +650,7 @@ out:
 			if(datalen <= pregap_length)
 				throw std::runtime_error("Stream too short (entiere pregap not present)");
 			write_trailier();
+			g.commit();
 		} catch(...) {
 			if(ctrl_cluster) fs.free_cluster_chain(ctrl_cluster);
 			if(data_cluster) fs.free_cluster_chain(data_cluster);
@@ -579,8 +661,6 @@ out:
 	void opus_stream::import_stream_sox(std::ifstream& data, settingvar::group& settings)
 	{
 		bitrate_tracker brtrack;
-		unsigned char tmpi[65536];
-		float tmp[OPUS_MAX_OUT];
 		char header[260];
 		data.read(header, 32);
 		if(!data)
@@ -597,47 +677,88 @@ out:
 			throw std::runtime_error("Only mono streams are supported");
 		uint64_t samples = serialization::u64l(header + 8);
 		opus::encoder enc(opus::samplerate::r48k, false, opus::application::voice);
-		enc.ctl(opus::bitrate(SET_opus_bitrate(settings)));
+		int32_t bitrate = SET_opus_bitrate(settings);
+		enc.ctl(opus::bitrate(bitrate));
 		int32_t pregap = enc.ctl(opus::lookahead);
 		pregap_length = pregap;
-		for(uint64_t i = 0; i < samples + pregap; i += OPUS_BLOCK_SIZE) {
-			size_t bs = OPUS_BLOCK_SIZE;
-			if(i + bs > samples + pregap)
-				bs = samples + pregap - i;
-			//We have to read zero bytes after the end of stream.
-			size_t readable = bs;
-			if(readable + i > samples)
-				readable = max(samples, i) - i;
-			if(readable > 0)
-				data.read(reinterpret_cast<char*>(tmpi), 4 * readable);
-			if(readable < bs)
-				memset(tmpi + 4 * readable, 0, 4 * (bs - readable));
-			if(!data) {
-				if(ctrl_cluster) fs.free_cluster_chain(ctrl_cluster);
-				if(data_cluster) fs.free_cluster_chain(data_cluster);
-				throw std::runtime_error("Can't read .sox data");
-			}
-			for(size_t j = 0; j < bs; j++)
-				tmp[j] = static_cast<float>(serialization::s32l(tmpi + 4 * j)) / 268435456;
-			if(bs < OPUS_BLOCK_SIZE)
-				postgap_length = OPUS_BLOCK_SIZE - bs;
-			for(size_t j = bs; j < OPUS_BLOCK_SIZE; j++)
-				tmp[j] = 0;
-			try {
-				const size_t opus_out_max2 = SET_opus_max_bitrate(settings) *
-					OPUS_BLOCK_SIZE / 384000;
-				size_t r = enc.encode(tmp, OPUS_BLOCK_SIZE, tmpi, opus_out_max2);
-				write(OPUS_BLOCK_SIZE / 120, tmpi, r);
-				brtrack.submit(r, bs);
-			} catch(std::exception& e) {
-				if(ctrl_cluster) fs.free_cluster_chain(ctrl_cluster);
-				if(data_cluster) fs.free_cluster_chain(data_cluster);
-				(stringfmt() << "Error encoding opus packet: " << e.what()).throwex();
+		const size_t opus_out_max2 = SET_opus_max_bitrate(settings) * OPUS_BLOCK_SIZE / 384000;
+		//The end is padded with zeroes to full block.
+		uint64_t total = samples + pregap;
+		uint64_t blocks = (total + OPUS_BLOCK_SIZE - 1) / OPUS_BLOCK_SIZE;
+		if(total % OPUS_BLOCK_SIZE)
+			postgap_length = OPUS_BLOCK_SIZE - total % OPUS_BLOCK_SIZE;
+		//The stream is encoded in segments on separate encoders. Each encoder is first fed the samples before
+		//its segment (which are thrown away), so it has converged by the time it gets to the segment.
+		const uint64_t warmup = OPUS_CONVERGE_MAX / OPUS_BLOCK_SIZE;
+		const uint64_t batch = 2 * workpool::shared().get_threads() * IMPORT_SEGMENT_BLOCKS;
+		std::vector<float> pcm;
+		std::vector<char> raw;
+		std::vector<std::vector<std::vector<unsigned char>>> encoded;
+		progress_reporter progress("Importing stream", blocks);
+		//Commit the whole import at once, not per packet.
+		filesystem::ref::group g(fs);
+		try {
+			for(uint64_t b = 0; b < blocks;) {
+				uint64_t bend = min(blocks, b + batch);
+				//pcm starts warm blocks before block b. Reuse the end of last batch for it.
+				uint64_t warm = min(b, warmup);
+				if(warm)
+					memmove(&pcm[0], &pcm[pcm.size() - warm * OPUS_BLOCK_SIZE],
+						warm * OPUS_BLOCK_SIZE * sizeof(float));
+				pcm.resize((warm + bend - b) * OPUS_BLOCK_SIZE);
+				uint64_t first = b * OPUS_BLOCK_SIZE;
+				uint64_t last = bend * OPUS_BLOCK_SIZE;
+				//We have to read zero bytes after the end of stream.
+				uint64_t readable = min(last, max(samples, first)) - first;
+				raw.resize(4 * readable);
+				if(readable > 0)
+					data.read(&raw[0], 4 * readable);
+				if(!data)
+					throw std::runtime_error("Can't read .sox data");
+				float* in = &pcm[warm * OPUS_BLOCK_SIZE];
+				for(size_t j = 0; j < readable; j++)
+					in[j] = static_cast<float>(serialization::s32l(&raw[4 * j])) / 268435456;
+				for(size_t j = readable; j < last - first; j++)
+					in[j] = 0;
+				size_t jobs = (bend - b + IMPORT_SEGMENT_BLOCKS - 1) / IMPORT_SEGMENT_BLOCKS;
+				encoded.resize(jobs);
+				run_parallel(jobs, [&](size_t j) {
+					uint64_t s0 = b + j * IMPORT_SEGMENT_BLOCKS;
+					uint64_t s1 = min(bend, s0 + IMPORT_SEGMENT_BLOCKS);
+					opus::encoder e(opus::samplerate::r48k, false, opus::application::voice);
+					e.ctl(opus::bitrate(bitrate));
+					std::vector<unsigned char> tmp(65536);
+					encoded[j].clear();
+					try {
+						for(uint64_t k = s0 - min(s0, warmup); k < s1; k++) {
+							const float* blk = &pcm[(k + warm - b) * OPUS_BLOCK_SIZE];
+							size_t r = e.encode(blk, OPUS_BLOCK_SIZE, &tmp[0], opus_out_max2);
+							if(k >= s0)
+								encoded[j].push_back(std::vector<unsigned char>(&tmp[0],
+									&tmp[r]));
+						}
+					} catch(std::exception& e) {
+						(stringfmt() << "Error encoding opus packet: " << e.what()).throwex();
+					}
+				});
+				for(auto& j : encoded)
+					for(auto& k : j) {
+						size_t bs = min(total - b * OPUS_BLOCK_SIZE, (uint64_t)OPUS_BLOCK_SIZE);
+						write(OPUS_BLOCK_SIZE / 120, &k[0], k.size());
+						brtrack.submit(k.size(), bs);
+						b++;
+					}
+				progress(b);
 			}
+		} catch(...) {
+			if(ctrl_cluster) fs.free_cluster_chain(ctrl_cluster);
+			if(data_cluster) fs.free_cluster_chain(data_cluster);
+			throw;
 		}
 		messages << "Imported stream: " << brtrack;
 		try {
 			write_trailier();
+			g.commit();
 		} catch(...) {
 			if(ctrl_cluster) fs.free_cluster_chain(ctrl_cluster);
 			if(data_cluster) fs.free_cluster_chain(data_cluster);
@@ -790,6 +911,7 @@ out:
 			char descriptor[4];
 			uint32_t used_cluster, used_offset;
 			uint32_t used_mcluster, used_moffset;
+			filesystem::ref::group g(fs);
 			if(!next_cluster)
 				next_cluster = data_cluster = fs.allocate_cluster();
 			if(!next_mcluster)
@@ -799,6 +921,7 @@ out:
 			serialization::u8b(descriptor + 3, 1);
 			fs.write_data(next_cluster, next_offset, payload, payload_len, used_cluster, used_offset);
 			fs.write_data(next_mcluster, next_moffset, descriptor, 4, used_mcluster, used_moffset);
+			g.commit();
 			uint64_t off = static_cast<uint64_t>(used_cluster) * CLUSTER_SIZE + used_offset;
 			opus_packetinfo p(payload_len, len, off);
 			total_len += p.length();
@@ -813,6 +936,7 @@ out:
 		try {
 			char descriptor[16];
 			uint32_t used_mcluster, used_moffset;
+			filesystem::ref::group g(fs);
 			//The allocation must be done for real.
 			if(!next_mcluster)
 				next_mcluster = ctrl_cluster = fs.allocate_cluster();
@@ -825,6 +949,7 @@ out:
 			serialization::s16b(descriptor + 12, gain);
 			serialization::u16b(descriptor + 14, 0x0004);
 			fs.write_data(tmp_mcluster, tmp_moffset, descriptor, 16, used_mcluster, used_moffset);
+			g.commit();
 		} catch(std::exception& e) {
 			(stringfmt() << "Can't write stream trailer: " << e.what()).throwex();
 		}
@@ -996,6 +1121,22 @@ out:
 	}
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//Index of times streams are active. Immutable once built, so it can be read without locking.
+	struct stream_interval_index
+	{
+		struct interval
+		{
+			uint64_t start;
+			uint64_t end;
+			uint64_t index;
+		};
+		//Sorted by start time.
+		std::vector<interval> intervals;
+		//Maximum end time of intervals up to and including this one.
+		std::vector<uint64_t> max_end;
+	};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Collection of streams.
 	struct stream_collection
@@ -1006,7 +1147,8 @@ out:
 		stream_collection(filesystem::ref filesys);
 		//Destroy a collection. All streams are destroyed but not deleted.
 		~stream_collection();
-		//Get list of streams active at given point.
+		//Get list of streams active at given point, in time order.
+		//Does not lock the collection.
 		std::list<uint64_t> streams_at(uint64_t point);
 		//Add a stream into collection.
 		//Can throw.
@@ -1039,6 +1181,8 @@ out:
 		//Can throw.
 		void export_superstream(std::ofstream& out);
 	private:
+		//Rebuild the interval index. Must be called with mlock held.
+		void rebuild_index();
 		filesystem::ref fs;
 		uint64_t next_index;
 		unsigned next_stream;
@@ -1048,6 +1192,8 @@ out:
 		std::multimap<uint64_t, uint64_t> streams_by_time;
 		//FIXME: Something more efficient.
 		std::map<uint64_t, opus_stream*> streams;
+		//Only accessed with std::atomic_load()/std::atomic_store().
+		std::shared_ptr<const stream_interval_index> interval_index;
 	};
 
 	stream_collection::stream_collection(filesystem::ref filesys)
@@ -1077,6 +1223,7 @@ out:
 					free_indices.insert(i);
 				next_stream = ++i;
 			}
+			rebuild_index();
 		} catch(std::exception& e) {
 			for(auto i : streams)
 				i.second->put_ref();
@@ -1092,17 +1239,39 @@ out:
 		streams.clear();
 	}
 
+	void stream_collection::rebuild_index()
+	{
+		std::shared_ptr<stream_interval_index> idx(new stream_interval_index);
+		idx->intervals.reserve(streams_by_time.size());
+		idx->max_end.reserve(streams_by_time.size());
+		uint64_t max_end = 0;
+		for(auto i : streams_by_time) {
+			stream_interval_index::interval x;
+			x.start = i.first;
+			x.end = i.first + streams[i.second]->length();
+			x.index = i.second;
+			max_end = max(max_end, x.end);
+			idx->intervals.push_back(x);
+			idx->max_end.push_back(max_end);
+		}
+		std::atomic_store(&interval_index, std::shared_ptr<const stream_interval_index>(idx));
+	}
+
 	std::list<uint64_t> stream_collection::streams_at(uint64_t point)
 	{
-		threads::alock m(mlock);
+		std::shared_ptr<const stream_interval_index> idx = std::atomic_load(&interval_index);
 		std::list<uint64_t> s;
-		for(auto i : streams) {
-			uint64_t start = i.second->timebase();
-			uint64_t end = start + i.second->length();
-			if(point >= start && point < end) {
-				i.second->get_ref();
-				s.push_back(i.first);
-			}
+		if(!idx)
+			return s;
+		auto& iv = idx->intervals;
+		//Streams starting after point can't be active. Going backwards, once no earlier stream ends after point,
+		//none of the rest can be active either.
+		size_t i = std::upper_bound(iv.begin(), iv.end(), point,
+			[](uint64_t p, const stream_interval_index::interval& x) { return p < x.start; }) - iv.begin();
+		while(i > 0 && idx->max_end[i - 1] > point) {
+			i--;
+			if(iv[i].end > point)
+				s.push_front(iv[i].index);
 		}
 		return s;
 	}
@@ -1135,6 +1304,7 @@ out:
 			fs.write_data(write_cluster, write_offset, buffer, 16, dummy1, dummy2);
 			streams_by_time.insert(std::make_pair(stream.timebase(), idx));
 			entries[idx] = entry_number;
+			rebuild_index();
 			return idx;
 		} catch(std::exception& e) {
 			(stringfmt() << "Failed to add stream: " << e.what()).throwex();
@@ -1170,6 +1340,7 @@ out:
 			}
 		streams[index]->delete_stream();
 		streams.erase(index);
+		rebuild_index();
 	}
 
 	void stream_collection::alter_stream_timebase(uint64_t index, uint64_t newts)
@@ -1196,6 +1367,7 @@ out:
 				}
 			streams[index]->timebase(newts);
 			streams_by_time.insert(std::make_pair(newts, index));
+			rebuild_index();
 		} catch(std::exception& e) {
 			(stringfmt() << "Failed to alter stream timebase: " << e.what()).throwex();
 		}
@@ -1228,96 +1400,75 @@ out:
 		std::list<uint64_t> slist = all_streams();
 		//Find the total length of superstream.
 		uint64_t len = 0;
+		std::vector<opus_stream*> sstreams;
 		for(auto i : slist) {
 			opus_stream* s = get_stream(i);
 			if(s) {
 				len = max(len, s->timebase() + s->length());
-				s->put_ref();
+				sstreams.push_back(s);
 			}
 		}
-		char header[32];
-		serialization::u64l(header, 0x1C586F532EULL);			//Magic and header size.
-		serialization::u64l(header + 8, len);
-		serialization::u64l(header + 16, 4676829883349860352ULL);	//Sampling rate.
-		serialization::u64l(header + 24, 1);
-		out.write(header, 32);
-		if(!out)
-			throw std::runtime_error("Error writing PCM output");
-
-		//Find the first valid stream.
-		auto next_i = slist.begin();
-		opus_stream* next_stream = NULL;
-		while(next_i != slist.end()) {
-			next_stream = get_stream(*next_i);
-			next_i++;
-			if(next_stream)
-				break;
-		}
-		uint64_t next_ts;
-		next_ts = next_stream ? next_stream->timebase() : len;
-
-		std::list<opus_playback_stream*> active;
 		try {
+			char header[32];
+			serialization::u64l(header, 0x1C586F532EULL);			//Magic and header size.
+			serialization::u64l(header + 8, len);
+			serialization::u64l(header + 16, 4676829883349860352ULL);	//Sampling rate.
+			serialization::u64l(header + 24, 1);
+			out.write(header, 32);
+			if(!out)
+				throw std::runtime_error("Error writing PCM output");
+
+			//The segments are mixed in parallel, streams continuing from earlier segments are seeked to
+			//the start of segment.
+			const uint64_t batch = 2 * workpool::shared().get_threads() * EXPORT_SEGMENT_SAMPLES;
+			std::vector<std::vector<char>> pcm;
+			progress_reporter progress("Exporting superstream", len);
 			for(uint64_t s = 0; s < len;) {
-				if(s == next_ts) {
-					active.push_back(new opus_playback_stream(*next_stream));
-					next_stream->put_ref();
-					next_stream = NULL;
-					while(next_i != slist.end()) {
-						next_stream = get_stream(*next_i);
-						next_i++;
-						if(!next_stream)
+				uint64_t send = min(len, s + batch);
+				size_t jobs = (send - s + EXPORT_SEGMENT_SAMPLES - 1) / EXPORT_SEGMENT_SAMPLES;
+				pcm.resize(jobs);
+				run_parallel(jobs, [&](size_t j) {
+					uint64_t s0 = s + j * EXPORT_SEGMENT_SAMPLES;
+					uint64_t s1 = min(send, s0 + EXPORT_SEGMENT_SAMPLES);
+					std::vector<float> mix(s1 - s0);
+					float buf[OUTPUT_BLOCK];
+					for(auto st : sstreams) {
+						uint64_t start = st->timebase();
+						uint64_t end = min(start + st->length(), s1);
+						if(start >= s1)
+							break;	//The streams are in time order.
+						if(end <= s0)
 							continue;
-						uint64_t next_ts = next_stream->timebase();
-						if(next_ts > s)
-							break;
-						//Okay, this starts too...
-						active.push_back(new opus_playback_stream(*next_stream));
-						next_stream->put_ref();
-						next_stream = NULL;
-					};
-					next_ts = next_stream ? next_stream->timebase() : len;
-				}
-				uint64_t maxsamples = min(next_ts - s, static_cast<uint64_t>(OUTPUT_BLOCK));
-				maxsamples = min(maxsamples, len - s);
-				char outbuf[4 * OUTPUT_BLOCK];
-				float buf1[OUTPUT_BLOCK];
-				float buf2[OUTPUT_BLOCK];
-				for(size_t t = 0; t < maxsamples; t++)
-					buf1[t] = 0;
-				for(auto t : active) {
-					t->read(buf2, maxsamples);
-					for(size_t u = 0; u < maxsamples; u++)
-						buf1[u] += buf2[u];
-				}
-				for(auto t = active.begin(); t != active.end();) {
-					if((*t)->eof()) {
-						auto todel = t;
-						t++;
-						delete *todel;
-						active.erase(todel);
-					} else
-						t++;
+						opus_playback_stream ps(*st);
+						if(s0 > start)
+							ps.skip(s0 - start);
+						for(uint64_t t = max(start, s0); t < end;) {
+							size_t n = min(end - t, static_cast<uint64_t>(OUTPUT_BLOCK));
+							ps.read(buf, n);
+							for(size_t u = 0; u < n; u++)
+								mix[t - s0 + u] += buf[u];
+							t += n;
+						}
+					}
+					pcm[j].resize(4 * mix.size());
+					for(size_t t = 0; t < mix.size(); t++)
+						serialization::s32l(&pcm[j][4 * t], mix[t] * 268435456);
+				});
+				for(auto& j : pcm) {
+					out.write(&j[0], j.size());
+					if(!out)
+						throw std::runtime_error("Failed to write PCM");
 				}
-				for(size_t t = 0; t < maxsamples; t++)
-					serialization::s32l(outbuf + 4 * t, buf1[t] * 268435456);
-				out.write(outbuf, 4 * maxsamples);
-				if(!out)
-					throw std::runtime_error("Failed to write PCM");
-				s += maxsamples;
+				s = send;
+				progress(s);
 			}
 		} catch(std::exception& e) {
+			for(auto i : sstreams)
+				i->put_ref();
 			(stringfmt() << "Failed to export PCM: " << e.what()).throwex();
 		}
-		for(auto t = active.begin(); t != active.end();) {
-			if((*t)->eof()) {
-				auto todelete = t;
-				t++;
-				delete *todelete;
-				active.erase(todelete);
-			} else
-				t++;
-		}
+		for(auto i : sstreams)
+			i->put_ref();
 	}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
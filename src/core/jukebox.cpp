@@ -10,6 +10,10 @@ namespace
 {
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_jukebox_dflt_binary(lsnes_setgrp,
 		"jukebox-default-binary", "Movie‣Saving‣Saveslots binary", true);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_jukebox_quicksave(lsnes_setgrp,
+		"jukebox-quicksave", "Movie‣Saving‣Saveslots as quicksaves", false);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_jukebox_dedup(lsnes_setgrp,
+		"jukebox-dedup", "Movie‣Saving‣Deduplicate saveslots", false);
 	settingvar::supervariable<settingvar::model_int<0,999999999>> SET_jukebox_size(lsnes_setgrp, "jukebox-size",
 		"Movie‣Number of save slots", 12);
 }
@@ -88,6 +92,16 @@ bool save_jukebox::save_binary()
 	return SET_jukebox_dflt_binary(settings);
 }
 
+bool save_jukebox::save_quick()
+{
+	return SET_jukebox_quicksave(settings);
+}
+
+bool save_jukebox::save_dedup()
+{
+	return SET_jukebox_dedup(settings);
+}
+
 std::string save_jukebox::get_slot_name()
 {
 	return (stringfmt() << "$SLOT:" << (get_slot() + 1)).str();
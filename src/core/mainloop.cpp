@@ -10,6 +10,7 @@
 #include "core/emustatus.hpp"
 #include "core/framebuffer.hpp"
 #include "core/framerate.hpp"
+#include "core/inputsearch.hpp"
 #include "core/instance.hpp"
 #include "core/inthread.hpp"
 #include "core/jukebox.hpp"
@@ -32,6 +33,7 @@
 #include "interface/c-interface.hpp"
 #include "interface/romtype.hpp"
 #include "library/framebuffer.hpp"
+#include "library/profiler.hpp"
 #include "library/settingvar.hpp"
 #include "library/string.hpp"
 #include "library/zip.hpp"
@@ -549,6 +551,11 @@ namespace
 			mark_pending_save(args, SAVE_STATE, 0);
 		});
 
+	command::fnptr<command::arg_filename> CMD_save_state4(lsnes_cmds, CLOADSAVE::sasq,
+		[](command::arg_filename args) throw(std::bad_alloc, std::runtime_error) {
+			mark_pending_save(args, SAVE_STATE, 2);
+		});
+
 	command::fnptr<command::arg_filename> CMD_save_movie(lsnes_cmds, CLOADSAVE::sam,
 		[](command::arg_filename args) throw(std::bad_alloc, std::runtime_error) {
 			mark_pending_save(args, SAVE_MOVIE, -1);
@@ -708,6 +715,7 @@ namespace
 	//failing.
 	int handle_load()
 	{
+		PROFILE_SPAN("load");
 		auto& core = CORE();
 		std::string old_project = *core.mlogic ? core.mlogic->get_mfile().projectid : "";
 jumpback:
@@ -794,10 +802,11 @@ nothing_to_do:
 	//If there are pending saves, perform them.
 	void handle_saves()
 	{
+		PROFILE_SPAN("save");
 		auto& core = CORE();
 		if(!*core.mlogic)
 			return;
-		if(!queued_saves.empty() || (do_unsafe_rewind && !unsafe_rewind_obj)) {
+		if(!queued_saves.empty() || (do_unsafe_rewind && !unsafe_rewind_obj) || input_search_pending()) {
 			core.rom->runtosave();
 			for(auto i : queued_saves) {
 				do_save_state(i.first, i.second);
@@ -806,12 +815,13 @@ nothing_to_do:
 			}
 			if(do_unsafe_rewind && !unsafe_rewind_obj) {
 				uint64_t t = framerate_regulator::get_utime();
-				core.mlogic->get_mfile().dyn.savestate = core.rom->save_core_state(true);
+				core.rom->save_core_state(core.mlogic->get_mfile().dyn.savestate, true);
 				core.lua2->callback_do_unsafe_rewind(core.mlogic->get_movie(), NULL);
 				do_unsafe_rewind = false;
 				messages << "Rewind point set in " << (framerate_regulator::get_utime() - t)
 					<< " usec." << std::endl;
 			}
+			input_search_run_pending();
 		}
 		queued_saves.clear();
 	}
@@ -841,6 +851,7 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 	std::runtime_error)
 {
 	lsnes_instance.emu_thread = threads::id();
+	profiler::set_thread_name("emulation");
 	auto& core = CORE();
 	mywindowcallbacks mywcb(*core.dispatch, *core.runmode, *core.supdater);
 	core.iqueue->system_thread_available = true;
@@ -885,6 +896,7 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 	core.lua2->run_startup_scripts();
 
 	while(!core.runmode->is_quit() || !queued_saves.empty()) {
+		PROFILE_SPAN("mainloop");
 		if(handle_corrupt()) {
 			first_round = *core.mlogic && core.mlogic->get_mfile().dyn.save_frame;
 			just_did_loadstate = first_round;
@@ -892,6 +904,7 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 		}
 		core.framerate->ack_frame_tick(framerate_regulator::get_utime());
 		core.runmode->decay_skiplag();
+		profiler::mark_frame(*core.mlogic ? core.mlogic->get_movie().get_current_frame() : 0);
 
 		if(!first_round) {
 			core.controls->reset_framehold();
@@ -937,10 +950,15 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 			just_did_loadstate = false;
 		}
 		core.dbg->do_callback_frame(core.mlogic->get_movie().get_current_frame(), false);
-		core.rom->emulate();
+		{
+			PROFILE_SPAN("emulate");
+			core.rom->emulate();
+		}
 		random_mix_timing_entropy();
-		if(core.runmode->is_freerunning())
+		if(core.runmode->is_freerunning()) {
+			PROFILE_SPAN("wait");
 			platform::wait(core.framerate->to_wait_frame(framerate_regulator::get_utime()));
+		}
 		first_round = false;
 		core.lua2->callback_do_frame();
 	}
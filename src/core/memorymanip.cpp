@@ -131,12 +131,14 @@ namespace
 {
 	uint64_t parse_address(std::string addr)
 	{
-		if(regex_match("[0-9]+|0x[0-9A-Fa-f]+", addr)) {
+		static regex_pattern absolute("[0-9]+|0x[0-9A-Fa-f]+", REGEX_FLAG_NOSUBS);
+		if(absolute.match(addr)) {
 			//Absolute in mapspace.
 			return parse_value<uint64_t>(addr);
-		} else if(regex_match("[^+]+\\+[0-9A-Fa-f]+", addr)) {
+		}
+		static regex_pattern vmarel("([^+]+)\\+([0-9A-Fa-f]+)");
+		if(regex_results r = vmarel(addr)) {
 			//VMA-relative.
-			regex_results r = regex("([^+]+)\\+([0-9A-Fa-f]+)", addr);
 			std::string vma = r[1];
 			std::string _offset = r[2];
 			uint64_t offset = parse_value<uint64_t>("0x" + _offset);
@@ -178,7 +180,8 @@ namespace
 		~memorymanip_command() throw() {}
 		void invoke(const std::string& args) throw(std::bad_alloc, std::runtime_error)
 		{
-			regex_results t = regex("(([^ \t]+)([ \t]+([^ \t]+)([ \t]+([^ \t].*)?)?)?)?", args);
+			static regex_pattern syntax("(([^ \t]+)([ \t]+([^ \t]+)([ \t]+([^ \t].*)?)?)?)?");
+			regex_results t = syntax(args);
 			if(!t) {
 				address_bad = true;
 				return;
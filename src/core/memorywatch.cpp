@@ -522,6 +522,17 @@ std::string memwatch_set::get_value(const std::string& name)
 	return watch_set.get(name).get_value();
 }
 
+GC::pointer<mathexpr::mathexpr> memwatch_set::parse_expression(const std::string& expr)
+{
+	return mathexpr::mathexpr::parse(*mathexpr::expression_value(), expr,
+		[this](const std::string& n) -> GC::pointer<mathexpr::mathexpr> {
+			auto i = watch_set.get_soft(n);
+			if(!i)
+				throw std::runtime_error("No memory watch named '" + n + "'");
+			return i->expr;
+		});
+}
+
 void memwatch_set::set_multi(std::list<std::pair<std::string, memwatch_item>>& list)
 {
 	std::map<std::string, memwatch_item> nitems = items;
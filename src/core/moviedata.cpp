@@ -19,6 +19,7 @@
 #include "interface/romtype.hpp"
 #include "library/directory.hpp"
 #include "library/minmax.hpp"
+#include "library/streamcompress.hpp"
 #include "library/string.hpp"
 #include "library/temporary_handle.hpp"
 #include "lua/lua.hpp"
@@ -32,12 +33,26 @@ namespace
 {
 	settingvar::supervariable<settingvar::model_int<0, 9>> SET_savecompression(lsnes_setgrp, "savecompression",
 		"Movie‣Saving‣Compression",  7);
+#ifdef LIBZSTD_AVAILABLE
+	settingvar::enumeration savecompression_methods {"deflate", "zstd"};
+#else
+	settingvar::enumeration savecompression_methods {"deflate"};
+#endif
+	settingvar::supervariable<settingvar::model_enumerated<&savecompression_methods>> SET_savecompression_method(
+		lsnes_setgrp, "savecompression-method", "Movie‣Saving‣Compression method", 0);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_readonly_load_preserves(
 		lsnes_setgrp, "preserve_on_readonly_load", "Movie‣Loading‣Preserve on readonly load", true);
 	threads::lock mprefix_lock;
 	std::string mprefix;
 	bool mprefix_valid;
 
+	uint16_t get_save_method(emulator_instance& core)
+	{
+		if(SET_savecompression_method(*core.settings) == 1)
+			return zip::METHOD_ZSTD;
+		return zip::METHOD_DEFLATE;
+	}
+
 	std::string get_mprefix()
 	{
 		threads::alock h(mprefix_lock);
@@ -64,6 +79,45 @@ namespace
 			messages << "Saved core state to " << name << std::endl;
 		});
 
+	command::fnptr<> CMD_collect_chunks(lsnes_cmds, CMOVIEDATA::collectchunks,
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			size_t n = moviefile::collect_quick_chunks();
+			messages << "Deleted " << n << " unreferenced quicksave chunks" << std::endl;
+		});
+
+	command::fnptr<const std::string&> CMD_train_zstd_dict(lsnes_cmds, CMOVIEDATA::traindict,
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			std::string output;
+			std::vector<std::vector<char>> samples;
+			for(auto& i : token_iterator<char>::foreach(args, {" ", "\t"})) {
+				if(i == "")
+					continue;
+				if(output == "") {
+					output = i;
+					continue;
+				}
+				std::ifstream y(i.c_str(), std::ios::in | std::ios::binary);
+				if(!y)
+					throw std::runtime_error("Can't open '" + i + "'");
+				std::vector<char> sample;
+				char buf[4096];
+				while(y) {
+					y.read(buf, sizeof(buf));
+					sample.insert(sample.end(), buf, buf + y.gcount());
+				}
+				samples.push_back(sample);
+			}
+			if(output == "" || samples.empty())
+				throw std::runtime_error("Syntax: train-zstd-dictionary <output> <coresave>...");
+			auto dict = streamcompress::zstd_train_dictionary(samples, 112640);
+			std::ofstream y(output.c_str(), std::ios::out | std::ios::binary);
+			y.write(&dict[0], dict.size());
+			if(!y)
+				throw std::runtime_error("Can't write '" + output + "'");
+			messages << "Trained " << dict.size() << " byte dictionary from " << samples.size()
+				<< " core states to " << output << std::endl;
+		});
+
 	bool warn_hash_mismatch(const std::string& mhash, const fileimage::image& slot,
 		const std::string& name, bool fatal)
 	{
@@ -159,7 +213,8 @@ std::string translate_name_mprefix(std::string original, int& binary, int save)
 	regex_results r = regex("\\$SLOT:(.*)", original);
 	if(r) {
 		if(binary < 0)
-			binary = core.jukebox->save_binary() ? 1 : 0;
+			binary = core.jukebox->save_dedup() ? 3 : core.jukebox->save_quick() ? 2 :
+				(core.jukebox->save_binary() ? 1 : 0);
 		if(p) {
 			uint64_t branch = p->get_current_branch();
 			std::string branch_str;
@@ -248,10 +303,14 @@ void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc
 			target.authors = prj->authors;
 		}
 		target.dyn.active_macros = core.controls->get_macro_frames();
-		target.save(filename2, SET_savecompression(*core.settings), binary > 0,
-			core.mlogic->get_rrdata(), true);
+		if(binary > 1)
+			target.save_quick(filename2, core.mlogic->get_rrdata(), binary > 2);
+		else
+			target.save(filename2, SET_savecompression(*core.settings), binary > 0,
+				core.mlogic->get_rrdata(), true, get_save_method(core));
 		uint64_t took = framerate_regulator::get_utime() - origtime;
-		std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
+		std::string kind = (binary > 2) ? "(deduplicated quicksave format)" : (binary > 1) ?
+			"(quicksave format)" : (binary > 0) ? "(binary format)" : "(zip format)";
 		messages << "Saved state " << kind << " '" << filename2 << "' in " << took << " microseconds."
 			<< std::endl;
 		core.lua2->callback_post_save(filename2, true);
@@ -262,6 +321,9 @@ void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc
 		messages << "Save failed: " << e.what() << std::endl;
 		core.lua2->callback_err_save(filename2);
 	}
+	//Quicksaves can't be loaded without their movie, so the last full save stays as the one to reopen.
+	if(binary > 1)
+		return;
 	last_save = resolve_relative_path(filename2);
 	auto p = core.project->get();
 	if(p) {
@@ -290,7 +352,7 @@ void do_save_movie(const std::string& filename, int binary) throw(std::bad_alloc
 			target.authors = prj->authors;
 		}
 		target.save(filename2, SET_savecompression(*core.settings), binary > 0,
-			core.mlogic->get_rrdata(), false);
+			core.mlogic->get_rrdata(), false, get_save_method(core));
 		uint64_t took = framerate_regulator::get_utime() - origtime;
 		std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
 		messages << "Saved movie " << kind << " '" << filename2 << "' in " << took << " microseconds."
@@ -858,9 +920,23 @@ bool do_load_state(const std::string& filename, int lmode)
 	struct moviefile* mfile = NULL;
 	bool used = false;
 	try {
-		if(core.rom->isnull())
-			try_request_rom(filename2);
-		mfile = new moviefile(filename2, core.rom->get_internal_rom_type());
+		if(moviefile::is_quicksave(filename2)) {
+			//Quicksaves only reference the input, so they are loaded on top of copy of current movie.
+			if(!*core.mlogic || !core.mlogic->get_mfile().gametype)
+				throw std::runtime_error("Can't load quicksave without a movie");
+			mfile = new moviefile();
+			try {
+				mfile->copy_fields(core.mlogic->get_mfile());
+				mfile->load_quick(filename2);
+			} catch(...) {
+				delete mfile;
+				throw;
+			}
+		} else {
+			if(core.rom->isnull())
+				try_request_rom(filename2);
+			mfile = new moviefile(filename2, core.rom->get_internal_rom_type());
+		}
 	} catch(std::bad_alloc& e) {
 		OOM_panic();
 	} catch(std::exception& e) {
@@ -0,0 +1,753 @@
+#include "core/moviefile-common.hpp"
+#include "core/moviefile.hpp"
+#include "library/chunkstore.hpp"
+#include "library/directory.hpp"
+#include "library/serialization.hpp"
+#include "library/sha256.hpp"
+#include "library/string.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <list>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(_WIN64) || defined(TEST_WIN32_CODE)
+//FUCK YOU. SERIOUSLY.
+#define EXTRA_OPENFLAGS O_BINARY
+#define NO_QUICKSAVE_MMAP
+#else
+#define EXTRA_OPENFLAGS 0
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+//Damn Windows.
+#ifndef EWOULDBLOCK
+#define EWOULDBLOCK EAGAIN
+#endif
+
+/*
+ * Quicksave file layout (all numbers little-endian):
+ *
+ * 0:  "lsqs\x1A\0\0\0"
+ * 8:  Version (4 bytes).
+ * 12: Number of sections N (4 bytes).
+ * 16: Section table, N entries of 24 bytes each: tag (4), reserved (4), offset (8), size (8).
+ * Section payloads follow, each starting at offset that is multiple of 8.
+ *
+ * The whole file is written with one gathering write and loaded by mapping it, so no section is ever copied
+ * more than once.
+ *
+ * Deduplicated quicksaves (version 2) are manifests: the bulky sections are replaced by QS_CHUNKED sections
+ * (original tag (4), size (8), chunk count (4), chunk ids (16 each)) referring to the chunk store of the project
+ * in the same directory. These also carry the input (QS_INPUT), so they can be loaded even if input has changed.
+ */
+namespace
+{
+	const char quicksave_magic[8] = {'l', 's', 'q', 's', 0x1A, 0, 0, 0};
+	const uint32_t quicksave_version = 1;
+	const uint32_t quicksave_chunked_version = 2;
+	const size_t quicksave_header = 16;
+	const size_t quicksave_tabentry = 24;
+	const char quicksave_padding[8] = {0};
+
+	enum quicksave_tags
+	{
+		QS_META = 1,
+		QS_SAVESTATE = 2,
+		QS_HOSTMEMORY = 3,
+		QS_SCREENSHOT = 4,
+		QS_SRAM = 5,
+		QS_INPUT = 6,
+		QS_CHUNKED = 7,
+	};
+
+	//Cursor for writing the metadata section.
+	struct qs_writer
+	{
+		qs_writer(std::vector<char>& _buf) : buf(_buf) {}
+		void u32(uint32_t v)
+		{
+			size_t o = buf.size();
+			buf.resize(o + 4);
+			serialization::u32l(&buf[o], v);
+		}
+		void u64(uint64_t v)
+		{
+			size_t o = buf.size();
+			buf.resize(o + 8);
+			serialization::u64l(&buf[o], v);
+		}
+		void raw(const void* data, size_t size)
+		{
+			const char* _data = reinterpret_cast<const char*>(data);
+			buf.insert(buf.end(), _data, _data + size);
+		}
+		void string(const std::string& s)
+		{
+			u32(s.length());
+			raw(s.c_str(), s.length());
+		}
+	private:
+		std::vector<char>& buf;
+	};
+
+	//Cursor for reading the metadata section.
+	struct qs_reader
+	{
+		qs_reader(const char* _buf, size_t _size) : buf(_buf), size(_size), ptr(0) {}
+		const char* raw(size_t amount)
+		{
+			if(amount > size - ptr)
+				throw std::runtime_error("Quicksave metadata truncated");
+			const char* r = buf + ptr;
+			ptr += amount;
+			return r;
+		}
+		uint32_t u32() { return serialization::u32l(raw(4)); }
+		uint64_t u64() { return serialization::u64l(raw(8)); }
+		std::string string()
+		{
+			size_t len = u32();
+			const char* s = raw(len);
+			return std::string(s, s + len);
+		}
+	private:
+		const char* buf;
+		size_t size;
+		size_t ptr;
+	};
+
+	//A read-only view of the whole quicksave file.
+	class qs_view
+	{
+	public:
+		qs_view(const std::string& filename)
+		{
+			int fd = open(filename.c_str(), O_RDONLY | EXTRA_OPENFLAGS);
+			if(fd < 0) {
+				int err = errno;
+				(stringfmt() << "Can't read file '" << filename << "': " << strerror(err)).throwex();
+			}
+			struct stat st;
+			if(fstat(fd, &st) < 0) {
+				int err = errno;
+				close(fd);
+				(stringfmt() << "Can't stat file '" << filename << "': " << strerror(err)).throwex();
+			}
+			size = st.st_size;
+			mapped = NULL;
+#ifndef NO_QUICKSAVE_MMAP
+			if(size) {
+				void* m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if(m != MAP_FAILED)
+					mapped = reinterpret_cast<char*>(m);
+			}
+#endif
+			if(!mapped) {
+				try {
+					copy.resize(size);
+					read_whole(fd, &copy[0], size);
+				} catch(...) {
+					close(fd);
+					throw;
+				}
+			}
+			close(fd);
+			data = mapped ? mapped : (size ? &copy[0] : NULL);
+			try {
+				parse();
+			} catch(...) {
+				unmap();
+				throw;
+			}
+		}
+		~qs_view()
+		{
+			unmap();
+		}
+		//Get payload of the first section with given tag. Returns NULL if none.
+		const char* section(uint32_t tag, size_t& len, size_t start = 0, size_t* index = NULL)
+		{
+			for(size_t i = start; i < sections.size(); i++) {
+				if(sections[i].tag != tag)
+					continue;
+				len = sections[i].size;
+				if(index) *index = i;
+				return sections[i].ptr;
+			}
+			return NULL;
+		}
+		uint32_t get_version() { return version; }
+		//Replace chunked sections by their content from the chunk store.
+		void resolve(chunkstore::store& store)
+		{
+			for(auto& i : sections) {
+				if(i.tag != QS_CHUNKED)
+					continue;
+				uint32_t tag;
+				uint64_t size;
+				std::vector<chunkstore::chunk_id> ids;
+				parse_chunked(i, tag, size, ids);
+				resolved.push_back(std::vector<char>());
+				store.get(ids, resolved.back());
+				if(resolved.back().size() != size)
+					throw std::runtime_error("Quicksave chunk list has wrong size");
+				i.tag = tag;
+				i.ptr = size ? &resolved.back()[0] : data;
+				i.size = size;
+			}
+		}
+		//Collect the chunks referenced.
+		void chunks(std::set<chunkstore::chunk_id>& ids)
+		{
+			for(auto& i : sections) {
+				if(i.tag != QS_CHUNKED)
+					continue;
+				uint32_t tag;
+				uint64_t size;
+				std::vector<chunkstore::chunk_id> x;
+				parse_chunked(i, tag, size, x);
+				ids.insert(x.begin(), x.end());
+			}
+		}
+	private:
+		qs_view(const qs_view&);
+		qs_view& operator=(const qs_view&);
+		struct sect
+		{
+			uint32_t tag;
+			const char* ptr;
+			uint64_t size;
+		};
+		void parse_chunked(const sect& s, uint32_t& tag, uint64_t& size,
+			std::vector<chunkstore::chunk_id>& ids)
+		{
+			qs_reader r(s.ptr, s.size);
+			tag = r.u32();
+			size = r.u64();
+			size_t count = r.u32();
+			const char* list = r.raw(16 * count);
+			ids.resize(count);
+			for(size_t i = 0; i < count; i++)
+				memcpy(ids[i].id, list + 16 * i, 16);
+		}
+		void unmap()
+		{
+#ifndef NO_QUICKSAVE_MMAP
+			if(mapped)
+				munmap(mapped, size);
+#endif
+			mapped = NULL;
+		}
+		void read_whole(int fd, char* buf, size_t bsize)
+		{
+			size_t r = 0;
+			while(r < bsize) {
+				int x = read(fd, buf + r, bsize - r);
+				if(x < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+					continue;
+				if(x < 0) {
+					int err = errno;
+					(stringfmt() << strerror(err)).throwex();
+				}
+				if(x == 0)
+					throw std::runtime_error("Unexpected end of file");
+				r += x;
+			}
+		}
+		void parse()
+		{
+			if(size < quicksave_header || memcmp(data, quicksave_magic, 8))
+				throw std::runtime_error("Not a quicksave");
+			version = serialization::u32l(data + 8);
+			if(version != quicksave_version && version != quicksave_chunked_version)
+				throw std::runtime_error("Unsupported quicksave version");
+			uint64_t count = serialization::u32l(data + 12);
+			if(count > (size - quicksave_header) / quicksave_tabentry)
+				throw std::runtime_error("Quicksave section table truncated");
+			for(size_t i = 0; i < count; i++) {
+				const char* e = data + quicksave_header + i * quicksave_tabentry;
+				sect s;
+				s.tag = serialization::u32l(e);
+				uint64_t offset = serialization::u64l(e + 8);
+				s.size = serialization::u64l(e + 16);
+				if(offset > size || s.size > size - offset)
+					throw std::runtime_error("Quicksave section out of bounds");
+				s.ptr = data + offset;
+				sections.push_back(s);
+			}
+		}
+		char* mapped;
+		std::vector<char> copy;
+		const char* data;
+		size_t size;
+		uint32_t version;
+		std::vector<sect> sections;
+		std::list<std::vector<char>> resolved;
+	};
+
+	//Gathering writer for the quicksave file.
+	class qs_output
+	{
+	public:
+		void add(uint32_t tag, const char* data, size_t len)
+		{
+			piece p;
+			p.tag = tag;
+			p.data = data;
+			p.size = len;
+			pieces.push_back(p);
+		}
+		void add(uint32_t tag, const std::vector<char>& data)
+		{
+			add(tag, data.empty() ? NULL : &data[0], data.size());
+		}
+		//Add a section made of two parts. Used for named SRAMs.
+		void add2(uint32_t tag, const std::vector<char>& head, const std::vector<char>& data)
+		{
+			add(tag, &head[0], head.size());
+			pieces.back().tail = data.empty() ? NULL : &data[0];
+			pieces.back().tailsize = data.size();
+		}
+		void write(int fd, uint32_t version)
+		{
+			std::vector<char> header(quicksave_header + quicksave_tabentry * pieces.size());
+			memcpy(&header[0], quicksave_magic, 8);
+			serialization::u32l(&header[8], version);
+			serialization::u32l(&header[12], pieces.size());
+			std::vector<std::pair<const char*, size_t>> iov;
+			iov.push_back(std::make_pair((const char*)NULL, header.size()));
+			uint64_t offset = header.size();
+			for(size_t i = 0; i < pieces.size(); i++) {
+				auto& p = pieces[i];
+				size_t pad = (8 - offset % 8) % 8;
+				if(pad) iov.push_back(std::make_pair(quicksave_padding, pad));
+				offset += pad;
+				char* e = &header[quicksave_header + i * quicksave_tabentry];
+				serialization::u32l(e, p.tag);
+				serialization::u32l(e + 4, 0);
+				serialization::u64l(e + 8, offset);
+				serialization::u64l(e + 16, p.size + p.tailsize);
+				if(p.size) iov.push_back(std::make_pair(p.data, p.size));
+				if(p.tailsize) iov.push_back(std::make_pair(p.tail, p.tailsize));
+				offset += p.size + p.tailsize;
+			}
+			iov[0].first = &header[0];
+			write_gather(fd, iov);
+		}
+	private:
+		struct piece
+		{
+			piece() { tail = NULL; tailsize = 0; }
+			uint32_t tag;
+			const char* data;
+			size_t size;
+			const char* tail;
+			size_t tailsize;
+		};
+		void write_gather(int fd, std::vector<std::pair<const char*, size_t>>& iov)
+		{
+#ifndef NO_QUICKSAVE_MMAP
+			std::vector<struct iovec> v;
+			for(auto& i : iov) {
+				struct iovec x;
+				x.iov_base = const_cast<char*>(i.first);
+				x.iov_len = i.second;
+				v.push_back(x);
+			}
+			size_t idx = 0;
+			while(idx < v.size()) {
+				size_t cnt = v.size() - idx;
+				if(cnt > IOV_MAX) cnt = IOV_MAX;
+				ssize_t r = writev(fd, &v[idx], cnt);
+				if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+					continue;
+				if(r < 0) {
+					int err = errno;
+					(stringfmt() << strerror(err)).throwex();
+				}
+				//Skip over the completely written parts, and adjust partially written one.
+				while(idx < v.size() && (size_t)r >= v[idx].iov_len) {
+					r -= v[idx].iov_len;
+					idx++;
+				}
+				if(idx < v.size()) {
+					v[idx].iov_base = reinterpret_cast<char*>(v[idx].iov_base) + r;
+					v[idx].iov_len -= r;
+				}
+			}
+#else
+			std::vector<char> tmp;
+			for(auto& i : iov)
+				tmp.insert(tmp.end(), i.first, i.first + i.second);
+			size_t w = 0;
+			while(w < tmp.size()) {
+				int r = ::write(fd, &tmp[w], tmp.size() - w);
+				if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+					continue;
+				if(r < 0) {
+					int err = errno;
+					(stringfmt() << strerror(err)).throwex();
+				}
+				w += r;
+			}
+#endif
+		}
+		std::vector<piece> pieces;
+	};
+
+	//Number of subframes belonging to frames up to and including the given frame.
+	uint64_t quicksave_input_length(portctrl::frame_vector& v, uint64_t frame)
+	{
+		int64_t next = v.find_frame(frame + 1);
+		return (next < 0) ? v.size() : next;
+	}
+
+	//Hash first n subframes of input.
+	void quicksave_input_hash(portctrl::frame_vector& v, uint64_t n, uint8_t* hash)
+	{
+		sha256 h;
+		size_t stride = v.get_stride();
+		size_t pageframes = v.get_frames_per_page();
+		size_t page = 0;
+		while(n > 0) {
+			size_t count = (n > pageframes) ? pageframes : n;
+			h.write(v.get_page_buffer(page++), count * stride);
+			n -= count;
+		}
+		h.read(hash);
+	}
+
+	//Check if given input matches the reference.
+	bool quicksave_input_matches(portctrl::frame_vector* v, uint64_t n, const uint8_t* hash)
+	{
+		if(!v || v->size() < n)
+			return false;
+		uint8_t h[32];
+		quicksave_input_hash(*v, n, h);
+		return !memcmp(h, hash, 32);
+	}
+
+	//Serialize the whole input as raw subframes.
+	void quicksave_input_save(portctrl::frame_vector& v, std::vector<char>& out)
+	{
+		size_t stride = v.get_stride();
+		size_t pageframes = v.get_frames_per_page();
+		size_t n = v.size();
+		size_t page = 0;
+		out.resize(n * stride);
+		char* ptr = out.empty() ? NULL : &out[0];
+		while(n > 0) {
+			size_t count = (n > pageframes) ? pageframes : n;
+			memcpy(ptr, v.get_page_buffer(page++), count * stride);
+			ptr += count * stride;
+			n -= count;
+		}
+	}
+
+	//Replace the input by raw subframes.
+	void quicksave_input_load(portctrl::frame_vector& v, const char* data, size_t len)
+	{
+		size_t stride = v.get_stride();
+		size_t pageframes = v.get_frames_per_page();
+		if(len % stride)
+			throw std::runtime_error("Quicksave input has wrong controller types");
+		size_t n = len / stride;
+		size_t page = 0;
+		v.clear();
+		v.resize(n);
+		while(n > 0) {
+			size_t count = (n > pageframes) ? pageframes : n;
+			memcpy(v.get_page_buffer(page++), data, count * stride);
+			data += count * stride;
+			n -= count;
+		}
+		v.recount_frames();
+	}
+
+	//Directory holding the chunks of deduplicated quicksaves of a project.
+	std::string quicksave_chunk_dir(const std::string& movie, const std::string& prjid)
+	{
+		size_t split = movie.find_last_of("/\\");
+		std::string dir = (split < movie.length()) ? movie.substr(0, split) : std::string(".");
+		return dir + "/" + prjid + ".chunks";
+	}
+
+	//Store a section into chunk store, making a QS_CHUNKED section out of it.
+	void quicksave_chunk_section(chunkstore::store& store, std::vector<char>& out, uint32_t tag,
+		const char* data, size_t len)
+	{
+		auto ids = store.put(data, len);
+		qs_writer w(out);
+		w.u32(tag);
+		w.u64(len);
+		w.u32(ids.size());
+		for(auto& i : ids)
+			w.raw(i.id, 16);
+	}
+
+	//Quicksave (path, project) pairs overwritten since last collection.
+	std::set<std::pair<std::string, std::string>> uncollected;
+
+	//Delete the chunks no longer referenced by any deduplicated quicksave of the project in the directory.
+	size_t quicksave_collect(const std::string& movie, const std::string& prjid)
+	{
+		std::string chunkdir = quicksave_chunk_dir(movie, prjid);
+		std::string dir = chunkdir.substr(0, chunkdir.find_last_of("/"));
+		std::set<chunkstore::chunk_id> live;
+		for(auto& i : directory::enumerate(dir, ".*")) {
+			if(!directory::is_regular(i) || !moviefile::is_quicksave(i))
+				continue;
+			try {
+				qs_view v(i);
+				if(v.get_version() != quicksave_chunked_version)
+					continue;
+				size_t len;
+				const char* meta = v.section(QS_META, len);
+				if(!meta)
+					continue;
+				qs_reader r(meta, len);
+				r.string();
+				if(r.string() != prjid)
+					continue;
+				v.chunks(live);
+			} catch(...) {
+				//If some manifest can't be read, don't risk deleting its chunks.
+				return 0;
+			}
+		}
+		return chunkstore::store(chunkdir).collect(live);
+	}
+}
+
+bool moviefile::is_quicksave(const std::string& filename)
+{
+	int s = open(filename.c_str(), O_RDONLY | EXTRA_OPENFLAGS);
+	if(s < 0)
+		return false;
+	char buf[8];
+	size_t x = 0;
+	while(x < 8) {
+		int r = read(s, buf + x, 8 - x);
+		if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			continue;
+		if(r <= 0)
+			break;
+		x += r;
+	}
+	close(s);
+	return (x == 8 && !memcmp(buf, quicksave_magic, 8));
+}
+
+void moviefile::save_quick(const std::string& movie, rrdata_set& rrd, bool dedup) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	if(!input)
+		throw std::runtime_error("Can't quicksave without input");
+	std::vector<char> meta;
+	qs_writer w(meta);
+	w.string(gametype->get_name());
+	w.string(projectid);
+	w.string(coreversion = gametype->get_type().get_core_identifier());
+	for(unsigned i = 0; i < ROM_SLOT_COUNT; i++) {
+		w.string(romimg_sha256[i]);
+		w.string(romxml_sha256[i]);
+		w.string(namehint[i]);
+	}
+	w.u64(rrd.count());
+	w.u64(dyn.save_frame);
+	w.u64(dyn.lagged_frames);
+	w.u64(dyn.rtc_second);
+	w.u64(dyn.rtc_subsecond);
+	w.u32(dyn.poll_flag);
+	w.u32(dyn.pollcounters.size());
+	for(auto i : dyn.pollcounters)
+		w.u32(i);
+	w.u32(dyn.active_macros.size());
+	for(auto& i : dyn.active_macros) {
+		w.string(i.first);
+		w.u64(i.second);
+	}
+	//The input is only referenced. The reference covers everything up to the end of current frame.
+	uint64_t ilen = quicksave_input_length(*input, dyn.save_frame);
+	uint8_t ihash[32];
+	quicksave_input_hash(*input, ilen, ihash);
+	w.string(current_branch());
+	w.u64(ilen);
+	w.raw(ihash, 32);
+
+	qs_output out;
+	out.add(QS_META, meta);
+	std::list<std::vector<char>> sram_heads;
+	if(dedup) {
+		//Only the chunk lists go to the manifest, the data goes to the chunk store.
+		chunkstore::store store(quicksave_chunk_dir(movie, projectid));
+		auto add_chunked = [&store, &sram_heads, &out](uint32_t tag, const std::vector<char>& data) {
+			sram_heads.push_back(std::vector<char>());
+			quicksave_chunk_section(store, sram_heads.back(), tag, data.empty() ? NULL : &data[0],
+				data.size());
+			out.add(QS_CHUNKED, sram_heads.back());
+		};
+		add_chunked(QS_SAVESTATE, dyn.savestate);
+		add_chunked(QS_HOSTMEMORY, dyn.host_memory);
+		add_chunked(QS_SCREENSHOT, dyn.screenshot);
+		for(auto& i : dyn.sram) {
+			std::vector<char> tmp;
+			qs_writer h(tmp);
+			h.string(i.first);
+			h.raw(i.second.empty() ? NULL : &i.second[0], i.second.size());
+			add_chunked(QS_SRAM, tmp);
+		}
+		std::vector<char> tmp;
+		quicksave_input_save(*input, tmp);
+		add_chunked(QS_INPUT, tmp);
+	} else {
+		out.add(QS_SAVESTATE, dyn.savestate);
+		out.add(QS_HOSTMEMORY, dyn.host_memory);
+		out.add(QS_SCREENSHOT, dyn.screenshot);
+		for(auto& i : dyn.sram) {
+			sram_heads.push_back(std::vector<char>());
+			qs_writer h(sram_heads.back());
+			h.string(i.first);
+			out.add2(QS_SRAM, sram_heads.back(), i.second);
+		}
+	}
+	bool overwrite = directory::is_regular(movie);
+
+	std::string tmp = movie + ".tmp";
+	int strm = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | EXTRA_OPENFLAGS, 0644);
+	if(strm < 0) {
+		int err = errno;
+		(stringfmt() << "Failed to open '" << tmp << "': " << strerror(err)).throwex();
+	}
+	try {
+		out.write(strm, dedup ? quicksave_chunked_version : quicksave_version);
+	} catch(std::exception& e) {
+		close(strm);
+		(stringfmt() << "Failed to write '" << tmp << "': " << e.what()).throwex();
+	}
+	if(close(strm) < 0) {
+		int err = errno;
+		(stringfmt() << "Failed to write '" << tmp << "': " << strerror(err)).throwex();
+	}
+	if(directory::rename_overwrite(tmp.c_str(), movie.c_str()) < 0)
+		throw std::runtime_error("Can't rename '" + tmp + "' -> '" + movie + "'");
+	//Overwriting a slot may have left chunks unreferenced. Scanning all the manifests is slow, so that is only
+	//done by collect_quick_chunks().
+	if(dedup && overwrite)
+		uncollected.insert(std::make_pair(movie, projectid));
+}
+
+size_t moviefile::collect_quick_chunks() throw(std::bad_alloc)
+{
+	size_t deleted = 0;
+	std::set<std::string> done;
+	for(auto& i : uncollected) {
+		//Only one collection per chunk store.
+		if(!done.insert(quicksave_chunk_dir(i.first, i.second)).second)
+			continue;
+		try {
+			deleted += quicksave_collect(i.first, i.second);
+		} catch(std::bad_alloc& e) {
+			throw;
+		} catch(...) {
+		}
+	}
+	uncollected.clear();
+	return deleted;
+}
+
+void moviefile::load_quick(const std::string& movie) throw(std::bad_alloc, std::runtime_error)
+{
+	qs_view v(movie);
+	size_t len;
+	const char* meta = v.section(QS_META, len);
+	if(!meta)
+		throw std::runtime_error("Quicksave has no metadata");
+	qs_reader r(meta, len);
+	std::string sysregion = r.string();
+	std::string prjid = r.string();
+	if(!gametype || sysregion != gametype->get_name())
+		throw std::runtime_error("Quicksave is for different system type");
+	if(prjid != projectid)
+		throw std::runtime_error("Quicksave is from different movie");
+	coreversion = r.string();
+	for(unsigned i = 0; i < ROM_SLOT_COUNT; i++) {
+		romimg_sha256[i] = r.string();
+		romxml_sha256[i] = r.string();
+		namehint[i] = r.string();
+	}
+	r.u64();	//Rerecord count, only for brief info.
+	dynamic_state ndyn;
+	ndyn.save_frame = r.u64();
+	ndyn.lagged_frames = r.u64();
+	ndyn.rtc_second = r.u64();
+	ndyn.rtc_subsecond = r.u64();
+	ndyn.poll_flag = r.u32();
+	ndyn.pollcounters.resize(r.u32());
+	for(auto& i : ndyn.pollcounters)
+		i = r.u32();
+	size_t macros = r.u32();
+	for(size_t i = 0; i < macros; i++) {
+		std::string name = r.string();
+		ndyn.active_macros[name] = r.u64();
+	}
+	std::string bname = r.string();
+	uint64_t ilen = r.u64();
+	const uint8_t* ihash = reinterpret_cast<const uint8_t*>(r.raw(32));
+	if(v.get_version() == quicksave_chunked_version) {
+		chunkstore::store store(quicksave_chunk_dir(movie, prjid));
+		v.resolve(store);
+	}
+	const char* p;
+	//Prefer the branch the save was made on, but fall back to the current one. Deduplicated quicksaves carry
+	//the input, so those can be loaded even if input has changed.
+	if(branches.count(bname) && quicksave_input_matches(&branches[bname], ilen, ihash))
+		input = &branches[bname];
+	else if(!quicksave_input_matches(input, ilen, ihash)) {
+		if(!input || !(p = v.section(QS_INPUT, len)))
+			throw std::runtime_error("Input has changed since the quicksave was made");
+		if(branches.count(bname))
+			input = &branches[bname];
+		quicksave_input_load(*input, p, len);
+	}
+
+	if((p = v.section(QS_SAVESTATE, len)))
+		ndyn.savestate.assign(p, p + len);
+	if((p = v.section(QS_HOSTMEMORY, len)))
+		ndyn.host_memory.assign(p, p + len);
+	if((p = v.section(QS_SCREENSHOT, len)))
+		ndyn.screenshot.assign(p, p + len);
+	size_t idx = 0;
+	while((p = v.section(QS_SRAM, len, idx, &idx))) {
+		qs_reader h(p, len);
+		std::string name = h.string();
+		size_t hlen = 4 + name.length();
+		ndyn.sram[name].assign(p + hlen, p + len);
+		idx++;
+	}
+	dyn.swap(ndyn);
+}
+
+void moviefile::brief_info::load_quick(const std::string& filename)
+{
+	qs_view v(filename);
+	size_t len;
+	const char* meta = v.section(QS_META, len);
+	if(!meta)
+		throw std::runtime_error("Quicksave has no metadata");
+	qs_reader r(meta, len);
+	sysregion = r.string();
+	projectid = r.string();
+	corename = r.string();
+	for(unsigned i = 0; i < ROM_SLOT_COUNT; i++) {
+		hash[i] = r.string();
+		hashxml[i] = r.string();
+		hint[i] = r.string();
+	}
+	rerecords = r.u64();
+	current_frame = r.u64();
+}
@@ -14,6 +14,7 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include <cstring>
 #if defined(_WIN32) || defined(_WIN64) || defined(TEST_WIN32_CODE)
 #include <windows.h>
 //FUCK YOU. SERIOUSLY.
@@ -85,6 +86,10 @@ moviefile::brief_info::brief_info(const std::string& filename)
 		}
 		return;
 	}
+	if(is_quicksave(filename)) {
+		load_quick(filename);
+		return;
+	}
 	{
 		int s = open(filename.c_str(), O_RDONLY | EXTRA_OPENFLAGS);
 		if(s < 0) {
@@ -159,6 +164,9 @@ moviefile::moviefile(const std::string& movie, core_type& romtype) throw(std::ba
 		copy_fields(s);
 		return;
 	}
+	if(is_quicksave(movie))
+		(stringfmt() << "'" << movie << "' is a quicksave, which can only be loaded on top of its movie")
+			.throwex();
 	input = NULL;
 	start_paused = false;
 	force_corrupt = false;
@@ -188,8 +196,8 @@ void moviefile::fixup_current_branch(const moviefile& mv)
 			input = &branches[i.first];
 }
 
-void moviefile::save(const std::string& movie, unsigned compression, bool binary, rrdata_set& rrd, bool as_state)
-	throw(std::bad_alloc, std::runtime_error)
+void moviefile::save(const std::string& movie, unsigned compression, bool binary, rrdata_set& rrd, bool as_state,
+	uint16_t method) throw(std::bad_alloc, std::runtime_error)
 {
 	regex_results rr;
 	if(rr = regex("\\$MEMORY:(.*)", movie)) {
@@ -228,7 +236,7 @@ void moviefile::save(const std::string& movie, unsigned compression, bool binary
 			throw std::runtime_error("Can't rename '" + tmp + "' -> '" + movie + "'");
 		return;
 	}
-	zip::writer w(movie, compression);
+	zip::writer w(movie, compression, method);
 	save(w, rrd, as_state);
 }
 
@@ -346,7 +354,7 @@ bool moviefile::is_movie_or_savestate(const std::string& filename)
 		}
 		bool is_binary = check_binary_magic(s);
 		close(s);
-		if(is_binary)
+		if(is_binary || is_quicksave(filename))
 			return true;
 		//It is not binary, might be text.
 		std::string tmp;
@@ -434,6 +442,55 @@ void dynamic_state::clear(int64_t sec, int64_t ssec, const std::map<std::string,
 	active_macros.clear();
 }
 
+namespace
+{
+	void copy_if_changed(std::vector<char>& dst, const std::vector<char>& src)
+	{
+		if(dst.size() == src.size() && (src.empty() || !memcmp(&dst[0], &src[0], src.size())))
+			return;
+		//Assignment reuses the existing capacity.
+		dst = src;
+	}
+}
+
+void dynamic_state::copy_from(const dynamic_state& s) throw(std::bad_alloc)
+{
+	if(this == &s)
+		return;
+	//Usually the set of SRAMs is the same, so only contents need updating.
+	bool same_srams = (sram.size() == s.sram.size());
+	auto j = s.sram.begin();
+	for(auto i = sram.begin(); same_srams && i != sram.end(); i++, j++)
+		same_srams = (i->first == j->first);
+	if(same_srams) {
+		j = s.sram.begin();
+		for(auto i = sram.begin(); i != sram.end(); i++, j++)
+			copy_if_changed(i->second, j->second);
+	} else
+		sram = s.sram;
+	savestate = s.savestate;
+	copy_if_changed(host_memory, s.host_memory);
+	copy_if_changed(screenshot, s.screenshot);
+	save_frame = s.save_frame;
+	lagged_frames = s.lagged_frames;
+	pollcounters = s.pollcounters;
+	poll_flag = s.poll_flag;
+	rtc_second = s.rtc_second;
+	rtc_subsecond = s.rtc_subsecond;
+	active_macros = s.active_macros;
+}
+
+size_t dynamic_state::get_size() const throw()
+{
+	size_t size = sizeof(*this) + savestate.size() + host_memory.size() + screenshot.size() +
+		pollcounters.size() * sizeof(uint32_t);
+	for(auto& i : sram)
+		size += i.first.length() + i.second.size();
+	for(auto& i : active_macros)
+		size += i.first.length() + sizeof(i.second);
+	return size;
+}
+
 void dynamic_state::swap(dynamic_state& s) throw()
 {
 	std::swap(sram, s.sram);
@@ -0,0 +1,72 @@
+#include "cmdhelp/profiler.hpp"
+#include "core/command.hpp"
+#include "core/messages.hpp"
+#include "core/profiler.hpp"
+#include "library/profiler.hpp"
+#include "library/string.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+
+void profiler_write_trace(const std::string& filename) throw(std::bad_alloc, std::runtime_error)
+{
+	std::ofstream out(filename.c_str());
+	if(!out)
+		throw std::runtime_error("Can't open '" + filename + "' for writing");
+	profiler::write_chrome_trace(out);
+	if(!out)
+		throw std::runtime_error("Can't write '" + filename + "'");
+}
+
+std::string profiler_summary() throw(std::bad_alloc)
+{
+	uint64_t frames;
+	auto s = profiler::summary(&frames);
+	std::vector<std::pair<std::string, profiler::stats>> sorted(s.begin(), s.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, profiler::stats>& a,
+		const std::pair<std::string, profiler::stats>& b) { return a.second.total > b.second.total; });
+	std::ostringstream out;
+	out << frames << " frames" << std::endl;
+	out << "span                        count    total ms     avg us     max us  us/frame" << std::endl;
+	for(auto& i : sorted) {
+		out << std::left << std::setw(24) << i.first << std::right << " " << std::setw(9)
+			<< i.second.count << " " << std::fixed << std::setprecision(3) << std::setw(11)
+			<< i.second.total / 1e6 << " " << std::setw(10) << i.second.total / 1e3 / i.second.count
+			<< " " << std::setw(10) << i.second.max / 1e3 << " ";
+		if(frames)
+			out << std::setw(9) << i.second.total / 1e3 / frames;
+		else
+			out << std::setw(9) << "-";
+		out << std::endl;
+	}
+	return out.str();
+}
+
+namespace
+{
+	command::fnptr<> CMD_profile_start(lsnes_cmds, CPROFILER::start,
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			profiler::clear();
+			profiler::set_enabled(true);
+			messages << "Profiling started" << std::endl;
+		});
+
+	command::fnptr<> CMD_profile_stop(lsnes_cmds, CPROFILER::stop,
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			profiler::set_enabled(false);
+			messages << "Profiling stopped" << std::endl;
+		});
+
+	command::fnptr<> CMD_profile_summary(lsnes_cmds, CPROFILER::summary,
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			messages << profiler_summary();
+		});
+
+	command::fnptr<command::arg_filename> CMD_profile_write(lsnes_cmds, CPROFILER::write,
+		[](command::arg_filename args) throw(std::bad_alloc, std::runtime_error) {
+			profiler_write_trace(args);
+			messages << "Profile written to '" << std::string(args) << "'" << std::endl;
+		});
+}
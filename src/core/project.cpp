@@ -336,6 +336,8 @@ project_info* project_state::get()
 
 bool project_state::set(project_info* p, bool current)
 {
+	//Clean up after the quicksaves of the project being left.
+	moviefile::collect_quick_chunks();
 	if(!p) {
 		if(active_project)
 			commentary.unload_collection();
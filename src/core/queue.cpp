@@ -2,14 +2,50 @@
 #include "core/queue.hpp"
 #include "core/random.hpp"
 #include "library/command.hpp"
+#include "library/profiler.hpp"
 #include "library/threads.hpp"
 #include <functional>
 
+//Sizes of the lock-free parts of queues. Keypresses come in bursts (e.g. joystick axes).
+#define KEYPRESS_QUEUE_SIZE 1024
+#define COMMAND_QUEUE_SIZE 256
+#define FUNCTION_QUEUE_SIZE 256
+
+template<typename T> void input_queue::channel<T>::push(T& item)
+{
+	//Once the ring has overflowed, keep queueing to overflow list until it is drained, so order is kept.
+	if(!overflowed.load(std::memory_order_acquire) && ring.push(item))
+		return;
+	threads::alock h(overflow_lock);
+	overflow.push_back(std::move(item));
+	overflowed.store(true, std::memory_order_release);
+}
+
+template<typename T> bool input_queue::channel<T>::pull(T& item)
+{
+	if(ring.pull(item))
+		return true;
+	if(!overflowed.load(std::memory_order_acquire))
+		return false;
+	threads::alock h(overflow_lock);
+	//Racing producers may have gotten into ring before overflow was flagged. Those go first.
+	if(ring.pull(item))
+		return true;
+	if(overflow.empty()) {
+		overflowed.store(false, std::memory_order_release);
+		return false;
+	}
+	item = std::move(overflow.front());
+	overflow.pop_front();
+	if(overflow.empty())
+		overflowed.store(false, std::memory_order_release);
+	return true;
+}
+
 input_queue::input_queue(command::group& _command)
-	: command(_command)
+	: keypresses(KEYPRESS_QUEUE_SIZE), commands(COMMAND_QUEUE_SIZE), functions(FUNCTION_QUEUE_SIZE),
+	command(_command), consumer_waiting(false), wake_requested(false)
 {
-	functions_executed = 0;
-	next_function = 0;
 	system_thread_available = false;
 	queue_function_run = false;
 }
@@ -39,25 +75,60 @@ keypress_info::keypress_info(keyboard::modifier_set mod, keyboard::key& _key, ke
 }
 
 
-void input_queue::queue(const keypress_info& k) throw(std::bad_alloc)
+void input_queue::queued() throw()
+{
+	//Pairs with the fence in wait(): Either this sees the consumer waiting, or the consumer sees the new entry.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(consumer_waiting.load(std::memory_order_relaxed)) {
+		//The entry itself is seen by pending(), so no wake request is needed.
+		threads::alock h(queue_lock);
+		queue_condition.notify_all();
+	}
+}
+
+bool input_queue::pending() const
+{
+	return keypresses.pending() || commands.pending() || functions.pending();
+}
+
+void input_queue::wait(uint64_t usec) throw()
 {
 	threads::alock h(queue_lock);
-	keypresses.push_back(k);
-	queue_condition.notify_all();
+	consumer_waiting.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	//A wake() that came before this call must not be lost.
+	if(!wake_requested.load(std::memory_order_relaxed) && !pending())
+		threads::cv_timed_wait(queue_condition, h, threads::ustime(usec));
+	wake_requested.store(false, std::memory_order_relaxed);
+	consumer_waiting.store(false, std::memory_order_relaxed);
 }
 
-void input_queue::queue(const std::string& c) throw(std::bad_alloc)
+void input_queue::wake() throw()
 {
 	threads::alock h(queue_lock);
-	commands.push_back(std::make_pair(nullptr, c));
+	wake_requested.store(true, std::memory_order_relaxed);
 	queue_condition.notify_all();
 }
 
+void input_queue::queue(const keypress_info& k) throw(std::bad_alloc)
+{
+	keypress_info _k = k;
+	keypresses.push(_k);
+	queued();
+}
+
+void input_queue::queue(const std::string& c) throw(std::bad_alloc)
+{
+	auto entry = std::make_pair((const char*)nullptr, c);
+	commands.push(entry);
+	queued();
+}
+
 void input_queue::queue(const char* c, const std::string& a) throw(std::bad_alloc)
 {
-	threads::alock h(queue_lock);
-	commands.push_back(std::make_pair(c, a));
-	queue_condition.notify_all();
+	auto entry = std::make_pair(c, a);
+	commands.push(entry);
+	queued();
 }
 
 void input_queue::queue(std::function<void()> f, std::function<void(std::exception& e)> onerror, bool sync)
@@ -71,70 +142,71 @@ void input_queue::queue(std::function<void()> f, std::function<void(std::excepti
 		}
 		return;
 	}
-	threads::alock h(queue_lock);
-	++next_function;
 	function_queue_entry entry;
-	entry.fn = f;
-	entry.onerror = onerror;
-	functions.push_back(entry);
-	queue_condition.notify_all();
-	if(sync)
-		while(functions_executed < next_function && system_thread_available) {
-			threads::cv_timed_wait(queue_condition, h, threads::ustime(10000));
+	entry.fn = std::move(f);
+	entry.onerror = std::move(onerror);
+	std::shared_ptr<std::atomic<bool>> done;
+	if(sync) {
+		done.reset(new std::atomic<bool>(false));
+		entry.done = done;
+	}
+	functions.push(entry);
+	queued();
+	if(sync) {
+		threads::alock h(sync_lock);
+		while(!done->load(std::memory_order_acquire) && system_thread_available) {
+			threads::cv_timed_wait(sync_condition, h, threads::ustime(10000));
 			random_mix_timing_entropy();
 		}
+	}
 }
 
-void input_queue::run_queue(bool unlocked) throw()
+void input_queue::run_queue() throw()
 {
-	if(!unlocked)
-		queue_lock.lock();
+	PROFILE_SPAN("queue");
 	try {
 		//Flush keypresses.
-		while(!keypresses.empty()) {
-			keypress_info k = keypresses.front();
-			keypresses.pop_front();
-			queue_lock.unlock();
+		keypress_info k;
+		while(keypresses.pull(k)) {
 			if(k.key1)
 				k.key1->set_state(k.modifiers, k.value);
 			if(k.key2)
 				k.key2->set_state(k.modifiers, k.value);
-			queue_lock.lock();
 			queue_function_run = true;
 		}
 		//Flush commands.
-		while(!commands.empty()) {
-			auto c = commands.front();
-			commands.pop_front();
-			queue_lock.unlock();
+		std::pair<const char*, std::string> c;
+		while(commands.pull(c)) {
 			if(c.first)
 				command.invoke(c.first, c.second);
 			else
 				command.invoke(c.second);
-			queue_lock.lock();
 			queue_function_run = true;
 		}
-		//Flush functions.
-		while(!functions.empty()) {
-			function_queue_entry f = functions.front();
-			functions.pop_front();
-			queue_lock.unlock();
+		//Flush functions. Synchronous callers are woken once per batch.
+		function_queue_entry f;
+		bool any_sync = false;
+		while(functions.pull(f)) {
 			try {
 				f.fn();
 			} catch(std::exception& e) {
 				f.onerror(e);
 			}
-			queue_lock.lock();
-			++functions_executed;
+			if(f.done) {
+				f.done->store(true, std::memory_order_release);
+				any_sync = true;
+			}
+			f = function_queue_entry();
 			queue_function_run = true;
 		}
-		queue_condition.notify_all();
+		if(any_sync) {
+			threads::alock h(sync_lock);
+			sync_condition.notify_all();
+		}
 	} catch(std::bad_alloc& e) {
 		OOM_panic();
 	} catch(std::exception& e) {
 		std::cerr << "Fault inside platform::run_queues(): " << e.what() << std::endl;
 		exit(1);
 	}
-	if(!unlocked)
-		queue_lock.unlock();
 }
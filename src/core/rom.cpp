@@ -149,9 +149,16 @@ std::map<std::string, std::vector<char>> load_sram_commandline(const std::vector
 std::vector<char> loaded_rom::save_core_state(bool nochecksum) throw(std::bad_alloc, std::runtime_error)
 {
 	std::vector<char> ret;
+	save_core_state(ret, nochecksum);
+	return ret;
+}
+
+void loaded_rom::save_core_state(std::vector<char>& ret, bool nochecksum) throw(std::bad_alloc,
+	std::runtime_error)
+{
 	rtype().serialize(ret);
 	if(nochecksum)
-		return ret;
+		return;
 	size_t offset = ret.size();
 	unsigned char tmp[32];
 #ifdef USE_LIBGCRYPT_SHA256
@@ -161,7 +168,6 @@ std::vector<char> loaded_rom::save_core_state(bool nochecksum) throw(std::bad_al
 #endif
 	ret.resize(offset + 32);
 	memcpy(&ret[offset], tmp, 32);
-	return ret;
 }
 
 void loaded_rom::load_core_state(const std::vector<char>& buf, bool nochecksum) throw(std::runtime_error)
@@ -358,9 +358,8 @@ void platform::dummy_event_loop() throw()
 {
 	auto& core = CORE();
 	while(!do_exit_dummy_event_loop) {
-		threads::alock h(core.iqueue->queue_lock);
-		core.iqueue->run_queue(true);
-		threads::cv_timed_wait(core.iqueue->queue_condition, h, threads::ustime(MAXWAIT));
+		core.iqueue->run_queue();
+		core.iqueue->wait(MAXWAIT);
 		random_mix_timing_entropy();
 	}
 }
@@ -369,8 +368,7 @@ void platform::exit_dummy_event_loop() throw()
 {
 	auto& core = CORE();
 	do_exit_dummy_event_loop = true;
-	threads::alock h(core.iqueue->queue_lock);
-	core.iqueue->queue_condition.notify_all();
+	core.iqueue->wake();
 	usleep(200000);
 }
 
@@ -393,8 +391,7 @@ void platform::flush_command_queue() throw()
 			reload_lua_timers();
 			run_idle = false;
 		}
-		threads::alock h(core.iqueue->queue_lock);
-		core.iqueue->run_queue(true);
+		core.iqueue->run_queue();
 		if(!pausing_allowed)
 			break;
 		if(core.iqueue->queue_function_run)
@@ -414,7 +411,7 @@ void platform::flush_command_queue() throw()
 			if(on_timer_time >= now)
 				waitleft = min(waitleft, on_timer_time - now);
 			if(waitleft > 0) {
-				threads::cv_timed_wait(core.iqueue->queue_condition, h, threads::ustime(waitleft));
+				core.iqueue->wait(waitleft);
 				random_mix_timing_entropy();
 			}
 		} else
@@ -447,8 +444,7 @@ void platform::wait(uint64_t usec) throw()
 			run_idle = false;
 			reload_lua_timers();
 		}
-		threads::alock h(core.iqueue->queue_lock);
-		core.iqueue->run_queue(true);
+		core.iqueue->run_queue();
 		if(core.iqueue->queue_function_run)
 			reload_lua_timers();
 		//If usec is 0, never wait (waitleft can be nonzero if time counting screws up).
@@ -468,7 +464,7 @@ void platform::wait(uint64_t usec) throw()
 			if(on_timer_time >= now)
 				waitleft = min(waitleft, on_timer_time - now);
 			if(waitleft > 0) {
-				threads::cv_timed_wait(core.iqueue->queue_condition, h, threads::ustime(waitleft));
+				core.iqueue->wait(waitleft);
 				random_mix_timing_entropy();
 			}
 		} else
@@ -480,8 +476,7 @@ void platform::cancel_wait() throw()
 {
 	auto& core = CORE();
 	continue_time = 0;
-	threads::alock h(core.iqueue->queue_lock);
-	core.iqueue->queue_condition.notify_all();
+	core.iqueue->wake();
 }
 
 void platform::set_modal_pause(bool enable) throw()
@@ -491,7 +486,7 @@ void platform::set_modal_pause(bool enable) throw()
 
 void platform::run_queues() throw()
 {
-	CORE().iqueue->run_queue(false);
+	CORE().iqueue->run_queue();
 }
 
 namespace
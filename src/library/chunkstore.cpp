@@ -0,0 +1,181 @@
+#include "chunkstore.hpp"
+#include "directory.hpp"
+#include "hash128.hpp"
+#include "hex.hpp"
+#include "string.hpp"
+#include <cstdio>
+#include <fstream>
+
+namespace chunkstore
+{
+namespace
+{
+	//Chunk size limits. The average chunk size is about min_chunk + avg_mask + 1.
+	const size_t min_chunk = 2048;
+	const uint64_t avg_mask = 0x1FFF;
+	const size_t max_chunk = 65536;
+
+	//Random values for the rolling gear hash, generated deterministically (splitmix64).
+	struct gear_values
+	{
+		gear_values()
+		{
+			uint64_t s = 0x6c736e657363646bULL;
+			for(unsigned i = 0; i < 256; i++) {
+				uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+				table[i] = z ^ (z >> 31);
+			}
+		}
+		uint64_t table[256];
+	};
+
+	const uint64_t* gear_table()
+	{
+		//Initialization of function-local static is thread-safe.
+		static const gear_values v;
+		return v.table;
+	}
+
+	chunk_id hash_chunk(const char* data, size_t size)
+	{
+		chunk_id id;
+		hash128::hash(id.id, reinterpret_cast<const uint8_t*>(data), size);
+		return id;
+	}
+}
+
+std::string chunk_id::str() const throw(std::bad_alloc)
+{
+	return hex::b_to(id, 16);
+}
+
+std::vector<size_t> split(const char* data, size_t size) throw(std::bad_alloc)
+{
+	const uint64_t* gear = gear_table();
+	const uint8_t* _data = reinterpret_cast<const uint8_t*>(data);
+	std::vector<size_t> r;
+	size_t start = 0;
+	while(start < size) {
+		size_t left = size - start;
+		if(left <= min_chunk) {
+			r.push_back(left);
+			break;
+		}
+		size_t limit = (left < max_chunk) ? left : max_chunk;
+		size_t i = min_chunk;
+		uint64_t h = 0;
+		for(; i < limit; i++) {
+			h = (h << 1) + gear[_data[start + i]];
+			if(!(h & avg_mask)) {
+				i++;
+				break;
+			}
+		}
+		r.push_back(i);
+		start += i;
+	}
+	return r;
+}
+
+store::store(const std::string& _dir) throw(std::bad_alloc, std::runtime_error)
+{
+	dir = _dir;
+	written = 0;
+	if(!directory::ensure_exists(dir))
+		throw std::runtime_error("Can't create chunk store '" + dir + "'");
+}
+
+std::string store::chunk_path(const chunk_id& id)
+{
+	std::string h = id.str();
+	return dir + "/" + h.substr(0, 2) + "/" + h.substr(2);
+}
+
+std::vector<chunk_id> store::put(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error)
+{
+	std::vector<chunk_id> r;
+	size_t offset = 0;
+	for(auto i : split(data, size)) {
+		chunk_id id = hash_chunk(data + offset, i);
+		r.push_back(id);
+		std::string path = chunk_path(id);
+		if(directory::is_regular(path)) {
+			offset += i;
+			continue;
+		}
+		std::string h = id.str();
+		if(!directory::ensure_exists(dir + "/" + h.substr(0, 2)))
+			throw std::runtime_error("Can't create chunk directory in '" + dir + "'");
+		std::string tmp = path + ".tmp";
+		{
+			std::ofstream f(tmp.c_str(), std::ios::binary);
+			f.write(data + offset, i);
+			if(!f)
+				throw std::runtime_error("Can't write chunk '" + tmp + "'");
+		}
+		if(directory::rename_overwrite(tmp.c_str(), path.c_str()) < 0) {
+			remove(tmp.c_str());
+			throw std::runtime_error("Can't rename '" + tmp + "' -> '" + path + "'");
+		}
+		written += i;
+		offset += i;
+	}
+	return r;
+}
+
+void store::get(const std::vector<chunk_id>& ids, std::vector<char>& out) throw(std::bad_alloc, std::runtime_error)
+{
+	for(auto& i : ids) {
+		std::string path = chunk_path(i);
+		std::ifstream f(path.c_str(), std::ios::binary);
+		if(!f)
+			throw std::runtime_error("Missing chunk " + i.str() + " in '" + dir + "'");
+		size_t base = out.size();
+		char buf[16384];
+		while(f) {
+			f.read(buf, sizeof(buf));
+			out.insert(out.end(), buf, buf + f.gcount());
+		}
+		if(!(hash_chunk(out.empty() ? NULL : &out[base], out.size() - base) == i))
+			throw std::runtime_error("Chunk " + i.str() + " in '" + dir + "' is damaged");
+	}
+}
+
+size_t store::collect(const std::set<chunk_id>& live) throw(std::bad_alloc)
+{
+	size_t deleted = 0;
+	std::set<std::string> subdirs;
+	try {
+		subdirs = directory::enumerate(dir, "[0-9a-f][0-9a-f]");
+	} catch(...) {
+		return 0;
+	}
+	for(auto& i : subdirs) {
+		std::string prefix = i.substr(i.length() - 2);
+		std::set<std::string> files;
+		try {
+			files = directory::enumerate(i, ".*");
+		} catch(...) {
+			continue;
+		}
+		for(auto& j : files) {
+			std::string name = j.substr(i.length() + 1);
+			//Leftover temporary files from interrupted writes are garbage too.
+			bool keep = false;
+			if(name.length() == 30) {
+				chunk_id id;
+				try {
+					hex::b_from(id.id, prefix + name);
+					keep = live.count(id);
+				} catch(...) {
+				}
+			}
+			if(!keep && !remove(j.c_str()))
+				deleted++;
+		}
+	}
+	return deleted;
+}
+}
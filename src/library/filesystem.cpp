@@ -1,50 +1,347 @@
 #include "filesystem.hpp"
 #include "minmax.hpp"
 #include "serialization.hpp"
+#include <cstdio>
 #include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <vector>
+#include <zlib.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_MMAP
+#endif
 
-filesystem::filesystem(const std::string& file)
+//Magic for log records.
+#define LOG_MAGIC 0x5345574CU
+//Log size to checkpoint at.
+#define LOG_CHECKPOINT_SIZE (1 << 20)
+//Granularity of growing the mapping.
+#define MAPPING_GRANULARITY (64ULL << 20)
+
+filesystem::filesystem(const std::string& file, bool use_mmap)
+{
+	logfile = file + ".wal";
+	log_size = 0;
+	logfd = -1;
+	group_depth = 0;
+	fd = -1;
+	mapping = NULL;
+	mapping_size = 0;
+#ifdef HAVE_MMAP
+	if(use_mmap) {
+		fd = open(file.c_str(), O_RDWR | O_CREAT, 0666);
+		if(fd < 0)
+			throw std::runtime_error("Can't open file '" + file + "'");
+		struct stat st;
+		if(fstat(fd, &st) < 0) {
+			close(fd);
+			throw std::runtime_error("Can't get file size.");
+		}
+		backing_size = st.st_size;
+	}
+#endif
+	if(fd < 0) {
+		backing.open(file, std::ios_base::out | std::ios_base::app);
+		backing.close();
+		backing.open(file, std::ios_base::in | std::ios_base::out | std::ios_base::binary |
+			std::ios_base::ate);
+		if(!backing)
+			throw std::runtime_error("Can't open file '" + file + "'");
+		backing_size = backing.tellp();
+		backing.seekp(0, std::ios_base::beg);
+		if(!backing)
+			throw std::runtime_error("Can't get file size.");
+	}
+	try {
+		replay_log();
+		supercluster_count = (backing_size + SUPERCLUSTER_SIZE - 1) / SUPERCLUSTER_SIZE;
+		for(unsigned i = 0; i < supercluster_count; i++) {
+			char buffer[CLUSTER_SIZE];
+			read_raw(SUPERCLUSTER_SIZE * i, buffer, CLUSTER_SIZE);
+			superclusters[i].load(buffer);
+		}
+		if(supercluster_count == 0) {
+			begin_group();
+			allocate_cluster();	//Will allocate cluster 2 (main directory).
+			//Write superblock to cluster 1.
+			char superblock[CLUSTER_SIZE];
+			memset(superblock, 0, CLUSTER_SIZE);
+			uint32_t c = 2;
+			uint32_t p = 0;
+			uint32_t c2, p2;
+			write_data(c, p, superblock, CLUSTER_SIZE, c2, p2);
+			strcpy(superblock, "sefs-magic");
+			c = 1;
+			p = 0;
+			write_data(c, p, superblock, CLUSTER_SIZE, c2, p2);
+			end_group();
+		} else {
+			//Read superblock from cluster 1.
+			char superblock[CLUSTER_SIZE];
+			uint32_t c = 1;
+			uint32_t p = 0;
+			read_data(c, p, superblock, CLUSTER_SIZE);
+			if(strcmp(superblock, "sefs-magic"))
+				throw std::runtime_error("Bad magic");
+		}
+	} catch(...) {
+#ifdef HAVE_MMAP
+		if(logfd >= 0)
+			close(logfd);
+		if(mapping)
+			munmap(mapping, mapping_size);
+		if(fd >= 0)
+			close(fd);
+#endif
+		throw;
+	}
+}
+
+filesystem::~filesystem()
 {
-	backing.open(file, std::ios_base::out | std::ios_base::app);
-	backing.close();
-	backing.open(file, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::ate);
+	try {
+		commit_tables();
+		//Checkpoint, the log is not needed after the tables are on disk.
+		sync_raw();
+		remove_log();
+	} catch(...) {
+	}
+#ifdef HAVE_MMAP
+	if(logfd >= 0)
+		close(logfd);
+	if(mapping)
+		munmap(mapping, mapping_size);
+	if(fd >= 0)
+		close(fd);
+#endif
+}
+
+void filesystem::read_raw(uint64_t offset, void* data, size_t length)
+{
+	if(offset + length > backing_size)
+		throw std::runtime_error("Can't read data");
+#ifdef HAVE_MMAP
+	if(fd >= 0) {
+		if(offset + length > mapping_size) {
+			//The file has grown, map it again. The mapping can extend past end of file, as long as that
+			//part is not accessed.
+			if(mapping)
+				munmap(mapping, mapping_size);
+			mapping_size = (backing_size + MAPPING_GRANULARITY - 1) / MAPPING_GRANULARITY *
+				MAPPING_GRANULARITY;
+			void* m = mmap(NULL, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+			mapping = (m != MAP_FAILED) ? reinterpret_cast<char*>(m) : NULL;
+			if(!mapping)
+				mapping_size = 0;
+		}
+		if(mapping) {
+			memcpy(data, mapping + offset, length);
+			return;
+		}
+		//Mapping failed (e.g. out of address space), read the normal way.
+		char* _data = reinterpret_cast<char*>(data);
+		while(length) {
+			ssize_t r = pread(fd, _data, length, offset);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				throw std::runtime_error("Can't read data");
+			_data += r;
+			offset += r;
+			length -= r;
+		}
+		return;
+	}
+#endif
+	backing.clear();
+	backing.seekg(offset, std::ios_base::beg);
+	backing.read(reinterpret_cast<char*>(data), length);
 	if(!backing)
-		throw std::runtime_error("Can't open file '" + file + "'");
-	uint64_t backing_size = backing.tellp();
-	backing.seekp(0, std::ios_base::beg);
+		throw std::runtime_error("Can't read data");
+}
+
+void filesystem::write_raw(uint64_t offset, const void* data, size_t length)
+{
+#ifdef HAVE_MMAP
+	if(fd >= 0) {
+		const char* _data = reinterpret_cast<const char*>(data);
+		uint64_t _offset = offset;
+		size_t _length = length;
+		while(_length) {
+			ssize_t r = pwrite(fd, _data, _length, _offset);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				throw std::runtime_error("Can't write data");
+			_data += r;
+			_offset += r;
+			_length -= r;
+		}
+		backing_size = max(backing_size, offset + length);
+		return;
+	}
+#endif
+	backing.clear();
+	backing.seekp(offset, std::ios_base::beg);
+	backing.write(reinterpret_cast<const char*>(data), length);
 	if(!backing)
-		throw std::runtime_error("Can't get file size.");
-	supercluster_count = (backing_size + SUPERCLUSTER_SIZE - 1) / SUPERCLUSTER_SIZE;
-	for(unsigned i = 0; i < supercluster_count; i++)
-		superclusters[i].load(backing, i);
-	if(supercluster_count == 0) {
-		allocate_cluster();	//Will allocate cluster 2 (main directory).
-		//Write superblock to cluster 1.
-		char superblock[CLUSTER_SIZE];
-		memset(superblock, 0, CLUSTER_SIZE);
-		uint32_t c = 2;
-		uint32_t p = 0;
-		uint32_t c2, p2;
-		write_data(c, p, superblock, CLUSTER_SIZE, c2, p2);
-		strcpy(superblock, "sefs-magic");
-		c = 1;
-		p = 0;
-		write_data(c, p, superblock, CLUSTER_SIZE, c2, p2);
-	} else {
-		//Read superblock from cluster 1.
-		char superblock[CLUSTER_SIZE];
-		uint32_t c = 1;
-		uint32_t p = 0;
-		read_data(c, p, superblock, CLUSTER_SIZE);
-		if(strcmp(superblock, "sefs-magic"))
-			throw std::runtime_error("Bad magic");
+		throw std::runtime_error("Can't write data");
+	backing_size = max(backing_size, offset + length);
+}
+
+void filesystem::sync_raw()
+{
+#ifdef HAVE_MMAP
+	if(fd >= 0) {
+		if(fsync(fd) < 0)
+			throw std::runtime_error("Can't sync data");
+		return;
+	}
+#endif
+	backing.flush();
+	if(!backing)
+		throw std::runtime_error("Can't sync data");
+}
+
+void filesystem::append_log(const std::vector<char>& record)
+{
+#ifdef HAVE_MMAP
+	if(logfd < 0)
+		logfd = open(logfile.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if(logfd < 0)
+		throw std::runtime_error("Can't open log file");
+	size_t done = 0;
+	while(done < record.size()) {
+		ssize_t r = write(logfd, &record[done], record.size() - done);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0)
+			throw std::runtime_error("Can't write log file");
+		done += r;
 	}
+	//The log must be on disk before anything it describes gets written.
+	if(fsync(logfd) < 0)
+		throw std::runtime_error("Can't sync log file");
+#else
+	if(!logstream.is_open())
+		logstream.open(logfile, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+	logstream.write(&record[0], record.size());
+	logstream.flush();
+	if(!logstream)
+		throw std::runtime_error("Can't write log file");
+#endif
+	log_size += record.size();
+}
+
+void filesystem::remove_log()
+{
+#ifdef HAVE_MMAP
+	if(logfd >= 0)
+		close(logfd);
+	logfd = -1;
+#else
+	logstream.close();
+#endif
+	remove(logfile.c_str());
+	log_size = 0;
+}
+
+void filesystem::begin_group()
+{
+	group_depth++;
+}
+
+void filesystem::end_group()
+{
+	if(group_depth && !--group_depth)
+		commit_tables();
+}
+
+void filesystem::end_operation()
+{
+	if(!group_depth)
+		commit_tables();
+}
+
+void filesystem::commit_tables()
+{
+	if(dirty.empty())
+		return;
+	//Log record: Magic, number of tables, the tables (each prefixed by supercluster number) and CRC32 of all that.
+	std::vector<char> record(12 + dirty.size() * (4 + CLUSTER_SIZE));
+	serialization::u32b(&record[0], LOG_MAGIC);
+	serialization::u32b(&record[4], dirty.size());
+	size_t ptr = 8;
+	for(auto i : dirty) {
+		serialization::u32b(&record[ptr], i);
+		superclusters[i].save(&record[ptr + 4]);
+		ptr += 4 + CLUSTER_SIZE;
+	}
+	serialization::u32b(&record[ptr], crc32(0, reinterpret_cast<Bytef*>(&record[0]), ptr));
+	append_log(record);
+	ptr = 8;
+	for(auto i : dirty) {
+		write_raw(SUPERCLUSTER_SIZE * i, &record[ptr + 4], CLUSTER_SIZE);
+		ptr += 4 + CLUSTER_SIZE;
+	}
+	dirty.clear();
+	if(log_size >= LOG_CHECKPOINT_SIZE) {
+		sync_raw();
+		remove_log();
+	}
+}
+
+void filesystem::replay_log()
+{
+	std::ifstream l(logfile, std::ios_base::in | std::ios_base::binary);
+	if(!l)
+		return;
+	std::vector<char> log((std::istreambuf_iterator<char>(l)), std::istreambuf_iterator<char>());
+	l.close();
+	//Apply all complete records. Incomplete record at the end means crash while writing the log, and the tables
+	//in the backing file are then intact.
+	size_t ptr = 0;
+	while(ptr + 12 <= log.size()) {
+		if(serialization::u32b(&log[ptr]) != LOG_MAGIC)
+			break;
+		size_t count = serialization::u32b(&log[ptr + 4]);
+		size_t len = 8 + count * (4 + CLUSTER_SIZE);
+		if(count > log.size() || ptr + len + 4 > log.size())
+			break;
+		if(serialization::u32b(&log[ptr + len]) != crc32(0, reinterpret_cast<Bytef*>(&log[ptr]), len))
+			break;
+		for(size_t i = 0; i < count; i++) {
+			const char* t = &log[ptr + 8 + i * (4 + CLUSTER_SIZE)];
+			uint32_t index = serialization::u32b(t);
+			if(SUPERCLUSTER_SIZE * index + CLUSTER_SIZE > backing_size)
+				continue;	//Supercluster never got created.
+			write_raw(SUPERCLUSTER_SIZE * index, t + 4, CLUSTER_SIZE);
+		}
+		ptr += len + 4;
+	}
+	sync_raw();
+	remove_log();
 }
 
 
 uint32_t filesystem::allocate_cluster()
+{
+	uint32_t cluster;
+	try {
+		cluster = _allocate_cluster();
+	} catch(...) {
+		end_operation();
+		throw;
+	}
+	end_operation();
+	return cluster;
+}
+
+uint32_t filesystem::_allocate_cluster()
 {
 	for(unsigned i = 0; i < supercluster_count; i++) {
 		supercluster& c = superclusters[i];
@@ -52,21 +349,24 @@ uint32_t filesystem::allocate_cluster()
 			for(unsigned j = 0; j < CLUSTERS_PER_SUPER; j++)
 				if(!c.clusters[j]) {
 					c.clusters[j] = 1;
-					c.save(backing, i);
+					c.free_clusters--;
+					dirty.insert(i);
 					//Write zeroes over the cluster.
 					uint32_t cluster = i * CLUSTERS_PER_SUPER + j;
 					char buffer[CLUSTER_SIZE];
 					memset(buffer, 0, CLUSTER_SIZE);
-					backing.seekp(cluster * CLUSTER_SIZE, std::ios_base::beg);
-					backing.write(buffer, CLUSTER_SIZE);
-					if(!backing)
+					try {
+						write_raw(static_cast<uint64_t>(cluster) * CLUSTER_SIZE, buffer,
+							CLUSTER_SIZE);
+					} catch(...) {
 						throw std::runtime_error("Can't zero out the new cluster");
+					}
 					return cluster;
 				}
 	}
 	//Create a new supercluster.
 	supercluster& c = superclusters[supercluster_count];
-	c.free_clusters = 65535;
+	c.free_clusters = CLUSTERS_PER_SUPER - 2;			//Cluster table and the new cluster.
 	c.clusters[0] = 0xFFFFFFFFU;					//Reserved for cluster table.
 	for(unsigned i = 1; i < CLUSTERS_PER_SUPER; i++)
 		c.clusters[i] = 0;					//Free.
@@ -76,14 +376,15 @@ uint32_t filesystem::allocate_cluster()
 	if(!supercluster_count)
 		c.free_clusters--;					//The superblock.
 	c.clusters[j] = 1;						//End of chain.
-	c.save(backing, supercluster_count);
+	dirty.insert(supercluster_count);
 	char blankbuf[2 * CLUSTER_SIZE];
 	memset(blankbuf, 0, 2 * CLUSTER_SIZE);
-	backing.clear();
-	backing.seekp(supercluster_count * SUPERCLUSTER_SIZE + CLUSTER_SIZE, std::ios_base::beg);
-	backing.write(blankbuf, supercluster_count ? CLUSTER_SIZE : 2 * CLUSTER_SIZE);
-	if(!backing)
+	try {
+		write_raw(supercluster_count * SUPERCLUSTER_SIZE + CLUSTER_SIZE, blankbuf, supercluster_count ?
+			CLUSTER_SIZE : 2 * CLUSTER_SIZE);
+	} catch(...) {
 		throw std::runtime_error("Can't write new supercluster");
+	}
 	return (supercluster_count++) * CLUSTERS_PER_SUPER + j;
 }
 
@@ -96,10 +397,21 @@ void filesystem::link_cluster(uint32_t cluster, uint32_t linkto)
 	if(superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER] != 1)
 		throw std::runtime_error("Only end of chain clusters can be linked");
 	superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER] = linkto;
-	superclusters[cluster / CLUSTERS_PER_SUPER].save(backing, cluster / CLUSTERS_PER_SUPER);
+	dirty.insert(cluster / CLUSTERS_PER_SUPER);
 }
 
 void filesystem::free_cluster_chain(uint32_t cluster)
+{
+	try {
+		_free_cluster_chain(cluster);
+	} catch(...) {
+		end_operation();
+		throw;
+	}
+	end_operation();
+}
+
+void filesystem::_free_cluster_chain(uint32_t cluster)
 {
 	if(cluster == 2)
 		throw std::runtime_error("Cluster 2 can't be freed");
@@ -111,11 +423,10 @@ void filesystem::free_cluster_chain(uint32_t cluster)
 	if(oldnext == 0xFFFFFFFFU)
 		throw std::runtime_error("Attempted to free system cluster");
 	superclusters[cluster / CLUSTERS_PER_SUPER].clusters[cluster % CLUSTERS_PER_SUPER] = 0;
-	//If there is no next block, or the next block is in different supercluster, save the cluster table.
-	if(oldnext == 1 || oldnext / CLUSTERS_PER_SUPER != cluster / CLUSTERS_PER_SUPER)
-		superclusters[cluster / CLUSTERS_PER_SUPER].save(backing, cluster / CLUSTERS_PER_SUPER);
+	superclusters[cluster / CLUSTERS_PER_SUPER].free_clusters++;
+	dirty.insert(cluster / CLUSTERS_PER_SUPER);
 	if(oldnext != 1)
-		free_cluster_chain(oldnext);
+		_free_cluster_chain(oldnext);
 }
 
 size_t filesystem::skip_data(uint32_t& cluster, uint32_t& ptr, uint32_t length)
@@ -163,11 +474,7 @@ size_t filesystem::read_data(uint32_t& cluster, uint32_t& ptr, void* data, uint3
 		//Read to end of cluster.
 		size_t maxread = min(length, max(static_cast<uint32_t>(CLUSTER_SIZE), ptr) - ptr);
 		if(maxread) {
-			backing.clear();
-			backing.seekg(cluster * CLUSTER_SIZE + ptr, std::ios_base::beg);
-			backing.read(_data, maxread);
-			if(!backing)
-				throw std::runtime_error("Can't read data");
+			read_raw(static_cast<uint64_t>(cluster) * CLUSTER_SIZE + ptr, _data, maxread);
 			length -= maxread;
 			_data += maxread;
 			ptr += maxread;
@@ -193,6 +500,18 @@ size_t filesystem::read_data(uint32_t& cluster, uint32_t& ptr, void* data, uint3
 
 void filesystem::write_data(uint32_t& cluster, uint32_t& ptr, const void* data, uint32_t length,
 	uint32_t& real_cluster, uint32_t& real_ptr)
+{
+	try {
+		_write_data(cluster, ptr, data, length, real_cluster, real_ptr);
+	} catch(...) {
+		end_operation();
+		throw;
+	}
+	end_operation();
+}
+
+void filesystem::_write_data(uint32_t& cluster, uint32_t& ptr, const void* data, uint32_t length,
+	uint32_t& real_cluster, uint32_t& real_ptr)
 {
 	const char* _data = reinterpret_cast<const char*>(data);
 	size_t r = 0;
@@ -205,24 +524,13 @@ void filesystem::write_data(uint32_t& cluster, uint32_t& ptr, const void* data,
 		//Write to end of cluster.
 		size_t maxwrite = min(length, max(static_cast<uint32_t>(CLUSTER_SIZE), ptr) - ptr);
 		if(maxwrite) {
-			char buffer[CLUSTER_SIZE];
-			memset(buffer, 0, CLUSTER_SIZE);
 			if(!assigned) {
 				real_cluster = cluster;
 				real_ptr = ptr;
 				assigned = true;
 			}
-			backing.seekp(0, std::ios_base::end);
-			uint64_t backing_size = backing.tellp();
-			if(backing_size > cluster * CLUSTER_SIZE) {
-				backing.seekg(cluster * CLUSTER_SIZE, std::ios_base::beg);
-				backing.read(buffer, CLUSTER_SIZE);
-			}
-			memcpy(buffer + ptr, _data, maxwrite);
-			backing.seekp(cluster * CLUSTER_SIZE, std::ios_base::beg);
-			backing.write(buffer, CLUSTER_SIZE);
-			if(!backing)
-				throw std::runtime_error("Can't write data");
+			//Allocated clusters are zeroed, so only the written part needs to be written.
+			write_raw(static_cast<uint64_t>(cluster) * CLUSTER_SIZE + ptr, _data, maxwrite);
 			length -= maxwrite;
 			_data += maxwrite;
 			ptr += maxwrite;
@@ -243,7 +551,7 @@ void filesystem::write_data(uint32_t& cluster, uint32_t& ptr, const void* data,
 					ptr = CLUSTER_SIZE;
 					return;
 				}
-				n = allocate_cluster();
+				n = _allocate_cluster();
 				link_cluster(cluster, n);
 				cluster = n;
 				ptr = 0;
@@ -255,33 +563,24 @@ void filesystem::write_data(uint32_t& cluster, uint32_t& ptr, const void* data,
 	} while(length > 0);
 }
 
-void filesystem::supercluster::load(std::fstream& s, uint32_t index)
+void filesystem::supercluster::load(const char* buffer)
 {
-	uint64_t offset = SUPERCLUSTER_SIZE * index;
-	char buffer[CLUSTER_SIZE];
-	s.clear();
-	s.seekg(offset, std::ios_base::beg);
-	s.read(buffer, CLUSTER_SIZE);
-	if(!s)
-		throw std::runtime_error("Can't read cluster table");
 	free_clusters = 0;
 	for(unsigned i = 0; i < CLUSTERS_PER_SUPER; i++) {
 		if(!(clusters[i] = serialization::u32b(buffer + 4 * i)))
 			free_clusters++;
 	}
+	//Supercluster whose table never got written (crash). Don't give away the table cluster.
+	if(!clusters[0]) {
+		clusters[0] = 0xFFFFFFFFU;
+		free_clusters--;
+	}
 }
 
-void filesystem::supercluster::save(std::fstream& s, uint32_t index)
+void filesystem::supercluster::save(char* buffer)
 {
-	uint64_t offset = SUPERCLUSTER_SIZE * index;
-	char buffer[CLUSTER_SIZE];
 	for(unsigned i = 0; i < CLUSTERS_PER_SUPER; i++)
 		serialization::u32b(buffer + 4 * i, clusters[i]);
-	s.clear();
-	s.seekp(offset, std::ios_base::beg);
-	s.write(buffer, CLUSTER_SIZE);
-	if(!s)
-		throw std::runtime_error("Can't write cluster table");
 }
 
 filesystem::ref& filesystem::ref::operator=(const filesystem::ref& r)
@@ -0,0 +1,254 @@
+#include "forkpool.hpp"
+#include "serialization.hpp"
+#include "string.hpp"
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+
+namespace forkpool
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+namespace
+{
+	//Messages are 8-byte little-endian length, 1 status byte (replies only) and the data.
+	const char STATUS_OK = 0;
+	const char STATUS_ERROR = 1;
+#ifdef MSG_NOSIGNAL
+	const int send_flags = MSG_NOSIGNAL;
+#else
+	const int send_flags = 0;
+#endif
+
+	//Dead peers should show up as write errors, not kill the process with SIGPIPE.
+	void no_sigpipe(int fd)
+	{
+#ifdef SO_NOSIGPIPE
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	}
+
+	bool write_all(int fd, const char* buf, size_t size)
+	{
+		while(size) {
+			ssize_t r = send(fd, buf, size, send_flags);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				return false;
+			buf += r;
+			size -= r;
+		}
+		return true;
+	}
+
+	bool read_all(int fd, char* buf, size_t size)
+	{
+		while(size) {
+			ssize_t r = read(fd, buf, size);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				return false;
+			buf += r;
+			size -= r;
+		}
+		return true;
+	}
+
+	bool write_message(int fd, const std::vector<char>& data, const char* status)
+	{
+		char hdr[9];
+		serialization::u64l(hdr, data.size());
+		if(status) hdr[8] = *status;
+		if(!write_all(fd, hdr, status ? 9 : 8))
+			return false;
+		return data.empty() || write_all(fd, &data[0], data.size());
+	}
+
+	bool read_message(int fd, std::vector<char>& data, char* status)
+	{
+		char hdr[9];
+		if(!read_all(fd, hdr, status ? 9 : 8))
+			return false;
+		if(status) *status = hdr[8];
+		data.resize(serialization::u64l(hdr));
+		return data.empty() || read_all(fd, &data[0], data.size());
+	}
+
+	void worker_main(int in, int out, worker_fn& fn)
+	{
+		std::vector<char> job;
+		std::vector<char> reply;
+		while(read_message(in, job, NULL)) {
+			char status = STATUS_OK;
+			reply.clear();
+			try {
+				fn(job, reply);
+			} catch(std::exception& e) {
+				status = STATUS_ERROR;
+				std::string msg = e.what();
+				reply = std::vector<char>(msg.begin(), msg.end());
+			}
+			if(!write_message(out, reply, &status))
+				break;
+		}
+	}
+}
+
+pool::pool(unsigned workers, worker_fn fn, const std::vector<threads::lock*>& hold)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	//Only this thread exists in the workers, so locks held by other threads would stay locked forever. Hold
+	//the given locks over fork(), so that they are free in the workers.
+	for(auto i : hold)
+		i->lock();
+	std::string err;
+	for(unsigned i = 0; i < workers; i++) {
+		int s[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0) {
+			err = std::string("Can't create socket pair: ") + strerror(errno);
+			break;
+		}
+		no_sigpipe(s[0]);
+		no_sigpipe(s[1]);
+		int pid = fork();
+		if(pid < 0) {
+			err = std::string("Can't fork worker: ") + strerror(errno);
+			close(s[0]);
+			close(s[1]);
+			break;
+		}
+		if(pid == 0) {
+			//Worker. Only async-signal-safe calls until fn runs.
+			for(auto j = hold.rbegin(); j != hold.rend(); j++)
+				(*j)->unlock();
+			//Don't keep sockets to other workers open, or they would never see EOF.
+			for(auto& j : children)
+				close(j.fd);
+			close(s[0]);
+			worker_main(s[1], s[1], fn);
+			//Don't run any destructors or atexit handlers belonging to the parent.
+			_exit(0);
+		}
+		close(s[1]);
+		child c;
+		c.pid = pid;
+		c.fd = s[0];
+		children.push_back(c);
+	}
+	for(auto j = hold.rbegin(); j != hold.rend(); j++)
+		(*j)->unlock();
+	if(err != "") {
+		shutdown();
+		throw std::runtime_error(err);
+	}
+}
+
+pool::~pool() throw()
+{
+	shutdown();
+}
+
+void pool::shutdown() throw()
+{
+	for(auto& i : children)
+		::shutdown(i.fd, SHUT_WR);
+	for(auto& i : children) {
+		close(i.fd);
+		while(waitpid(i.pid, NULL, 0) < 0 && errno == EINTR);
+	}
+	children.clear();
+}
+
+void pool::run(const std::vector<std::vector<char>>& jobs, std::vector<std::vector<char>>& results)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	results.resize(jobs.size());
+	if(children.empty())
+		throw std::runtime_error("No workers");
+	//Job running on each worker (or -1 if idle).
+	std::vector<ssize_t> running(children.size(), -1);
+	size_t next = 0;
+	size_t done = 0;
+	std::string error;
+	while(done < jobs.size()) {
+		for(size_t i = 0; i < children.size() && next < jobs.size(); i++) {
+			if(running[i] >= 0 || error != "")
+				continue;
+			if(!write_message(children[i].fd, jobs[next], NULL))
+				throw std::runtime_error("Worker died");
+			running[i] = next++;
+		}
+		std::vector<struct pollfd> fds;
+		std::vector<size_t> fdidx;
+		for(size_t i = 0; i < children.size(); i++) {
+			if(running[i] < 0)
+				continue;
+			struct pollfd p;
+			p.fd = children[i].fd;
+			p.events = POLLIN;
+			p.revents = 0;
+			fds.push_back(p);
+			fdidx.push_back(i);
+		}
+		if(fds.empty())
+			break;	//Error, and nothing running anymore.
+		if(poll(&fds[0], fds.size(), -1) < 0) {
+			if(errno == EINTR)
+				continue;
+			throw std::runtime_error(std::string("Can't poll workers: ") + strerror(errno));
+		}
+		for(size_t j = 0; j < fds.size(); j++) {
+			if(!fds[j].revents)
+				continue;
+			size_t i = fdidx[j];
+			char status;
+			if(!read_message(children[i].fd, results[running[i]], &status))
+				throw std::runtime_error("Worker died");
+			if(status != STATUS_OK && error == "")
+				error = std::string(results[running[i]].begin(), results[running[i]].end());
+			running[i] = -1;
+			done++;
+		}
+	}
+	if(error != "")
+		throw std::runtime_error(error);
+}
+
+bool pool::supported() throw()
+{
+	return true;
+}
+#else
+pool::pool(unsigned workers, worker_fn fn, const std::vector<threads::lock*>& hold)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	throw std::runtime_error("Worker processes are not supported on this system");
+}
+
+pool::~pool() throw()
+{
+}
+
+void pool::shutdown() throw()
+{
+}
+
+void pool::run(const std::vector<std::vector<char>>& jobs, std::vector<std::vector<char>>& results)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	throw std::runtime_error("Worker processes are not supported on this system");
+}
+
+bool pool::supported() throw()
+{
+	return false;
+}
+#endif
+}
@@ -22,6 +22,50 @@ unsigned default_shift_b;
 
 namespace
 {
+	//Glyph rows pre-rasterized to one byte per pixel, in normal and double width.
+	struct glyph_strips
+	{
+		glyph_strips()
+		{
+			for(unsigned i = 0; i < 256; i++)
+				for(unsigned j = 0; j < 8; j++) {
+					uint8_t bit = (i >> (7 - j)) & 1;
+					single[i][j] = bit;
+					dbl[i][2 * j + 0] = bit;
+					dbl[i][2 * j + 1] = bit;
+				}
+		}
+		uint8_t single[256][8];
+		uint8_t dbl[256][16];
+	} strips;
+
+	//Rasterize glyph row to one byte per pixel. Returns the width.
+	size_t rasterize_glyph_row(uint8_t* out, const font::glyph& g, uint32_t row, bool hdbl)
+	{
+		uint32_t d = g.data[row >> (g.wide ? 1 : 2)];
+		if(g.wide) {
+			d >>= 16 - ((row & 1) << 4);
+			if(hdbl) {
+				memcpy(out, strips.dbl[(d >> 8) & 0xFF], 16);
+				memcpy(out + 16, strips.dbl[d & 0xFF], 16);
+				return 32;
+			} else {
+				memcpy(out, strips.single[(d >> 8) & 0xFF], 8);
+				memcpy(out + 8, strips.single[d & 0xFF], 8);
+				return 16;
+			}
+		} else {
+			d >>= 24 - ((row & 3) << 3);
+			if(hdbl) {
+				memcpy(out, strips.dbl[d & 0xFF], 16);
+				return 16;
+			} else {
+				memcpy(out, strips.single[d & 0xFF], 8);
+				return 8;
+			}
+		}
+	}
+
 	void recalculate_default_shifts()
 	{
 		uint32_t magic = 0x18000810;
@@ -647,6 +691,15 @@ font::font() throw(std::bad_alloc)
 	bad_glyph_data[3] = 0x55800180U;
 	bad_glyph.wide = false;
 	bad_glyph.data = bad_glyph_data;
+	update_fast_glyphs();
+}
+
+void font::update_fast_glyphs() throw()
+{
+	for(uint32_t i = 0; i < FONT_FAST_GLYPHS; i++) {
+		auto j = glyphs.find(i);
+		fast_glyphs[i] = (j != glyphs.end()) ? &j->second : &bad_glyph;
+	}
 }
 
 void font::load_hex_glyph(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error)
@@ -707,12 +760,16 @@ void font::load_hex(const char* data, size_t size) throw(std::bad_alloc, std::ru
 	glyphs[32].offset = memory.size() - 4;
 	for(auto& i : glyphs)
 		i.second.data = &memory[i.second.offset];
+	update_fast_glyphs();
 }
 
 const font::glyph& font::get_glyph(uint32_t glyph) throw()
 {
-	if(glyphs.count(glyph))
-		return glyphs[glyph];
+	if(glyph < FONT_FAST_GLYPHS)
+		return *fast_glyphs[glyph];
+	auto i = glyphs.find(glyph);
+	if(i != glyphs.end())
+		return i->second;
 	else
 		return bad_glyph;
 }
@@ -817,28 +874,20 @@ template<bool X> void font::render(struct fb<X>& scr, int32_t x, int32_t y, cons
 			for(size_t i = 0; i < ylength; i++) {
 				typename fb<X>::element_t* r = scr.rowptr(gy + ystart + i) +
 					(gx + xstart);
-				uint32_t _y = (i + ystart) >> (vdbl ? 1 : 0);
-				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
-				if(g.wide)
-					d >>= 16 - ((_y & 1) << 4);
-				else
-					d >>= 24 - ((_y & 3) << 3);
-				if(hdbl)
+				uint8_t strip[32];
+				rasterize_glyph_row(strip, g, (i + ystart) >> (vdbl ? 1 : 0), hdbl);
+				const uint8_t* s = strip + xstart;
+				if(bg)
 					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - ((j + xstart) >> 1);
-						if(((d >> b) & 1) != 0)
+						if(s[j])
 							fg.apply(r[j]);
 						else
 							bg.apply(r[j]);
 					}
 				else
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - (j + xstart);
-						if(((d >> b) & 1) != 0)
+					for(size_t j = 0; j < xlength; j++)
+						if(s[j])
 							fg.apply(r[j]);
-						else
-							bg.apply(r[j]);
-					}
 			}
 		else
 			for(size_t i = 0; i < ylength; i++) {
@@ -854,27 +903,11 @@ void font::render(uint8_t* buf, size_t stride, const std::string& str, uint32_t
 	for_each_glyph(str, alignx, hdbl, vdbl, [this, buf, stride]
 		(uint32_t lx, uint32_t ly, const glyph& g, bool hdbl, bool vdbl) {
 		uint8_t* ptr = buf + (ly * stride + lx);
-		size_t xlength = (g.wide ? 16 : 8) << (hdbl ? 1 : 0);
 		size_t height = 16 << (vdbl ? 1 : 0);
 
 		if(g.data)
 			for(size_t i = 0; i < height; i++) {
-				uint32_t _y = i >> (vdbl ? 1 : 0);
-				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
-				if(g.wide)
-					d >>= 16 - ((_y & 1) << 4);
-				else
-					d >>= 24 - ((_y & 3) << 3);
-				if(hdbl)
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - (j >> 1);
-						ptr[j] = ((d >> b) & 1);
-					}
-				else
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - j;
-						ptr[j] = ((d >> b) & 1);
-					}
+				rasterize_glyph_row(ptr, g, i >> (vdbl ? 1 : 0), hdbl);
 				ptr += stride;
 			}
 	});
@@ -0,0 +1,122 @@
+#include "hash128.hpp"
+#include "hex.hpp"
+#include "serialization.hpp"
+
+namespace
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+	inline uint64_t rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t fmix(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+}
+
+hash128::hash128(uint64_t seed) throw()
+{
+	h1 = h2 = seed;
+	total = 0;
+	buffer_fill = 0;
+	finished = false;
+}
+
+void hash128::block(const uint8_t* data) throw()
+{
+	uint64_t k1 = serialization::u64l(data);
+	uint64_t k2 = serialization::u64l(data + 8);
+	k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+	h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+	k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+	h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+}
+
+void hash128::write(const uint8_t* data, size_t datalen) throw()
+{
+	if(finished)
+		return;
+	total += datalen;
+	if(buffer_fill) {
+		size_t fill = 16 - buffer_fill;
+		if(fill > datalen) fill = datalen;
+		memcpy(buffer + buffer_fill, data, fill);
+		buffer_fill += fill;
+		data += fill;
+		datalen -= fill;
+		if(buffer_fill < 16)
+			return;
+		block(buffer);
+		buffer_fill = 0;
+	}
+	while(datalen >= 16) {
+		block(data);
+		data += 16;
+		datalen -= 16;
+	}
+	memcpy(buffer, data, datalen);
+	buffer_fill = datalen;
+}
+
+void hash128::read(uint8_t* hashout) throw()
+{
+	if(!finished) {
+		uint64_t k1 = 0;
+		uint64_t k2 = 0;
+		const uint8_t* tail = buffer;
+		switch(buffer_fill) {
+		case 15: k2 ^= (uint64_t)tail[14] << 48;
+		case 14: k2 ^= (uint64_t)tail[13] << 40;
+		case 13: k2 ^= (uint64_t)tail[12] << 32;
+		case 12: k2 ^= (uint64_t)tail[11] << 24;
+		case 11: k2 ^= (uint64_t)tail[10] << 16;
+		case 10: k2 ^= (uint64_t)tail[9] << 8;
+		case 9: k2 ^= (uint64_t)tail[8];
+			k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+		case 8: k1 ^= (uint64_t)tail[7] << 56;
+		case 7: k1 ^= (uint64_t)tail[6] << 48;
+		case 6: k1 ^= (uint64_t)tail[5] << 40;
+		case 5: k1 ^= (uint64_t)tail[4] << 32;
+		case 4: k1 ^= (uint64_t)tail[3] << 24;
+		case 3: k1 ^= (uint64_t)tail[2] << 16;
+		case 2: k1 ^= (uint64_t)tail[1] << 8;
+		case 1: k1 ^= (uint64_t)tail[0];
+			k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+		};
+		h1 ^= total;
+		h2 ^= total;
+		h1 += h2;
+		h2 += h1;
+		h1 = fmix(h1);
+		h2 = fmix(h2);
+		h1 += h2;
+		h2 += h1;
+		serialization::u64l(finalhash, h1);
+		serialization::u64l(finalhash + 8, h2);
+		finished = true;
+	}
+	memcpy(hashout, finalhash, 16);
+}
+
+std::string hash128::read() throw(std::bad_alloc)
+{
+	uint8_t h[16];
+	read(h);
+	return hex::b_to(h, 16);
+}
+
+void hash128::hash(uint8_t* hashout, const uint8_t* data, size_t datalen, uint64_t seed) throw()
+{
+	hash128 h(seed);
+	h.write(data, datalen);
+	h.read(hashout);
+}
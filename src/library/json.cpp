@@ -239,14 +239,16 @@ node::number_holder::number_holder(const std::string& expr, size_t& ptr, size_t
 	x = expr.substr(ptr, tmp - ptr);
 	ptr = tmp;
 	try {
-		if(regex_match("[0-9]+", x)) {
+		static regex_pattern unumber("[0-9]+", REGEX_FLAG_NOSUBS);
+		if(unumber.match(x)) {
 			n.n1 = parse_value<uint64_t>(x);
 			sub = 1;
 			return;
 		}
 	} catch(...) {}
 	try {
-		if(regex_match("[+-]?[0-9]+", x)) {
+		static regex_pattern snumber("[+-]?[0-9]+", REGEX_FLAG_NOSUBS);
+		if(snumber.match(x)) {
 			n.n2 = parse_value<int64_t>(x);
 			sub = 2;
 			return;
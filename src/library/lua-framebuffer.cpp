@@ -8,9 +8,9 @@ framebuffer::color get_fb_color(lua::state& L, int index, const std::string& fna
 	std::runtime_error)
 {
 	if(L.type(index) == LUA_TSTRING)
-		return framebuffer::color(L.get_string(index, fname.c_str()));
+		return framebuffer::color(L.get_string(index, fname));
 	else if(L.type(index) == LUA_TNUMBER)
-		return framebuffer::color(L.get_numeric_argument<int64_t>(index, fname.c_str()));
+		return framebuffer::color(L.get_numeric_argument<int64_t>(index, fname));
 	else
 		(stringfmt() << "Expected argument #" << index << " to " << fname
 			<< " be string or number").throwex();
@@ -21,9 +21,9 @@ framebuffer::color get_fb_color(lua::state& L, int index, const std::string& fna
 	throw(std::bad_alloc, std::runtime_error)
 {
 	if(L.type(index) == LUA_TSTRING)
-		return framebuffer::color(L.get_string(index, fname.c_str()));
+		return framebuffer::color(L.get_string(index, fname));
 	else if(L.type(index) == LUA_TNUMBER)
-		return framebuffer::color(L.get_numeric_argument<int64_t>(index, fname.c_str()));
+		return framebuffer::color(L.get_numeric_argument<int64_t>(index, fname));
 	else if(L.type(index) == LUA_TNIL || L.type(index) == LUA_TNONE)
 		return framebuffer::color(dflt);
 	else
@@ -3,8 +3,10 @@
 #include "lua-function.hpp"
 #include "lua-params.hpp"
 #include "lua-pin.hpp"
+#include "profiler.hpp"
 #include "stateobject.hpp"
 #include "threads.hpp"
+#include <algorithm>
 #include <functional>
 #include <iostream>
 #include <cassert>
@@ -110,9 +112,8 @@ namespace
 			for(auto i : m) {
 				if(!strcmp(i.name, method)) {
 					//Hit.
-					std::string fname = ptr->get_name() + "::" + i.name;
 					L.pushlightuserdata((void*)i.fn);
-					L.pushstring(fname.c_str());
+					L.pushlightuserdata((void*)&ptr->static_method_name(i.name));
 					L.push_trampoline(class_info::trampoline, 2);
 					return 1;
 				}
@@ -154,9 +155,8 @@ namespace
 			}
 		if(best_fn) {
 			L.pushlstring(lowbound);
-			std::string name = obj->get_name() + "::" + lowbound;
 			L.pushlightuserdata(best_fn);
-			L.pushlstring(name);
+			L.pushlightuserdata((void*)&obj->static_method_name(lowbound.c_str()));
 			L.push_trampoline(class_info::trampoline, 2);
 			return 2;
 		} else {
@@ -199,7 +199,7 @@ namespace
 	{
 		void* _fn = L.touserdata(L.trampoline_upval(1));
 		fn_t fn = (fn_t)_fn;
-		std::string name = L.tostring(L.trampoline_upval(2));
+		const std::string& name = *reinterpret_cast<const std::string*>(L.touserdata(L.trampoline_upval(2)));
 		parameters P(L, name);
 		return fn(L, P);
 	}
@@ -630,6 +630,8 @@ void state::do_unregister(const std::string& name, callback_list& callback)
 state::callback_list::callback_list(state& _L, const std::string& _name, const std::string& fncbname)
 	: L(_L), name(_name), fn_cbname(fncbname)
 {
+	dispatching = 0;
+	profile_name = profiler::intern("lua." + name);
 	L.do_register(name, *this);
 }
 
@@ -663,13 +665,31 @@ void state::callback_list::_unregister(state& _L)
 			_L.pushlightuserdata(key);
 			_L.pushnil();
 			_L.rawset(LUA_REGISTRYINDEX);
-			i = callbacks.erase(i);
+			if(dispatching) {
+				//Just skipped until the dispatch ends.
+				unregistered.push_back(key);
+				i++;
+			} else
+				i = callbacks.erase(i);
 		} else
 			i++;
 		_L.pop(1);
 	}
 }
 
+void state::callback_list::end_dispatch()
+{
+	if(--dispatching || unregistered.empty())
+		return;
+	for(auto i = callbacks.begin(); i != callbacks.end();) {
+		if(std::find(unregistered.begin(), unregistered.end(), &*i) != unregistered.end())
+			i = callbacks.erase(i);
+		else
+			i++;
+	}
+	unregistered.clear();
+}
+
 function_group::function_group()
 {
 }
@@ -920,6 +940,11 @@ std::set<std::string> class_base::all_classes(state& L)
 	return r;
 }
 
+const std::string& class_base::static_method_name(const char* method)
+{
+	return *smethod_names.insert(name + "::" + method).first;
+}
+
 void class_base::register_static(state& L)
 {
 again:
@@ -991,6 +1016,8 @@ functions::fn::fn(function_group& grp, const std::string& name, std::function<in
 	: function(grp, name)
 {
 	func = _func;
+	auto target = func.target<int(*)(state& L, parameters& P)>();
+	direct = target ? *target : NULL;
 }
 
 functions::fn::~fn() throw()
@@ -1000,6 +1027,9 @@ functions::fn::~fn() throw()
 int functions::fn::invoke(state& L)
 {
 	lua::parameters P(L, fname);
+	//Plain functions are called directly, skipping the std::function dispatch.
+	if(direct)
+		return direct(L, P);
 	return func(L, P);
 }
 }
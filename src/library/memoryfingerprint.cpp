@@ -0,0 +1,94 @@
+#include "memoryfingerprint.hpp"
+#include "memoryspace.hpp"
+#include "hash128.hpp"
+#include "hex.hpp"
+#include "minmax.hpp"
+#include "serialization.hpp"
+#include <cstring>
+
+namespace
+{
+	const size_t page_size = 4096;
+}
+
+memory_fingerprint::memory_fingerprint(bool _incremental)
+{
+	incremental = _incremental;
+	hashed = 0;
+}
+
+void memory_fingerprint::reset() throw()
+{
+	tracked.clear();
+}
+
+void memory_fingerprint::compute(memory_space& mspace, uint8_t* out) throw(std::bad_alloc)
+{
+	hash128 total;
+	size_t idx = 0;
+	hashed = 0;
+	for(auto r : mspace.get_regions()) {
+		if(r->readonly || r->special)
+			continue;
+		uint8_t tmp[8];
+		serialization::u64l(tmp, r->size);
+		total.write(r->name.c_str(), r->name.length() + 1);
+		total.write(tmp, 8);
+		size_t pages = (r->size + page_size - 1) / page_size;
+		tracked_region* t = NULL;
+		if(incremental) {
+			if(idx == tracked.size()) {
+				tracked.push_back(tracked_region());
+				tracked[idx].size = 0;
+				tracked[idx].primed = false;
+			}
+			t = &tracked[idx++];
+			if(t->name != r->name || t->size != r->size) {
+				//New or changed region, start tracking from scratch.
+				t->name = r->name;
+				t->size = r->size;
+				t->shadow.resize(r->size);
+				t->hashes.resize(16 * pages);
+				t->primed = false;
+			}
+		}
+		bool first = t && !t->primed;
+		for(size_t i = 0; i < pages; i++) {
+			uint64_t offset = i * page_size;
+			size_t len = min(static_cast<uint64_t>(page_size), r->size - offset);
+			const char* ptr;
+			if(r->direct_map)
+				ptr = reinterpret_cast<const char*>(r->direct_map + offset);
+			else {
+				buffer.resize(page_size);
+				r->read(offset, &buffer[0], len);
+				ptr = &buffer[0];
+			}
+			uint8_t h[16];
+			uint8_t* hptr = h;
+			if(t) {
+				hptr = &t->hashes[16 * i];
+				if(!first && !memcmp(&t->shadow[offset], ptr, len)) {
+					total.write(hptr, 16);
+					continue;
+				}
+				memcpy(&t->shadow[offset], ptr, len);
+			}
+			hash128::hash(hptr, reinterpret_cast<const uint8_t*>(ptr), len);
+			total.write(hptr, 16);
+			hashed += len;
+		}
+		if(t)
+			t->primed = true;
+	}
+	if(incremental)
+		tracked.resize(idx);
+	total.read(out);
+}
+
+std::string memory_fingerprint::compute(memory_space& mspace) throw(std::bad_alloc)
+{
+	uint8_t h[16];
+	compute(mspace, h);
+	return hex::b_to(h, 16);
+}
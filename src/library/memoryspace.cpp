@@ -216,6 +216,28 @@ void memory_space::read_range(uint64_t address, void* buffer, size_t bsize)
 	read_range_r(*g.first, g.second, buffer, bsize);
 }
 
+int memory_space::read_strided(uint64_t address, uint64_t stride, size_t count, size_t esize, void* buffer)
+{
+	char* _buffer = reinterpret_cast<char*>(buffer);
+	auto g = lookup(address);
+	if(!g.first) {
+		memset(buffer, 0, count * esize);
+		return 0;
+	}
+	if(stride == esize) {
+		read_range_r(*g.first, g.second, buffer, count * esize);
+		return g.first->endian;
+	}
+	uint64_t offset = g.second;
+	for(size_t i = 0; i < count; i++, offset += stride) {
+		if(offset >= g.first->size)
+			memset(_buffer + i * esize, 0, esize);
+		else
+			read_range_r(*g.first, offset, _buffer + i * esize, esize);
+	}
+	return g.first->endian;
+}
+
 bool memory_space::write_range(uint64_t address, const void* buffer, size_t bsize)
 {
 	auto g = lookup(address);
@@ -250,6 +272,15 @@ memory_space::region* memory_space::lookup_n(size_t n)
 	return u_regions[n];
 }
 
+memory_space::region* memory_space::lookup_name(const char* name)
+{
+	threads::alock m(mlock);
+	for(auto i : u_regions)
+		if(i->name == name)
+			return i;
+	return NULL;
+}
+
 
 std::list<memory_space::region*> memory_space::get_regions()
 {
@@ -0,0 +1,315 @@
+#include "profiler.hpp"
+#include "minmax.hpp"
+#include "threads.hpp"
+#include <chrono>
+#include <list>
+#include <set>
+#include <vector>
+#include <iomanip>
+
+namespace profiler
+{
+std::atomic<bool> _enabled(false);
+
+namespace
+{
+	//Default number of events kept per thread.
+	const size_t default_buffer_size = 65536;
+	const char* frame_marker = "frame";
+
+	struct event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+		uint64_t frame;
+	};
+
+	//Event slot. Written by owning thread while others may read it, so the fields are atomic.
+	struct event_slot
+	{
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> start;
+		std::atomic<uint64_t> end;
+		std::atomic<uint64_t> frame;
+	};
+
+	//Ring of events, written only by the owning thread without locking. Readers copy the events and then
+	//discard any that the writer may have overwritten meanwhile (seqlock style).
+	struct thread_buffer
+	{
+		thread_buffer() : events(NULL), size(0), begun(0), written(0), in_use(true) {}
+		~thread_buffer() { delete[] events; }
+		//The rest are only changed with state lock held.
+		event_slot* events;
+		size_t size;
+		//Number of events started and completed.
+		std::atomic<uint64_t> begun;
+		std::atomic<uint64_t> written;
+		std::atomic<bool> in_use;
+		unsigned tid;
+		std::string name;
+	};
+
+	struct profiler_state
+	{
+		profiler_state()
+		{
+			buffer_size = default_buffer_size;
+			epoch = now();
+			next_tid = 1;
+		}
+		threads::lock lock;
+		std::list<thread_buffer*> buffers;
+		std::set<std::string> interned;
+		size_t buffer_size;
+		uint64_t epoch;
+		unsigned next_tid;
+	};
+
+	std::atomic<uint64_t> current_frame(0);
+	//Buffer size threads should switch to.
+	std::atomic<size_t> wanted_size(default_buffer_size);
+
+	profiler_state& state()
+	{
+		static profiler_state s;
+		return s;
+	}
+
+	//Call with state lock held.
+	void reset_buffer(thread_buffer& b, size_t size)
+	{
+		if(b.size != size) {
+			event_slot* n = new event_slot[size];
+			delete[] b.events;
+			b.events = n;
+			b.size = size;
+		}
+		b.begun.store(0, std::memory_order_relaxed);
+		b.written.store(0, std::memory_order_relaxed);
+	}
+
+	//Hands the buffer back when the thread exits, so the next new thread reuses it.
+	struct buffer_owner
+	{
+		buffer_owner() : buffer(NULL) {}
+		~buffer_owner()
+		{
+			if(!buffer)
+				return;
+			threads::alock h(state().lock);
+			buffer->in_use.store(false, std::memory_order_relaxed);
+		}
+		thread_buffer* buffer;
+	};
+	thread_local buffer_owner tbuf;
+
+	thread_buffer& get_buffer()
+	{
+		if(tbuf.buffer)
+			return *tbuf.buffer;
+		auto& s = state();
+		threads::alock h(s.lock);
+		thread_buffer* b = NULL;
+		for(auto i : s.buffers)
+			if(!i->in_use.load(std::memory_order_relaxed)) {
+				b = i;
+				break;
+			}
+		if(!b) {
+			b = new thread_buffer;
+			s.buffers.push_back(b);
+		}
+		reset_buffer(*b, wanted_size.load(std::memory_order_relaxed));
+		b->in_use.store(true, std::memory_order_relaxed);
+		b->tid = s.next_tid++;
+		b->name = "";
+		return *(tbuf.buffer = b);
+	}
+
+	void push(const event& e)
+	{
+		thread_buffer& b = get_buffer();
+		if(b.size != wanted_size.load(std::memory_order_relaxed)) {
+			//Buffer size changed by clear(), readers might be looking at the old buffer.
+			threads::alock h(state().lock);
+			reset_buffer(b, wanted_size.load(std::memory_order_relaxed));
+		}
+		if(!b.size)
+			return;
+		uint64_t n = b.written.load(std::memory_order_relaxed);
+		b.begun.store(n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		event_slot& slot = b.events[n % b.size];
+		slot.name.store(e.name, std::memory_order_relaxed);
+		slot.start.store(e.start, std::memory_order_relaxed);
+		slot.end.store(e.end, std::memory_order_relaxed);
+		slot.frame.store(e.frame, std::memory_order_relaxed);
+		b.written.store(n + 1, std::memory_order_release);
+	}
+
+	//Call fn on each recorded event, oldest first for each thread.
+	template<typename T> void for_each_event(T fn)
+	{
+		auto& s = state();
+		threads::alock h(s.lock);
+		std::vector<event> copy;
+		for(auto b : s.buffers) {
+			if(!b->size)
+				continue;
+			uint64_t last = b->written.load(std::memory_order_acquire);
+			uint64_t first = (last > b->size) ? last - b->size : 0;
+			copy.resize(last - first);
+			for(uint64_t i = first; i < last; i++) {
+				const event_slot& slot = b->events[i % b->size];
+				event& e = copy[i - first];
+				e.name = slot.name.load(std::memory_order_relaxed);
+				e.start = slot.start.load(std::memory_order_relaxed);
+				e.end = slot.end.load(std::memory_order_relaxed);
+				e.frame = slot.frame.load(std::memory_order_relaxed);
+			}
+			//Events the writer has started overwriting since are garbage.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t begun = b->begun.load(std::memory_order_relaxed);
+			uint64_t valid = (begun > b->size) ? begun - b->size : 0;
+			for(uint64_t i = max(first, valid); i < last; i++) {
+				const event& e = copy[i - first];
+				//Spans that started before clear() are stale.
+				if(e.start >= s.epoch)
+					fn(*b, e, s.epoch);
+			}
+		}
+	}
+
+	void json_string(std::ostream& out, const std::string& str)
+	{
+		out << "\"";
+		for(auto c : str) {
+			if(c == '"' || c == '\\')
+				out << "\\" << c;
+			else if((unsigned char)c < 32)
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+			else
+				out << c;
+		}
+		out << "\"";
+	}
+
+	void json_usec(std::ostream& out, uint64_t nsec)
+	{
+		out << nsec / 1000 << "." << std::setw(3) << std::setfill('0') << nsec % 1000;
+	}
+}
+
+void set_enabled(bool enable)
+{
+	state();
+	_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void set_buffer_size(size_t events)
+{
+	auto& s = state();
+	threads::alock h(s.lock);
+	s.buffer_size = events;
+}
+
+void clear()
+{
+	auto& s = state();
+	threads::alock h(s.lock);
+	//The events are left in place and filtered by time. Threads pick up new size on their next span.
+	wanted_size.store(s.buffer_size, std::memory_order_relaxed);
+	s.epoch = now();
+}
+
+uint64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const char* name, uint64_t start, uint64_t end)
+{
+	event e;
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	e.frame = current_frame.load(std::memory_order_relaxed);
+	push(e);
+}
+
+void mark_frame(uint64_t frame)
+{
+	current_frame.store(frame, std::memory_order_relaxed);
+	if(!enabled())
+		return;
+	uint64_t t = now();
+	record(frame_marker, t, t);
+}
+
+const char* intern(const std::string& name)
+{
+	auto& s = state();
+	threads::alock h(s.lock);
+	return s.interned.insert(name).first->c_str();
+}
+
+void set_thread_name(const std::string& name)
+{
+	thread_buffer& b = get_buffer();
+	threads::alock h(state().lock);
+	b.name = name;
+}
+
+std::map<std::string, stats> summary(uint64_t* frames)
+{
+	std::map<std::string, stats> ret;
+	uint64_t frames_seen = 0;
+	for_each_event([&ret, &frames_seen](thread_buffer& b, const event& e, uint64_t epoch) {
+		if(e.name == frame_marker) {
+			frames_seen++;
+			return;
+		}
+		stats& st = ret[e.name];
+		uint64_t d = e.end - e.start;
+		st.count++;
+		st.total += d;
+		if(d > st.max) st.max = d;
+	});
+	if(frames) *frames = frames_seen;
+	return ret;
+}
+
+void write_chrome_trace(std::ostream& out)
+{
+	bool first = true;
+	std::set<thread_buffer*> named;
+	out << "{\"traceEvents\":[";
+	for_each_event([&out, &first, &named](thread_buffer& b, const event& e, uint64_t epoch) {
+		if(!first) out << ",";
+		first = false;
+		out << "\n";
+		if(!named.count(&b) && b.name != "") {
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.tid
+				<< ",\"args\":{\"name\":";
+			json_string(out, b.name);
+			out << "}},\n";
+			named.insert(&b);
+		}
+		out << "{\"name\":";
+		json_string(out, e.name);
+		if(e.name == frame_marker)
+			out << ",\"ph\":\"i\",\"s\":\"g\"";
+		else {
+			out << ",\"ph\":\"X\",\"dur\":";
+			json_usec(out, e.end - e.start);
+		}
+		out << ",\"ts\":";
+		json_usec(out, e.start - epoch);
+		out << ",\"pid\":1,\"tid\":" << b.tid << ",\"args\":{\"frame\":" << e.frame << "}}";
+	});
+	out << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+}
+}
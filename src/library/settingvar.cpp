@@ -6,6 +6,13 @@ namespace settingvar
 namespace
 {
 	threads::rlock* global_lock;
+	std::atomic<uint64_t> generation(0);
+
+	//Called with settings lock held.
+	void bump_generation()
+	{
+		generation.fetch_add(1, std::memory_order_release);
+	}
 
 	struct set_internal
 	{
@@ -30,6 +37,27 @@ threads::rlock& get_setting_lock()
 	return *global_lock;
 }
 
+uint64_t get_generation()
+{
+	return generation.load(std::memory_order_acquire);
+}
+
+handle_cache::handle_cache()
+	: seq(0), cgroup(NULL), cbase(NULL), cgen(0)
+{
+}
+
+void handle_cache::update(group& grp, base* b, uint64_t gen)
+{
+	unsigned s = seq.load(std::memory_order_relaxed);
+	seq.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	cgroup.store(&grp, std::memory_order_relaxed);
+	cbase.store(b, std::memory_order_relaxed);
+	cgen.store(gen, std::memory_order_relaxed);
+	seq.store(s + 2, std::memory_order_release);
+}
+
 listener::~listener() throw()
 {
 }
@@ -46,6 +74,7 @@ group::group() throw(std::bad_alloc)
 group::~group() throw()
 {
 	threads::arlock h(get_setting_lock());
+	bump_generation();
 	auto state = group_internal_t::get_soft(this);
 	if(!state) return;
 	for(auto i : state->settings)
@@ -113,6 +142,7 @@ void group::do_register(const std::string& name, base& _setting) throw(std::bad_
 	auto& state = group_internal_t::get(this);
 	if(state.settings.count(name)) return;
 	state.settings[name] = &_setting;
+	bump_generation();
 }
 
 void group::do_unregister(const std::string& name, base& _setting) throw(std::bad_alloc)
@@ -121,6 +151,7 @@ void group::do_unregister(const std::string& name, base& _setting) throw(std::ba
 	auto state = group_internal_t::get_soft(this);
 	if(!state || !state->settings.count(name) || state->settings[name] != &_setting) return;
 	state->settings.erase(name);
+	bump_generation();
 }
 
 void group::add_set(set& s) throw(std::bad_alloc)
@@ -167,6 +198,7 @@ void group::xlistener::destroy(set& s, const std::string& name)
 	auto state = group_internal_t::get_soft(&grp);
 	if(state)
 		state->settings.erase(name);
+	bump_generation();
 }
 
 void group::xlistener::kill(set& s)
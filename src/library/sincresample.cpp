@@ -0,0 +1,126 @@
+#include "sincresample.hpp"
+#include <cmath>
+
+namespace sincresample
+{
+namespace
+{
+	struct preset
+	{
+		unsigned taps;
+		unsigned phases;
+		//Fraction of the lower Nyquist frequency to pass.
+		double rolloff;
+	};
+
+	const preset presets[] = {
+		{8, 64, 0.85},		//QUALITY_FAST.
+		{16, 128, 0.92},	//QUALITY_NORMAL.
+		{32, 256, 0.96},	//QUALITY_BEST.
+	};
+
+	double kernel(double t, double half, double cutoff)
+	{
+		if(fabs(t) >= half)
+			return 0;
+		double w = 0.42 + 0.5 * cos(M_PI * t / half) + 0.08 * cos(2 * M_PI * t / half);
+		double x = M_PI * cutoff * t;
+		double s = (fabs(x) < 1e-9) ? 1 : sin(x) / x;
+		return cutoff * s * w;
+	}
+}
+
+resampler::resampler(quality q)
+{
+	set_quality(q);
+}
+
+void resampler::set_quality(quality q)
+{
+	const preset& p = presets[q];
+	taps = p.taps;
+	phases = p.phases;
+	rolloff = p.rolloff;
+	coeffs.resize(phases * 2 * taps);
+	deltas.resize(phases * 2 * taps);
+	hist.resize(4 * taps);
+	table_cutoff = 0;
+	build_table(p.rolloff);
+	reset();
+}
+
+void resampler::reset()
+{
+	for(auto& i : hist)
+		i = 0;
+	hpos = 0;
+	position = 0;
+}
+
+void resampler::build_table(double cutoff)
+{
+	//Interpolating at phase p is done between taps taps/2-1 and taps/2. Phases are normalized to unity gain, and
+	//the phase after the last is needed for the differences.
+	double half = taps / 2;
+	std::vector<double> prev(taps);
+	std::vector<double> cur(taps);
+	for(unsigned p = 0; p <= phases; p++) {
+		double phase = (double)p / phases;
+		double sum = 0;
+		for(unsigned k = 0; k < taps; k++)
+			sum += (cur[k] = kernel(k - (half - 1) - phase, half, cutoff));
+		for(unsigned k = 0; k < taps; k++)
+			cur[k] /= sum;
+		if(p > 0)
+			for(unsigned k = 0; k < taps; k++) {
+				size_t base = 2 * ((p - 1) * taps + k);
+				coeffs[base + 0] = coeffs[base + 1] = prev[k];
+				deltas[base + 0] = deltas[base + 1] = cur[k] - prev[k];
+			}
+		std::swap(prev, cur);
+	}
+	table_cutoff = cutoff;
+}
+
+void resampler::resample(const float*& in, size_t& insize, float*& out, size_t& outsize, double ratio, bool stereo)
+{
+	double iratio = 1 / ratio;
+	//When decimating, the cutoff has to be lowered to avoid aliasing. Don't rebuild the table on small changes.
+	double cutoff = rolloff * ((ratio < 1) ? ratio : 1);
+	if(fabs(cutoff - table_cutoff) > table_cutoff / 64)
+		build_table(cutoff);
+	unsigned n = 2 * taps;
+	while(outsize) {
+		double newpos = position + iratio;
+		while(newpos >= 1) {
+			//Gotta load a new sample.
+			if(!insize) {
+				//Resume loading from here on next call.
+				position = newpos - iratio;
+				return;
+			}
+			push(in[0], in[stereo ? 1 : 0]);
+			--insize;
+			in += (stereo ? 2 : 1);
+			newpos = newpos - 1;
+		}
+		position = newpos;
+		double p = position * phases;
+		unsigned idx = p;
+		if(idx >= phases) idx = phases - 1;
+		float f = p - idx;
+		const float* c = &coeffs[idx * n];
+		const float* d = &deltas[idx * n];
+		const float* h = &hist[2 * hpos];
+		//Two stereo frames at a time, so the loop maps to 4-wide vector operations.
+		float acc[4] = {0, 0, 0, 0};
+		for(unsigned i = 0; i < n; i += 4)
+			for(unsigned j = 0; j < 4; j++)
+				acc[j] += h[i + j] * (c[i + j] + f * d[i + j]);
+		*(out++) = acc[0] + acc[2];
+		if(stereo)
+			*(out++) = acc[1] + acc[3];
+		--outsize;
+	}
+}
+}
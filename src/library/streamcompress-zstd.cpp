@@ -0,0 +1,122 @@
+#include "streamcompress.hpp"
+#include "string.hpp"
+#include <stdexcept>
+#ifdef LIBZSTD_AVAILABLE
+#include <fstream>
+#include <zstd.h>
+#include <zdict.h>
+
+namespace
+{
+	std::vector<char> read_dictionary(const std::string& filename)
+	{
+		std::ifstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("Can't open zstd dictionary '" + filename + "'");
+		std::vector<char> d;
+		char buf[4096];
+		while(f) {
+			f.read(buf, sizeof(buf));
+			d.insert(d.end(), buf, buf + f.gcount());
+		}
+		if(d.empty())
+			throw std::runtime_error("zstd dictionary '" + filename + "' is empty");
+		return d;
+	}
+
+	void check_zstd(size_t r)
+	{
+		if(ZSTD_isError(r))
+			throw std::runtime_error(std::string("zstd error: ") + ZSTD_getErrorName(r));
+	}
+
+	struct zstd : public streamcompress::base
+	{
+		zstd(int level, const std::vector<char>& dict)
+		{
+			cctx = ZSTD_createCCtx();
+			if(!cctx) throw std::bad_alloc();
+			try {
+				check_zstd(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level));
+				check_zstd(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1));
+				if(!dict.empty())
+					check_zstd(ZSTD_CCtx_loadDictionary(cctx, &dict[0], dict.size()));
+			} catch(...) {
+				ZSTD_freeCCtx(cctx);
+				throw;
+			}
+		}
+		~zstd()
+		{
+			ZSTD_freeCCtx(cctx);
+		}
+		bool process(uint8_t*& in, size_t& insize, uint8_t*& out, size_t& outsize, bool final)
+		{
+			ZSTD_inBuffer ib = {in, insize, 0};
+			ZSTD_outBuffer ob = {out, outsize, 0};
+			size_t r = ZSTD_compressStream2(cctx, &ob, &ib, final ? ZSTD_e_end : ZSTD_e_continue);
+			check_zstd(r);
+			in += ib.pos;
+			insize -= ib.pos;
+			out += ob.pos;
+			outsize -= ob.pos;
+			//When finishing, 0 means the frame has been completely flushed.
+			return final && !insize && !r;
+		}
+	private:
+		ZSTD_CCtx* cctx;
+	};
+
+	struct foo {
+		foo() {
+			streamcompress::base::do_register("zstd", [](const std::string& v) -> streamcompress::base* {
+				auto a = streamcompress::parse_attributes(v);
+				int level = 3;
+				std::vector<char> dict;
+				if(a.count("level")) level = parse_value<int>(a["level"]);
+				if(level > ZSTD_maxCLevel()) level = ZSTD_maxCLevel();
+				if(level < ZSTD_minCLevel()) level = ZSTD_minCLevel();
+				if(a.count("dict")) dict = read_dictionary(a["dict"]);
+				return new zstd(level, dict);
+			});
+		}
+		~foo() {
+			streamcompress::base::do_unregister("zstd");
+		}
+	} _foo;
+}
+
+namespace streamcompress
+{
+std::vector<char> zstd_train_dictionary(const std::vector<std::vector<char>>& samples, size_t maxsize)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	std::vector<char> buffer;
+	std::vector<size_t> sizes;
+	for(auto& i : samples) {
+		if(i.empty())
+			continue;
+		buffer.insert(buffer.end(), i.begin(), i.end());
+		sizes.push_back(i.size());
+	}
+	if(sizes.empty())
+		throw std::runtime_error("No samples to train zstd dictionary from");
+	std::vector<char> dict;
+	dict.resize(maxsize);
+	size_t r = ZDICT_trainFromBuffer(&dict[0], dict.size(), &buffer[0], &sizes[0], sizes.size());
+	if(ZDICT_isError(r))
+		throw std::runtime_error(std::string("Can't train zstd dictionary: ") + ZDICT_getErrorName(r));
+	dict.resize(r);
+	return dict;
+}
+}
+#else
+namespace streamcompress
+{
+std::vector<char> zstd_train_dictionary(const std::vector<std::vector<char>>& samples, size_t maxsize)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	throw std::runtime_error("zstd support not compiled in");
+}
+}
+#endif
@@ -3,7 +3,7 @@
 #include "threads.hpp"
 #include "eatarg.hpp"
 #include <cctype>
-#include "map-pointer.hpp"
+#include <map>
 
 #ifdef USE_BOOST_REGEX
 #include <boost/regex.hpp>
@@ -62,8 +62,8 @@ regex_results::regex_results()
 regex_results::regex_results(std::vector<std::string> res, std::vector<std::pair<size_t, size_t>> mch)
 {
 	matched = true;
-	matches = mch;
-	results = res;
+	matches = std::move(mch);
+	results = std::move(res);
 }
 
 regex_results::operator bool() const
@@ -91,62 +91,131 @@ std::pair<size_t, size_t> regex_results::match(size_t i) const
 	return matches[i];
 }
 
-regex_results regex(const std::string& regexp, const std::string& str, const char* ex) throw(std::bad_alloc,
-	std::runtime_error)
+//Maximum number of compiled regexps to keep cached.
+#define REGEX_CACHE_SIZE 256
+
+struct regex_pattern::compiled
+{
+	compiled(const std::string& pattern, unsigned flags)
+		: re(pattern, translate(flags))
+	{
+	}
+	regex_ns::regex re;
+private:
+	static regex_ns::regex::flag_type translate(unsigned flags)
+	{
+		auto f = regex_ns::regex::extended & ~regex_ns::regex::collate;
+		if(flags & REGEX_FLAG_ICASE) f |= regex_ns::regex::icase;
+		if(flags & REGEX_FLAG_NOSUBS) f |= regex_ns::regex::nosubs;
+		return f;
+	}
+};
+
+namespace
 {
-	static threads::lock m;
-	threads::alock h(m);
-	static std::map<std::string, map_pointer<regex_ns::regex>> regexps;
-	if(!regexps.count(regexp)) {
-		regex_ns::regex* y = NULL;
-		try {
-			y = new regex_ns::regex(regexp, regex_ns::regex::extended & ~regex_ns::regex::collate);
-			regexps[regexp] = y;
-		} catch(std::bad_alloc& e) {
-			delete y;
-			throw;
-		} catch(std::exception& e) {
-			throw std::runtime_error(e.what());
+	typedef std::pair<std::string, unsigned> regex_key;
+
+	//LRU cache of compiled regexps. Evicting an entry does not invalidate regex_pattern objects using it.
+	struct regex_cache
+	{
+		std::shared_ptr<const regex_pattern::compiled> get(const std::string& pattern, unsigned flags)
+		{
+			regex_key key(pattern, flags);
+			{
+				threads::alock h(lock);
+				auto i = entries.find(key);
+				if(i != entries.end()) {
+					lru.splice(lru.begin(), lru, i->second.second);
+					return i->second.first;
+				}
+			}
+			//Compile without holding the lock, so other threads are not stalled. If two threads race to compile
+			//the same pattern, the loser just drops its copy.
+			std::shared_ptr<const regex_pattern::compiled> c;
+			try {
+				c.reset(new regex_pattern::compiled(pattern, flags));
+			} catch(std::bad_alloc& e) {
+				throw;
+			} catch(std::exception& e) {
+				throw std::runtime_error(e.what());
+			}
+			threads::alock h(lock);
+			auto i = entries.find(key);
+			if(i != entries.end()) {
+				lru.splice(lru.begin(), lru, i->second.second);
+				return i->second.first;
+			}
+			lru.push_front(key);
+			try {
+				entries[key] = std::make_pair(c, lru.begin());
+			} catch(...) {
+				lru.pop_front();
+				throw;
+			}
+			while(entries.size() > REGEX_CACHE_SIZE) {
+				entries.erase(lru.back());
+				lru.pop_back();
+			}
+			return c;
 		}
+		threads::lock lock;
+		std::list<regex_key> lru;
+		std::map<regex_key, std::pair<std::shared_ptr<const regex_pattern::compiled>,
+			std::list<regex_key>::iterator>> entries;
+	};
+
+	regex_cache& get_regex_cache()
+	{
+		static regex_cache cache;
+		return cache;
 	}
+}
 
+regex_pattern::regex_pattern(const std::string& _pattern, unsigned flags) throw(std::bad_alloc, std::runtime_error)
+	: pattern(_pattern)
+{
+	re = get_regex_cache().get(pattern, flags);
+}
+
+regex_results regex_pattern::operator()(const std::string& str, const char* ex) const throw(std::bad_alloc,
+	std::runtime_error)
+{
 	regex_ns::smatch matches;
-	bool x = regex_ns::regex_match(str.begin(), str.end(), matches, *(regexps[regexp]));
+	bool x = regex_ns::regex_match(str.begin(), str.end(), matches, re->re);
 	if(x) {
 		std::vector<std::string> res;
 		std::vector<std::pair<size_t, size_t>> mch;
+		res.reserve(matches.size());
+		mch.reserve(matches.size());
 		for(size_t i = 0; i < matches.size(); i++) {
 			res.push_back(matches.str(i));
 			mch.push_back(std::make_pair(matches[i].first - str.begin(),
 				matches[i].second - matches[i].first));
 		}
-		return regex_results(res, mch);
+		return regex_results(std::move(res), std::move(mch));
 	} else if(ex)
 		throw std::runtime_error(ex);
 	else
 		return regex_results();
 }
 
+bool regex_pattern::match(const std::string& str) const throw(std::bad_alloc)
+{
+	return regex_ns::regex_match(str.begin(), str.end(), re->re);
+}
+
+regex_results regex(const std::string& regexp, const std::string& str, const char* ex) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	return regex_pattern(regexp)(str, ex);
+}
+
 bool regex_match(const std::string& regexp, const std::string& str, enum regex_match_mode mode)
 	throw(std::bad_alloc, std::runtime_error)
 {
-	static threads::lock m;
-	static std::map<std::string, map_pointer<regex_ns::regex>> regexps;
-	static std::map<std::pair<regex_match_mode, std::string> , std::pair<std::string, bool>> transform_cache;
 	std::string _regexp;
 	bool icase = false;
 	std::ostringstream y;
-	{
-		//See if we have cached transform.
-		threads::alock h(m);
-		auto key = std::make_pair(mode, regexp);
-		if(transform_cache.count(key)) {
-			auto entry = transform_cache[key];
-			_regexp = entry.first;
-			icase = entry.second;
-			goto transformed;
-		}
-	}
 	switch(mode) {
 	case REGEX_MATCH_REGEX:
 		icase = false;
@@ -177,28 +246,7 @@ bool regex_match(const std::string& regexp, const std::string& str, enum regex_m
 		_regexp = ".*" + regexp + ".*";
 		break;
 	}
-transformed:
-	threads::alock h(m);
-	auto key = std::make_pair(mode, regexp);
-	if(!transform_cache.count(key))
-		transform_cache[key] = std::make_pair(_regexp, icase);
-
-	if(!regexps.count(regexp)) {
-		regex_ns::regex* y = NULL;
-		auto flags = regex_ns::regex::extended & ~regex_ns::regex::collate;
-		flags |= regex_ns::regex::nosubs;
-		if(icase) flags |= regex_ns::regex::icase;
-		try {
-			y = new regex_ns::regex(_regexp, flags);
-			regexps[_regexp] = y;
-		} catch(std::bad_alloc& e) {
-			delete y;
-			throw;
-		} catch(std::exception& e) {
-			throw std::runtime_error(e.what());
-		}
-	}
-	return regex_ns::regex_match(str.begin(), str.end(), *(regexps[_regexp]));
+	return regex_pattern(_regexp, REGEX_FLAG_NOSUBS | (icase ? REGEX_FLAG_ICASE : 0)).match(str);
 }
 
 namespace
@@ -0,0 +1,73 @@
+#include "workpool.hpp"
+
+int workpool::reflector::operator()(workpool* x)
+{
+	x->worker();
+	return 0;
+}
+
+workpool::workpool(unsigned threads)
+{
+	quitting = false;
+	if(!threads)
+		threads = hardware_threads();
+	for(unsigned i = 0; i < threads; i++)
+		workers.push_back(new threads::thread(_reflector, this));
+}
+
+workpool::~workpool()
+{
+	{
+		threads::alock h(mlock);
+		quitting = true;
+		condition.notify_all();
+	}
+	for(auto i : workers) {
+		i->join();
+		delete i;
+	}
+}
+
+void workpool::submit(std::function<void()> job)
+{
+	threads::alock h(mlock);
+	queue.push_back(job);
+	condition.notify_one();
+}
+
+void workpool::worker()
+{
+	while(true) {
+		std::function<void()> job;
+		{
+			threads::alock h(mlock);
+			//Quit only after the queue has been drained.
+			while(queue.empty() && !quitting)
+				condition.wait(h);
+			if(queue.empty())
+				return;
+			job = queue.front();
+			queue.pop_front();
+		}
+		try {
+			job();
+		} catch(...) {
+		}
+	}
+}
+
+unsigned workpool::hardware_threads()
+{
+#ifdef NATIVE_THREADS
+	unsigned n = std::thread::hardware_concurrency();
+#else
+	unsigned n = boost::thread::hardware_concurrency();
+#endif
+	return n ? n : 1;
+}
+
+workpool& workpool::shared()
+{
+	static workpool pool;
+	return pool;
+}
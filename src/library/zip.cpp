@@ -1,6 +1,7 @@
 #include "zip.hpp"
 #include "directory.hpp"
 #include "serialization.hpp"
+#include "workpool.hpp"
 
 #include <cstdint>
 #include <cstring>
@@ -15,6 +16,18 @@
 #include <boost/iostreams/filter/bzip2.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef LIBZSTD_AVAILABLE
+#include <zstd.h>
+#endif
+#if defined(_WIN32) || defined(_WIN64) || defined(TEST_WIN32_CODE)
+#define NO_ZIP_MMAP
+#else
+#include <sys/mman.h>
+#endif
 
 namespace zip
 {
@@ -203,20 +216,13 @@ namespace
 		uint32_t next_offset;
 	};
 
-	//Parse member starting from current offset.
-	zipfile_member_info parse_member(std::ifstream& file)
+	//Parse the fixed part of member header. Returns filename and extra field lengths.
+	std::pair<uint16_t, uint16_t> parse_member_header(zipfile_member_info& info, const unsigned char* buffer)
 	{
-		zipfile_member_info info;
-		info.central_directory_special = false;
-		info.header_offset = file.tellg();
-		//The file header is 30 bytes (this could also hit central header, but that's even larger).
-		unsigned char buffer[30];
-		if(!(file.read(reinterpret_cast<char*>(buffer), 30)))
-			throw std::runtime_error("Can't read file header from ZIP file");
 		uint32_t magic = serialization::u32l(buffer);
 		if(magic == 0x02014b50) {
 			info.central_directory_special = true;
-			return info;
+			return std::make_pair(0, 0);
 		}
 		if(magic != 0x04034b50)
 			throw std::runtime_error("ZIP archive corrupt: Expected file or central directory magic");
@@ -232,7 +238,8 @@ namespace
 		uint16_t extra_len = serialization::u16l(buffer + 28);
 		if(!filename_len)
 			throw std::runtime_error("Unsupported ZIP feature: Empty filename not allowed");
-		if(info.version_needed > 20 && info.version_needed != 46) {
+		if(info.version_needed > 20 && info.version_needed != 46 && !(info.version_needed == 63 &&
+			info.compression == METHOD_ZSTD)) {
 			throw std::runtime_error("Unsupported ZIP feature: Only ZIP versions up to 2.0 supported");
 		}
 		if(info.flags & 0x2001)
@@ -241,19 +248,61 @@ namespace
 			throw std::runtime_error("Unsupported ZIP feature: Indeterminate length not supported");
 		if(info.flags & 0x20)
 			throw std::runtime_error("Unsupported ZIP feature: Binary patching is not supported");
-		if(info.compression != 0 && info.compression != 8 && info.compression != 12)
+		if(info.compression != 0 && info.compression != 8 && info.compression != 12 &&
+			!(info.compression == METHOD_ZSTD && method_supported(METHOD_ZSTD)))
 			throw std::runtime_error("Unsupported ZIP feature: Unsupported compression method");
 		if(info.compression == 0 && info.compressed_size != info.uncompressed_size)
 			throw std::runtime_error("ZIP archive corrupt: csize ≠ usize for stored member");
+		info.data_offset = info.header_offset + 30 + filename_len + extra_len;
+		info.next_offset = info.data_offset + info.compressed_size;
+		return std::make_pair(filename_len, extra_len);
+	}
+
+	//Parse member starting from current offset.
+	zipfile_member_info parse_member(std::ifstream& file)
+	{
+		zipfile_member_info info;
+		info.central_directory_special = false;
+		info.header_offset = file.tellg();
+		//The file header is 30 bytes (this could also hit central header, but that's even larger).
+		unsigned char buffer[30];
+		if(!(file.read(reinterpret_cast<char*>(buffer), 30)))
+			throw std::runtime_error("Can't read file header from ZIP file");
+		uint16_t filename_len = parse_member_header(info, buffer).first;
+		if(info.central_directory_special)
+			return info;
 		std::vector<unsigned char> filename_storage;
 		filename_storage.resize(filename_len);
 		if(!(file.read(reinterpret_cast<char*>(&filename_storage[0]), filename_len)))
 			throw std::runtime_error("Can't read file name from zip file");
 		info.filename = std::string(reinterpret_cast<char*>(&filename_storage[0]), filename_len);
-		info.data_offset = info.header_offset + 30 + filename_len + extra_len;
-		info.next_offset = info.data_offset + info.compressed_size;
 		return info;
 	}
+
+	//Parse member at given offset of mapped archive. Does not read the filename.
+	zipfile_member_info parse_member(const char* base, size_t size, uint64_t offset)
+	{
+		zipfile_member_info info;
+		info.central_directory_special = false;
+		info.header_offset = offset;
+		if(offset > size || size - offset < 30)
+			throw std::runtime_error("Can't read file header from ZIP file");
+		parse_member_header(info, reinterpret_cast<const unsigned char*>(base + offset));
+		if(info.central_directory_special)
+			throw std::runtime_error("ZIP archive corrupt: Expected file magic");
+		if(info.data_offset > size || size - info.data_offset < info.compressed_size)
+			throw std::runtime_error("Can't read compressed data from ZIP file");
+		return info;
+	}
+
+#ifdef LIBZSTD_AVAILABLE
+	void zstd_decompress(char* out, size_t outsize, const char* in, size_t insize)
+	{
+		size_t r = ZSTD_decompress(out, outsize, in, insize);
+		if(ZSTD_isError(r) || r != outsize)
+			throw std::runtime_error("ZIP archive corrupt: Can't decompress member");
+	}
+#endif
 }
 
 bool reader::has_member(const std::string& name) throw()
@@ -302,6 +351,19 @@ std::istream& reader::operator[](const std::string& name) throw(std::bad_alloc,
 		s->push(boost::iostreams::bzip2_decompressor());
 		s->push(file_input(*zipstream, info.compressed_size, refcnt));
 		return *s;
+#ifdef LIBZSTD_AVAILABLE
+	} else if(info.compression == METHOD_ZSTD) {
+		//Zstd compression. Members are small enough to decompress in one go.
+		std::vector<char> cdata(info.compressed_size);
+		if(info.compressed_size)
+			zipstream->read(&cdata[0], info.compressed_size);
+		if((size_t)zipstream->gcount() != info.compressed_size)
+			throw std::runtime_error("ZIP archive corrupt: Truncated member");
+		std::string udata;
+		udata.resize(info.uncompressed_size);
+		zstd_decompress(&udata[0], udata.size(), cdata.empty() ? NULL : &cdata[0], cdata.size());
+		return *new std::istringstream(udata);
+#endif
 	} else
 		throw std::runtime_error("Unsupported ZIP feature: Unsupported compression method");
 }
@@ -328,6 +390,10 @@ reader::riterator reader::rend() throw(std::bad_alloc)
 
 reader::~reader() throw()
 {
+#ifndef NO_ZIP_MMAP
+	if(mapbase)
+		munmap(const_cast<char*>(mapbase), mapsize);
+#endif
 	if(!--*refcnt) {
 		delete zipstream;
 		delete refcnt;
@@ -340,6 +406,10 @@ reader::reader(const std::string& zipfile) throw(std::bad_alloc, std::runtime_er
 		throw std::runtime_error("Zipfile '" + zipfile + "' is not regular file");
 	zipstream = NULL;
 	refcnt = NULL;
+	filename = zipfile;
+	mapbase = NULL;
+	mapsize = 0;
+	map_tried = false;
 	try {
 		zipfile_member_info info;
 		info.next_offset = 0;
@@ -371,6 +441,14 @@ bool reader::read_linefile(const std::string& member, std::string& out, bool con
 {
 	if(conditional && !has_member(member))
 		return false;
+	if(map_archive()) {
+		std::vector<char> tmp(member_size(member));
+		read_into(member, tmp.empty() ? NULL : &tmp[0], tmp.size());
+		size_t eol = std::find(tmp.begin(), tmp.end(), '\n') - tmp.begin();
+		out = std::string(tmp.begin(), tmp.begin() + eol);
+		istrip_CR(out);
+		return true;
+	}
 	std::istream& m = (*this)[member];
 	try {
 		std::getline(m, out);
@@ -387,6 +465,12 @@ void reader::read_raw_file(const std::string& member, std::vector<char>& out) th
 	std::runtime_error)
 {
 	std::vector<char> _out;
+	if(map_archive()) {
+		_out.resize(member_size(member));
+		read_into(member, _out.empty() ? NULL : &_out[0], _out.size());
+		std::swap(out, _out);
+		return;
+	}
 	std::istream& m = (*this)[member];
 	try {
 		boost::iostreams::back_insert_device<std::vector<char>> rd(_out);
@@ -399,9 +483,131 @@ void reader::read_raw_file(const std::string& member, std::vector<char>& out) th
 	out = _out;
 }
 
-writer::writer(const std::string& zipfile, unsigned _compression) throw(std::bad_alloc, std::runtime_error)
+bool reader::map_archive()
+{
+	if(map_tried)
+		return (mapbase != NULL);
+	map_tried = true;
+#ifndef NO_ZIP_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || !st.st_size) {
+		close(fd);
+		return false;
+	}
+	void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED)
+		return false;
+	mapbase = reinterpret_cast<const char*>(m);
+	mapsize = st.st_size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t reader::member_size(const std::string& member) throw(std::bad_alloc, std::runtime_error)
 {
+	if(!offsets.count(member))
+		throw std::runtime_error("No such file '" + member + "' in zip archive");
+	if(map_archive())
+		return parse_member(mapbase, mapsize, offsets[member]).uncompressed_size;
+	zipstream->clear();
+	zipstream->seekg(offsets[member], std::ios::beg);
+	return parse_member(*zipstream).uncompressed_size;
+}
+
+std::pair<const char*, size_t> reader::stored_span(const std::string& member) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	if(!offsets.count(member))
+		throw std::runtime_error("No such file '" + member + "' in zip archive");
+	if(!map_archive())
+		return std::make_pair((const char*)NULL, (size_t)0);
+	zipfile_member_info info = parse_member(mapbase, mapsize, offsets[member]);
+	if(info.compression != 0)
+		return std::make_pair((const char*)NULL, (size_t)0);
+	return std::make_pair(mapbase + info.data_offset, (size_t)info.uncompressed_size);
+}
+
+size_t reader::read_into(const std::string& member, char* buf, size_t bufsize) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	if(!offsets.count(member))
+		throw std::runtime_error("No such file '" + member + "' in zip archive");
+	zipfile_member_info info;
+	if(map_archive())
+		info = parse_member(mapbase, mapsize, offsets[member]);
+	else {
+		zipstream->clear();
+		zipstream->seekg(offsets[member], std::ios::beg);
+		info = parse_member(*zipstream);
+	}
+	size_t size = info.uncompressed_size;
+	if(bufsize < size)
+		throw std::runtime_error("Buffer too small for ZIP member");
+	if(mapbase && info.compression == 0) {
+		if(size)
+			memcpy(buf, mapbase + info.data_offset, size);
+		return size;
+	}
+	if(mapbase && info.compression == 8) {
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if(inflateInit2(&z, -15) != Z_OK)
+			throw std::runtime_error("Can't initialize inflate");
+		z.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(mapbase + info.data_offset));
+		z.avail_in = info.compressed_size;
+		z.next_out = reinterpret_cast<unsigned char*>(buf);
+		z.avail_out = size;
+		int r = inflate(&z, Z_FINISH);
+		size_t got = z.total_out;
+		inflateEnd(&z);
+		if(r != Z_STREAM_END || got != size)
+			throw std::runtime_error("ZIP archive corrupt: Can't decompress member");
+		return size;
+	}
+#ifdef LIBZSTD_AVAILABLE
+	if(mapbase && info.compression == METHOD_ZSTD) {
+		zstd_decompress(buf, size, mapbase + info.data_offset, info.compressed_size);
+		return size;
+	}
+#endif
+	//Other compression methods, or no mapping. Go through the stream.
+	std::istream& m = (*this)[member];
+	try {
+		m.read(buf, size);
+		if((size_t)m.gcount() != size)
+			throw std::runtime_error("Can't read ZIP member");
+		delete &m;
+	} catch(...) {
+		delete &m;
+		throw;
+	}
+	return size;
+}
+
+bool method_supported(uint16_t method) throw()
+{
+	if(method == METHOD_STORE || method == METHOD_DEFLATE)
+		return true;
+#ifdef LIBZSTD_AVAILABLE
+	if(method == METHOD_ZSTD)
+		return true;
+#endif
+	return false;
+}
+
+writer::writer(const std::string& zipfile, unsigned _compression, uint16_t _method)
+	throw(std::bad_alloc, std::runtime_error)
+{
+	if(!method_supported(_method))
+		throw std::runtime_error("Unsupported ZIP compression method");
 	compression = _compression;
+	method = compression ? _method : METHOD_STORE;
 	zipfile_path = zipfile;
 	temp_path = zipfile + ".tmp";
 	zipstream = new std::ofstream(temp_path.c_str(), std::ios::binary);
@@ -409,18 +615,29 @@ writer::writer(const std::string& zipfile, unsigned _compression) throw(std::bad
 		throw std::runtime_error("Can't open zipfile '" + temp_path + "' for writing");
 	committed = false;
 	system_stream = true;
+	parallel = (compression && workpool::shared().get_threads() > 1);
+	collect_raw = (parallel || method == METHOD_ZSTD);
+	pending_count = 0;
 }
 
-writer::writer(std::ostream& stream, unsigned _compression) throw(std::bad_alloc, std::runtime_error)
+writer::writer(std::ostream& stream, unsigned _compression, uint16_t _method) throw(std::bad_alloc,
+	std::runtime_error)
 {
+	if(!method_supported(_method))
+		throw std::runtime_error("Unsupported ZIP compression method");
 	compression = _compression;
+	method = compression ? _method : METHOD_STORE;
 	zipstream = &stream;
 	committed = false;
 	system_stream = false;
+	parallel = (compression && workpool::shared().get_threads() > 1);
+	collect_raw = (parallel || method == METHOD_ZSTD);
+	pending_count = 0;
 }
 
 writer::~writer() throw()
 {
+	drain_pending();
 	if(!committed && system_stream)
 		remove(temp_path.c_str());
 	if(system_stream)
@@ -433,6 +650,7 @@ void writer::commit() throw(std::bad_alloc, std::logic_error, std::runtime_error
 		throw std::logic_error("Can't commit twice");
 	if(open_file != "")
 		throw std::logic_error("Can't commit with file open");
+	flush_completed(true);
 	std::vector<unsigned char> directory_entry;
 	uint32_t cdirsize = 0;
 	uint32_t cdiroff = zipstream->tellp();
@@ -443,9 +661,9 @@ void writer::commit() throw(std::bad_alloc, std::logic_error, std::runtime_error
 		directory_entry.resize(46 + i.first.length());
 		serialization::u32l(&directory_entry[0], 0x02014b50);
 		serialization::u16l(&directory_entry[4], 3);
-		serialization::u16l(&directory_entry[6], 20);
+		serialization::u16l(&directory_entry[6], (method == METHOD_ZSTD) ? 63 : 20);
 		serialization::u16l(&directory_entry[8], 0);
-		serialization::u16l(&directory_entry[10], compression ? 8 : 0);
+		serialization::u16l(&directory_entry[10], method);
 		serialization::u16l(&directory_entry[12], 0);
 		serialization::u16l(&directory_entry[14], 10273);
 		serialization::u32l(&directory_entry[16], i.second.crc);
@@ -494,10 +712,17 @@ std::ostream& writer::create_file(const std::string& name) throw(std::bad_alloc,
 		throw std::runtime_error("Bad member name");
 	current_compressed_file.resize(0);
 	s = new boost::iostreams::filtering_ostream();
+	if(collect_raw) {
+		//Just collect the data, size, CRC and compression are done in the worker pool (or on close).
+		s->push(vector_output(current_compressed_file));
+		open_file = name;
+		return *s;
+	}
 	s->push(size_and_crc_filter(4096));
 	if(compression) {
 		boost::iostreams::zlib_params params;
 		params.noheader = true;
+		params.level = (compression > 9) ? 9 : compression;
 		s->push(boost::iostreams::zlib_compressor(params));
 	}
 	s->push(vector_output(current_compressed_file));
@@ -509,42 +734,167 @@ void writer::close_file() throw(std::bad_alloc, std::logic_error, std::runtime_e
 {
 	if(open_file == "")
 		throw std::logic_error("Can't close file with no file open");
-	uint32_t ucs, cs, crc32;
+	uint32_t ucs, crc32;
 	boost::iostreams::close(*s);
+	if(parallel) {
+		delete s;
+		pending_member* m = new pending_member;
+		m->name = open_file;
+		m->oom = false;
+		std::swap(m->data, current_compressed_file);
+		open_file = "";
+		{
+			threads::alock h(plock);
+			pending_count++;
+		}
+		unsigned level = compression;
+		uint16_t _method = method;
+		workpool::shared().submit([this, m, level, _method]() {
+			m->compress(level, _method);
+			threads::alock h(this->plock);
+			this->completed.push_back(m);
+			this->pending_count--;
+			this->pcond.notify_all();
+		});
+		flush_completed(false);
+		return;
+	}
+	if(collect_raw) {
+		delete s;
+		pending_member m;
+		m.oom = false;
+		std::swap(m.data, current_compressed_file);
+		m.compress(compression, method);
+		if(m.oom)
+			throw std::bad_alloc();
+		if(m.error != "")
+			throw std::runtime_error(m.error);
+		write_member(open_file, m.crc, m.uncompressed_size, m.data);
+		open_file = "";
+		return;
+	}
 	size_and_crc_filter& f = *s->component<size_and_crc_filter>(0);
-	cs = current_compressed_file.size();
 	ucs = f.size();
 	crc32 = f.crc32();
 	delete s;
+	write_member(open_file, crc32, ucs, current_compressed_file);
+	current_compressed_file.resize(0);
+	open_file = "";
+}
 
+void writer::write_member(const std::string& name, uint32_t crc32, uint32_t ucs, const std::vector<char>& data)
+{
+	uint32_t cs = data.size();
 	base_offset = zipstream->tellp();
 	if(base_offset == (uint32_t)-1)
 		throw std::runtime_error("Can't read current ZIP stream position");
 	unsigned char header[30];
 	memset(header, 0, 30);
 	serialization::u32l(header, 0x04034b50);
-	header[4] = 20;
+	header[4] = (method == METHOD_ZSTD) ? 63 : 20;
 	header[6] = 0;
-	header[8] = compression ? 8 : 0;
+	header[8] = method;
 	header[12] = 33;
 	header[13] = 40;
 	serialization::u32l(header + 14, crc32);
 	serialization::u32l(header + 18, cs);
 	serialization::u32l(header + 22, ucs);
-	serialization::u16l(header + 26, open_file.length());
+	serialization::u16l(header + 26, name.length());
 	zipstream->write(reinterpret_cast<char*>(header), 30);
-	zipstream->write(open_file.c_str(), open_file.length());
-	zipstream->write(&current_compressed_file[0], current_compressed_file.size());
+	zipstream->write(name.c_str(), name.length());
+	if(cs)
+		zipstream->write(&data[0], cs);
 	if(!*zipstream)
 		throw std::runtime_error("Can't write member to ZIP file");
-	current_compressed_file.resize(0);
 	file_info info;
 	info.crc = crc32;
 	info.uncompressed_size = ucs;
 	info.compressed_size = cs;
 	info.offset = base_offset;
-	files[open_file] = info;
-	open_file = "";
+	files[name] = info;
+}
+
+void writer::pending_member::compress(unsigned level, uint16_t method)
+{
+	try {
+		uncompressed_size = data.size();
+		crc = ::crc32(0, NULL, 0);
+		crc = ::crc32(crc, reinterpret_cast<const unsigned char*>(data.empty() ? "" : &data[0]),
+			data.size());
+#ifdef LIBZSTD_AVAILABLE
+		if(method == METHOD_ZSTD) {
+			std::vector<char> out;
+			out.resize(ZSTD_compressBound(data.size()));
+			size_t r = ZSTD_compress(&out[0], out.size(), data.empty() ? NULL : &data[0], data.size(),
+				(level > 9) ? 9 : level);
+			if(ZSTD_isError(r))
+				throw std::runtime_error("Can't compress ZIP member");
+			out.resize(r);
+			std::swap(data, out);
+			return;
+		}
+#endif
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if(deflateInit2(&z, (level > 9) ? 9 : level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			throw std::runtime_error("Can't initialize deflate");
+		std::vector<char> out;
+		out.resize(deflateBound(&z, data.size()));
+		z.next_in = reinterpret_cast<unsigned char*>(data.empty() ? NULL : &data[0]);
+		z.avail_in = data.size();
+		z.next_out = reinterpret_cast<unsigned char*>(&out[0]);
+		z.avail_out = out.size();
+		int r = deflate(&z, Z_FINISH);
+		size_t outsize = z.total_out;
+		deflateEnd(&z);
+		if(r != Z_STREAM_END)
+			throw std::runtime_error("Can't compress ZIP member");
+		out.resize(outsize);
+		std::swap(data, out);
+	} catch(std::bad_alloc& e) {
+		oom = true;
+	} catch(std::exception& e) {
+		error = e.what();
+	}
+}
+
+void writer::flush_completed(bool all)
+{
+	if(!parallel)
+		return;
+	while(true) {
+		pending_member* m;
+		{
+			threads::alock h(plock);
+			while(all && completed.empty() && pending_count)
+				pcond.wait(h);
+			if(completed.empty())
+				return;
+			m = completed.front();
+			completed.pop_front();
+		}
+		try {
+			if(m->oom)
+				throw std::bad_alloc();
+			if(m->error != "")
+				throw std::runtime_error(m->error);
+			write_member(m->name, m->crc, m->uncompressed_size, m->data);
+		} catch(...) {
+			delete m;
+			throw;
+		}
+		delete m;
+	}
+}
+
+void writer::drain_pending() throw()
+{
+	threads::alock h(plock);
+	while(pending_count)
+		pcond.wait(h);
+	for(auto i : completed)
+		delete i;
+	completed.clear();
 }
 
 void writer::write_linefile(const std::string& member, const std::string& value, bool conditional)
@@ -21,23 +21,27 @@ namespace
 
 uint64_t lua_get_vmabase(const std::string& vma)
 {
-	for(auto i : CORE().memory->get_regions())
-		if(i->name == vma)
-			return i->base;
-	throw std::runtime_error("No such VMA");
+	auto r = CORE().memory->lookup_name(vma.c_str());
+	if(!r)
+		throw std::runtime_error("No such VMA");
+	return r->base;
 }
 
 uint64_t lua_get_read_address(lua::parameters& P)
 {
-	static std::map<std::string, char> deprecation_keys;
-	char* deprecation = &deprecation_keys[P.get_fname()];
 	uint64_t vmabase = 0;
 	if(P.is<lua_address>()) {
 		return P.arg<lua_address*>()->get();
-	} else if(P.is_string())
-		vmabase = lua_get_vmabase(P.arg<std::string>());
-	else {
+	} else if(P.is_string()) {
+		//This is on hot path of memory.read*, so look the name up without copying it.
+		auto r = CORE().memory->lookup_name(P.get_state().tostring(P.skip()));
+		if(!r)
+			throw std::runtime_error("No such VMA");
+		vmabase = r->base;
+	} else {
 		//Deprecated.
+		static std::map<std::string, char> deprecation_keys;
+		char* deprecation = &deprecation_keys[P.get_fname()];
 		if(P.get_state().do_once(deprecation))
 			messages << P.get_fname() << ": Global memory form is deprecated." << std::endl;
 	}
@@ -12,7 +12,10 @@
 #include "library/zip.hpp"
 #include "lua/bitmap.hpp"
 #include "library/threads.hpp"
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <type_traits>
 #include <vector>
 #include <sstream>
 
@@ -162,6 +165,7 @@ namespace
 		const rpixel_t& read(size_t idx) { return pixels[idx]; }
 		const pixel_t& lookup(const rpixel_t& p) { return p; }
 		void write(size_t idx, const pixel_t& v) { pixels[idx] = v; }
+		pixel_t* rowptr(size_t idx) { return pixels + idx; }
 		bool is_opaque(const rpixel_t& p) { return p.origa > 0; }
 		const pixel_t& transparent() { return _transparent; }
 	private:
@@ -184,6 +188,7 @@ namespace
 		const rpixel_t& read(size_t idx) { return pixels[idx]; }
 		const pixel_t& lookup(const rpixel_t& p) { return p; }
 		void write(size_t idx, const pixel_t& v) { pixels[idx] = v; }
+		pixel_t* rowptr(size_t idx) { return pixels + idx; }
 		bool is_opaque(const rpixel_t& p) { return p > 0; }
 		pixel_t transparent() { return 0; }
 	private:
@@ -243,6 +248,106 @@ namespace
 		uint16_t ck;
 	};
 
+	//Copy a row of pixels. The specializations are simple enough loops for the compiler to vectorize.
+	template<class _src, class _dest, class colorkey> void copy_row(_dest& dest, _src& src, const colorkey& ckey,
+		size_t didx, size_t sidx, size_t w)
+	{
+		for(size_t i = 0; i < w; i++) {
+			typename _src::rpixel_t c = src.read(sidx + i);
+			if(!ckey.iskey(c))
+				dest.write(didx + i, src.lookup(c));
+		}
+	}
+
+	void copy_row(operand_bitmap& dest, operand_bitmap& src, const colorkey_none& ckey, size_t didx, size_t sidx,
+		size_t w)
+	{
+		memmove(dest.rowptr(didx), src.rowptr(sidx), w * sizeof(uint16_t));
+	}
+
+	void copy_row(operand_bitmap& dest, operand_bitmap& src, const colorkey_palette& ckey, size_t didx,
+		size_t sidx, size_t w)
+	{
+		uint16_t* d = dest.rowptr(didx);
+		const uint16_t* s = src.rowptr(sidx);
+		uint16_t ck = ckey.ck;
+		for(size_t i = 0; i < w; i++)
+			d[i] = (s[i] != ck) ? s[i] : d[i];
+	}
+
+	void copy_row(operand_dbitmap& dest, operand_dbitmap& src, const colorkey_none& ckey, size_t didx,
+		size_t sidx, size_t w)
+	{
+		memmove(dest.rowptr(didx), src.rowptr(sidx), w * sizeof(framebuffer::color));
+	}
+
+	void copy_row(operand_dbitmap& dest, operand_dbitmap& src, const colorkey_direct& ckey, size_t didx,
+		size_t sidx, size_t w)
+	{
+		framebuffer::color* d = dest.rowptr(didx);
+		const framebuffer::color* s = src.rowptr(sidx);
+		uint32_t ck = ckey.ck;
+		uint16_t cka = ckey.cka;
+		for(size_t i = 0; i < w; i++)
+			if(s[i].orig != ck || s[i].origa != cka)
+				d[i] = s[i];
+	}
+
+	//Copy a row of pixels with Porter-Duff Over operator (opaque source pixels replace destination).
+	template<class _src, class _dest> void over_row(_dest& dest, _src& src, size_t didx, size_t sidx, size_t w)
+	{
+		for(size_t i = 0; i < w; i++) {
+			typename _src::rpixel_t c = src.read(sidx + i);
+			if(src.is_opaque(c))
+				dest.write(didx + i, src.lookup(c));
+		}
+	}
+
+	void over_row(operand_bitmap& dest, operand_bitmap& src, size_t didx, size_t sidx, size_t w)
+	{
+		uint16_t* d = dest.rowptr(didx);
+		const uint16_t* s = src.rowptr(sidx);
+		for(size_t i = 0; i < w; i++)
+			d[i] = s[i] ? s[i] : d[i];
+	}
+
+	void over_row(operand_dbitmap& dest, operand_dbitmap& src, size_t didx, size_t sidx, size_t w)
+	{
+		framebuffer::color* d = dest.rowptr(didx);
+		const framebuffer::color* s = src.rowptr(sidx);
+		for(size_t i = 0; i < w; i++)
+			if(s[i].origa)
+				d[i] = s[i];
+	}
+
+	//Copy a row of pixels, repeating each source pixel hscl times.
+	template<class _src, class _dest, class colorkey> void expand_row(_dest& dest, _src& src,
+		const colorkey& ckey, size_t didx, size_t sidx, size_t w, uint32_t hscl)
+	{
+		for(size_t i = 0; i < w; i++, didx += hscl) {
+			typename _src::rpixel_t c = src.read(sidx + i);
+			if(ckey.iskey(c))
+				continue;
+			typename _src::pixel_t p = src.lookup(c);
+			for(uint32_t k = 0; k < hscl; k++)
+				dest.write(didx + k, p);
+		}
+	}
+
+	//Like over_row, repeating each source pixel hscl times.
+	template<class _src, class _dest> void expand_over_row(_dest& dest, _src& src, size_t didx, size_t sidx,
+		size_t w, uint32_t hscl)
+	{
+		for(size_t i = 0; i < w; i++, didx += hscl) {
+			typename _src::rpixel_t c = src.read(sidx + i);
+			if(!src.is_opaque(c))
+				continue;
+			typename _src::pixel_t p = src.lookup(c);
+			for(uint32_t k = 0; k < hscl; k++)
+				dest.write(didx + k, p);
+		}
+	}
+
 	template<class _src, class _dest, class colorkey> struct srcdest
 	{
 		srcdest(_dest Xdest, _src Xsrc, const colorkey& _ckey)
@@ -259,6 +364,20 @@ namespace
 			if(!ckey.iskey(c))
 				dest.write(didx, src.lookup(c));
 		}
+		void copy(size_t didx, size_t sidx, size_t w)
+		{
+			copy_row(dest, src, ckey, didx, sidx, w);
+		}
+		void expand(size_t didx, size_t sidx, size_t w, uint32_t hscl)
+		{
+			expand_row(dest, src, ckey, didx, sidx, w, hscl);
+		}
+		//Without colorkey, every destination pixel is overwritten, so rows of scaled blit can be duplicated.
+		static const bool row_duplicable = std::is_same<colorkey, colorkey_none>::value;
+		void duplicate_row(size_t didx, size_t sdidx, size_t w)
+		{
+			memcpy(dest.rowptr(didx), dest.rowptr(sdidx), w * sizeof(typename _dest::pixel_t));
+		}
 		size_t swidth, sheight, dwidth, dheight;
 	private:
 		_dest dest;
@@ -289,6 +408,25 @@ namespace
 			if(darray[didx] < c)
 				darray[didx] = c;
 		}
+		void copy(size_t didx, size_t sidx, size_t w)
+		{
+			uint16_t* d = darray + didx;
+			const uint16_t* s = sarray + sidx;
+			for(size_t i = 0; i < w; i++)
+				d[i] = (d[i] < s[i]) ? s[i] : d[i];
+		}
+		void expand(size_t didx, size_t sidx, size_t w, uint32_t hscl)
+		{
+			uint16_t* d = darray + didx;
+			const uint16_t* s = sarray + sidx;
+			for(size_t i = 0; i < w; i++, d += hscl)
+				for(uint32_t k = 0; k < hscl; k++)
+					d[k] = (d[k] < s[i]) ? s[i] : d[k];
+		}
+		static const bool row_duplicable = false;
+		void duplicate_row(size_t didx, size_t sdidx, size_t w)
+		{
+		}
 		size_t swidth, sheight, dwidth, dheight;
 	private:
 		uint16_t* sarray;
@@ -365,6 +503,53 @@ namespace
 			}
 			dest.write(didx, r);
 		}
+		void copy(size_t didx, size_t sidx, size_t w)
+		{
+			switch(oper) {
+			case PD_SRC:
+				copy_row(dest, src, colorkey_none(), didx, sidx, w);
+				break;
+			case PD_OVER:
+				over_row(dest, src, didx, sidx, w);
+				break;
+			case PD_DEST:
+				break;
+			case PD_CLEAR:
+				std::fill(dest.rowptr(didx), dest.rowptr(didx) + w, dest.transparent());
+				break;
+			default:
+				for(size_t i = 0; i < w; i++)
+					copy(didx + i, sidx + i);
+				break;
+			}
+		}
+		void expand(size_t didx, size_t sidx, size_t w, uint32_t hscl)
+		{
+			switch(oper) {
+			case PD_SRC:
+				expand_row(dest, src, colorkey_none(), didx, sidx, w, hscl);
+				break;
+			case PD_OVER:
+				expand_over_row(dest, src, didx, sidx, w, hscl);
+				break;
+			case PD_DEST:
+				break;
+			case PD_CLEAR:
+				std::fill(dest.rowptr(didx), dest.rowptr(didx) + w * hscl, dest.transparent());
+				break;
+			default:
+				for(size_t i = 0; i < w; i++, didx += hscl)
+					for(uint32_t k = 0; k < hscl; k++)
+						copy(didx + k, sidx + i);
+				break;
+			}
+		}
+		//Src and Clear don't depend on destination.
+		static const bool row_duplicable = (oper == PD_SRC || oper == PD_CLEAR);
+		void duplicate_row(size_t didx, size_t sdidx, size_t w)
+		{
+			memcpy(dest.rowptr(didx), dest.rowptr(sdidx), w * sizeof(typename _dest::pixel_t));
+		}
 		size_t swidth, sheight, dwidth, dheight;
 	private:
 		_dest dest;
@@ -388,16 +573,10 @@ namespace
 		if(sx + w < w || sy + h < h) return;  //Don't do overflowing blits.
 		size_t sidx = sy * sd.swidth + sx;
 		size_t didx = dy * sd.dwidth + dx;
-		size_t srskip = sd.swidth - w;
-		size_t drskip = sd.dwidth - w;
 		for(uint32_t j = 0; j < h; j++) {
-			for(uint32_t i = 0; i < w; i++) {
-				sd.copy(didx, sidx);
-				sidx++;
-				didx++;
-			}
-			sidx += srskip;
-			didx += drskip;
+			sd.copy(didx, sidx, w);
+			sidx += sd.swidth;
+			didx += sd.dwidth;
 		}
 	}
 
@@ -416,19 +595,19 @@ namespace
 		if(sx + w < w || sy + h < h) return;  //Don't do overflowing blits.
 		size_t sidx = sy * sd.swidth + sx;
 		size_t didx = dy * sd.dwidth + dx;
-		size_t drskip = sd.dwidth - hscl * w;
 		uint32_t _w = hscl * w;
 		for(uint32_t j = 0; j < vscl * h; j++) {
-			uint32_t _sidx = sidx;
-			for(uint32_t i = 0; i < _w ; i += hscl) {
-				for(uint32_t k = 0; k < hscl; k++)
-					sd.copy(didx + k, _sidx);
-				_sidx++;
-				didx+=hscl;
+			if(sd.row_duplicable && (j % vscl) != 0) {
+				//Same as the row above.
+				sd.duplicate_row(didx, didx - sd.dwidth, _w);
+			} else if(hscl == 1) {
+				sd.copy(didx, sidx, w);
+			} else {
+				sd.expand(didx, sidx, w, hscl);
 			}
 			if((j % vscl) == vscl - 1)
 				sidx += sd.swidth;
-			didx += drskip;
+			didx += sd.dwidth;
 		}
 	}
 
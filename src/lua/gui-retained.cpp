@@ -0,0 +1,254 @@
+#include "core/framebuffer.hpp"
+#include "core/instance.hpp"
+#include "lua/internal.hpp"
+#include "library/framebuffer.hpp"
+#include "library/lua-framebuffer.hpp"
+#include "library/threads.hpp"
+
+namespace
+{
+	struct lua_retained;
+
+	//Objects currently being rendered on this thread, innermost first. Used to break reference cycles.
+	struct render_guard
+	{
+		render_guard(const lua_retained* _obj);
+		~render_guard();
+		static bool active(const lua_retained* obj);
+	private:
+		const lua_retained* obj;
+		render_guard* prev;
+		static thread_local render_guard* top;
+	};
+
+	thread_local render_guard* render_guard::top;
+
+	render_guard::render_guard(const lua_retained* _obj)
+		: obj(_obj), prev(top)
+	{
+		top = this;
+	}
+
+	render_guard::~render_guard()
+	{
+		top = prev;
+	}
+
+	bool render_guard::active(const lua_retained* obj)
+	{
+		for(render_guard* g = top; g; g = g->prev)
+			if(g->obj == obj)
+				return true;
+		return false;
+	}
+
+	struct lua_retained
+	{
+		lua_retained(lua::state& L, int fnidx);
+		static size_t overcommit(int fnidx) { return 0; }
+		~lua_retained() throw();
+		static int create(lua::state& L, lua::parameters& P);
+		int set(lua::state& L, lua::parameters& P);
+		int move(lua::state& L, lua::parameters& P);
+		int draw(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			threads::alock h(lock);
+			size_t s = rqueue.get_object_count();
+			return (stringfmt() << s << " " << ((s != 1) ? "objects" : "object") << " at " << x << ","
+				<< y).str();
+		}
+		void record(lua::state& L, int first, int count);
+		int32_t x;
+		int32_t y;
+		framebuffer::queue rqueue;
+		lua::render_context lctx;
+		threads::lock lock;
+	private:
+		lua::state* mstate;
+		unsigned recording;
+	};
+
+	struct render_object_retained : public framebuffer::object
+	{
+		render_object_retained(lua::objpin<lua_retained>& _r) throw()
+			: r(_r) {}
+		~render_object_retained() throw() {}
+		bool kill_request(void* obj) throw()
+		{
+			return kill_request_ifeq(r.object(), obj);
+		}
+		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		{
+			lua_retained& _r = *r;
+			//If objects draw each other, don't recurse forever (or deadlock on the lock).
+			if(render_guard::active(&_r))
+				return;
+			render_guard g(&_r);
+			threads::alock h(_r.lock);
+			size_t ox = scr.get_origin_x();
+			size_t oy = scr.get_origin_y();
+			scr.set_origin(ox + _r.x, oy + _r.y);
+			_r.rqueue.run(scr);
+			scr.set_origin(ox, oy);
+		}
+		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
+		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
+		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+	private:
+		lua::objpin<lua_retained> r;
+	};
+
+	lua_retained::lua_retained(lua::state& L, int fnidx)
+	{
+		x = 0;
+		y = 0;
+		lctx.left_gap = std::numeric_limits<uint32_t>::max();
+		lctx.right_gap = std::numeric_limits<uint32_t>::max();
+		lctx.bottom_gap = std::numeric_limits<uint32_t>::max();
+		lctx.top_gap = std::numeric_limits<uint32_t>::max();
+		lctx.queue = &rqueue;
+		lctx.width = 0;
+		lctx.height = 0;
+		recording = 0;
+		//The function is kept in order to record again with different parameters.
+		mstate = &L.get_master();
+		L.pushlightuserdata(this);
+		L.pushvalue(fnidx);
+		L.rawset(LUA_REGISTRYINDEX);
+	}
+
+	lua_retained::~lua_retained() throw()
+	{
+		CORE().fbuf->render_kill_request(this);
+		if(mstate->handle()) {
+			mstate->pushlightuserdata(this);
+			mstate->pushnil();
+			mstate->rawset(LUA_REGISTRYINDEX);
+		}
+	}
+
+	void lua_retained::record(lua::state& L, int first, int count)
+	{
+		auto& core = CORE();
+		lua::render_context* saved = core.lua2->render_ctx;
+		//Record into temporary queue without holding the lock, as the function may call methods of this object.
+		framebuffer::queue tmpq;
+		lua::render_context tctx;
+		tctx.left_gap = std::numeric_limits<uint32_t>::max();
+		tctx.right_gap = std::numeric_limits<uint32_t>::max();
+		tctx.bottom_gap = std::numeric_limits<uint32_t>::max();
+		tctx.top_gap = std::numeric_limits<uint32_t>::max();
+		tctx.queue = &tmpq;
+		tctx.width = saved ? saved->width : lctx.width;
+		tctx.height = saved ? saved->height : lctx.height;
+		L.pushlightuserdata(this);
+		L.rawget(LUA_REGISTRYINDEX);
+		for(int i = 0; i < count; i++)
+			L.pushvalue(first + i);
+		recording++;
+		core.lua2->render_ctx = &tctx;
+		int r = L.pcall(count, 0, 0);
+		core.lua2->render_ctx = saved;
+		recording--;
+		if(r) {
+			std::string err;
+			if(r == LUA_ERRRUN)
+				err = L.get_string(-1, "Lua retained drawing function");
+			else if(r == LUA_ERRMEM)
+				err = "Out of memory";
+			else if(r == LUA_ERRERR)
+				err = "Double fault";
+			else
+				err = "Unknown error";
+			L.pop(1);
+			throw std::runtime_error("Error recording retained drawing: " + err);
+		}
+		threads::alock h(lock);
+		rqueue.clear();
+		rqueue.copy_from(tmpq);
+		lctx.left_gap = tctx.left_gap;
+		lctx.right_gap = tctx.right_gap;
+		lctx.bottom_gap = tctx.bottom_gap;
+		lctx.top_gap = tctx.top_gap;
+		lctx.width = tctx.width;
+		lctx.height = tctx.height;
+	}
+
+	int lua_retained::create(lua::state& L, lua::parameters& P)
+	{
+		int fnidx;
+
+		P(P.function(fnidx));
+
+		lua_retained* r = lua::_class<lua_retained>::create(L, fnidx);
+		int top = L.gettop();
+		r->record(L, fnidx + 1, top - 1 - fnidx);
+		return 1;
+	}
+
+	int lua_retained::set(lua::state& L, lua::parameters& P)
+	{
+		int first;
+
+		P(P.skipped());
+		first = P.skip();
+
+		record(L, first, L.gettop() - first + 1);
+		return 0;
+	}
+
+	int lua_retained::move(lua::state& L, lua::parameters& P)
+	{
+		int32_t _x, _y;
+
+		P(P.skipped(), _x, _y);
+
+		threads::alock h(lock);
+		x = _x;
+		y = _y;
+		return 0;
+	}
+
+	int lua_retained::draw(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		lua::objpin<lua_retained> r;
+
+		if(!core.lua2->render_ctx) return 0;
+
+		P(r);
+
+		if(recording)
+			throw std::runtime_error("Can't draw retained object into itself");
+		if(!P.is_novalue()) {
+			int32_t _x, _y;
+
+			P(_x, _y);
+
+			threads::alock h(lock);
+			x = _x;
+			y = _y;
+		}
+
+		lua::render_context* ptr = &lctx;
+		if(ptr->top_gap != std::numeric_limits<uint32_t>::max())
+			core.lua2->render_ctx->top_gap = ptr->top_gap;
+		if(ptr->right_gap != std::numeric_limits<uint32_t>::max())
+			core.lua2->render_ctx->right_gap = ptr->right_gap;
+		if(ptr->bottom_gap != std::numeric_limits<uint32_t>::max())
+			core.lua2->render_ctx->bottom_gap = ptr->bottom_gap;
+		if(ptr->left_gap != std::numeric_limits<uint32_t>::max())
+			core.lua2->render_ctx->left_gap = ptr->left_gap;
+		core.lua2->render_ctx->queue->create_add<render_object_retained>(r);
+		return 0;
+	}
+
+	lua::_class<lua_retained> LUA_class_lua_retained(lua_class_gui, "RETAINED", {
+		{"new", lua_retained::create},
+	}, {
+		{"set", &lua_retained::set},
+		{"move", &lua_retained::move},
+		{"draw", &lua_retained::draw},
+	}, &lua_retained::print);
+}
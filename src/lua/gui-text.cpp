@@ -7,6 +7,33 @@
 
 namespace
 {
+	//Size of glyph buffer needed for text, and the size of the text itself.
+	std::pair<size_t, size_t> text_buffer_size(int32_t x, const std::string& text, bool hdbl, bool vdbl,
+		std::pair<size_t, size_t>& orig_size)
+	{
+		auto size = main_font.get_metrics(text, x, hdbl, vdbl);
+		orig_size = size;
+		//Enlarge size by 2 in each dimension, in order to accomodiate halo, if any.
+		//Round up width to multiple of 32.
+		size.first = (size.first + 33) >> 5 << 5;
+		size.second += 2;
+		return size;
+	}
+
+	template<bool X> void render_text_with(struct framebuffer::fb<X>& scr, unsigned char* mem,
+		std::pair<size_t, size_t> size, std::pair<size_t, size_t> orig_size, int32_t x, int32_t y,
+		const std::string& text, framebuffer::color& fg, framebuffer::color& bg, framebuffer::color& hl,
+		bool hdbl, bool vdbl) throw()
+	{
+		uint32_t rx = x + (int32_t)scr.get_origin_x() - 1;
+		uint32_t ry = y + (int32_t)scr.get_origin_y() - 1;
+		mem += (32 - ((size_t)mem & 31)) & 31;	//Align.
+		memset(mem, 0, size.first * size.second);
+		main_font.render(mem + size.first + 1, size.first, text, x, hdbl, vdbl);
+		halo_blit(scr, mem, size.first, size.second, orig_size.first, orig_size.second, rx, ry, bg,
+			fg, hl);
+	}
+
 	struct render_object_text : public framebuffer::object
 	{
 		render_object_text(int32_t _x, int32_t _y, const std::string& _text, framebuffer::color _fg,
@@ -16,35 +43,20 @@ namespace
 		~render_object_text() throw() {}
 		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
 		{
-			auto size = main_font.get_metrics(text, x, hdbl, vdbl);
-			auto orig_size = size;
-			//Enlarge size by 2 in each dimension, in order to accomodiate halo, if any.
-			//Round up width to multiple of 32.
-			size.first = (size.first + 33) >> 5 << 5;
-			size.second += 2;
+			std::pair<size_t, size_t> orig_size;
+			auto size = text_buffer_size(x, text, hdbl, vdbl, orig_size);
 			//The -1 is to accomodiate halo.
 			size_t allocsize = size.first * size.second + 32;
 
 			if(allocsize > 32768) {
 				std::vector<uint8_t> memory;
 				memory.resize(allocsize);
-				op_with(scr, &memory[0], size, orig_size);
+				render_text_with(scr, &memory[0], size, orig_size, x, y, text, fg, bg, hl, hdbl, vdbl);
 			} else {
 				uint8_t memory[allocsize];
-				op_with(scr, memory, size, orig_size);
+				render_text_with(scr, memory, size, orig_size, x, y, text, fg, bg, hl, hdbl, vdbl);
 			}
 		}
-		template<bool X> void op_with(struct framebuffer::fb<X>& scr, unsigned char* mem,
-			std::pair<size_t, size_t> size, std::pair<size_t, size_t> orig_size) throw()
-		{
-			uint32_t rx = x + (int32_t)scr.get_origin_x() - 1;
-			uint32_t ry = y + (int32_t)scr.get_origin_y() - 1;
-			mem += (32 - ((size_t)mem & 31)) & 31;	//Align.
-			memset(mem, 0, size.first * size.second);
-			main_font.render(mem + size.first + 1, size.first, text, x, hdbl, vdbl);
-			halo_blit(scr, mem, size.first, size.second, orig_size.first, orig_size.second, rx, ry, bg,
-				fg, hl);
-		}
 		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
 		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
 		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
@@ -59,6 +71,98 @@ namespace
 		bool vdbl;
 	};
 
+	struct text_batch_entry
+	{
+		int32_t x;
+		int32_t y;
+		size_t offset;
+		size_t length;
+	};
+
+	//Many strings with same colors, drawn by one queue entry.
+	struct render_object_text_batch : public framebuffer::object
+	{
+		render_object_text_batch(std::vector<text_batch_entry>* _entries, std::string* _texts,
+			framebuffer::color _fg, framebuffer::color _bg, framebuffer::color _hl) throw()
+			: fg(_fg), bg(_bg), hl(_hl)
+		{
+			std::swap(entries, *_entries);
+			std::swap(texts, *_texts);
+		}
+		~render_object_text_batch() throw() {}
+		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		{
+			//The glyph buffer is shared by all the strings.
+			std::vector<uint8_t> memory;
+			std::string text;
+			for(auto& i : entries) {
+				text.assign(texts, i.offset, i.length);
+				std::pair<size_t, size_t> orig_size;
+				auto size = text_buffer_size(i.x, text, false, false, orig_size);
+				size_t allocsize = size.first * size.second + 32;
+				if(memory.size() < allocsize)
+					memory.resize(allocsize);
+				render_text_with(scr, &memory[0], size, orig_size, i.x, i.y, text, fg, bg, hl, false,
+					false);
+			}
+		}
+		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
+		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
+		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+	private:
+		std::vector<text_batch_entry> entries;
+		std::string texts;
+		framebuffer::color fg;
+		framebuffer::color bg;
+		framebuffer::color hl;
+	};
+
+	int text_batch(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		int ltbl;
+		framebuffer::color fg, bg, hl;
+		std::vector<text_batch_entry> entries;
+		std::string texts;
+
+		if(!core.lua2->render_ctx) return 0;
+
+		P(P.table(ltbl), P.optional(fg, 0xFFFFFFU), P.optional(bg, -1), P.optional(hl, -1));
+
+		for(int i = 1;; i++) {
+			L.rawgeti(ltbl, i);
+			if(L.type(-1) == LUA_TNIL) {
+				L.pop(1);
+				break;
+			}
+			if(L.type(-1) != LUA_TTABLE) {
+				L.pop(1);
+				(stringfmt() << P.get_fname() << ": Entries must be {x, y, text} tables").throwex();
+			}
+			L.rawgeti(-1, 1);
+			L.rawgeti(-2, 2);
+			L.rawgeti(-3, 3);
+			size_t len;
+			const char* str = (L.type(-1) == LUA_TSTRING || L.type(-1) == LUA_TNUMBER) ?
+				L.tolstring(-1, len) : NULL;
+			if(L.type(-3) != LUA_TNUMBER || L.type(-2) != LUA_TNUMBER || !str) {
+				L.pop(4);
+				(stringfmt() << P.get_fname() << ": Entries must be {x, y, text} tables").throwex();
+			}
+			text_batch_entry e;
+			e.x = L.tonumber(-3);
+			e.y = L.tonumber(-2);
+			e.offset = texts.length();
+			e.length = len;
+			texts.append(str, len);
+			entries.push_back(e);
+			L.pop(4);
+		}
+
+		core.lua2->render_ctx->queue->create_add<render_object_text_batch>(&entries, &texts, fg, bg, hl);
+		return 0;
+	}
+
 	template<bool hdbl, bool vdbl>
 	int internal_gui_text(lua::state& L, lua::parameters& P)
 	{
@@ -80,5 +184,6 @@ namespace
 		{"textH", internal_gui_text<true, false>},
 		{"textV", internal_gui_text<false, true>},
 		{"textHV", internal_gui_text<true, true>},
+		{"text_batch", text_batch},
 	});
 }
@@ -64,9 +64,11 @@ namespace
 		size_t stride() { return width; }
 		void lock() {}
 		void unlock() {}
-		void draw(size_t bmpidx, typename framebuffer::fb<T>::element_t& target)
+		void draw_row(size_t bmpidx, typename framebuffer::fb<T>::element_t* target, size_t w)
 		{
-			cmap[pixmap[bmpidx]].apply(target);
+			const unsigned char* s = pixmap + bmpidx;
+			for(size_t i = 0; i < w; i++)
+				cmap[s[i]].apply(target[i]);
 		}
 	private:
 		framebuffer::color cmap[4];
@@ -4,9 +4,11 @@
 #include "library/globalwrap.hpp"
 #include "library/keyboard.hpp"
 #include "library/memtracker.hpp"
+#include "library/profiler.hpp"
 #include "lua/internal.hpp"
 #include "lua/lua.hpp"
 #include "lua/unsaferewind.hpp"
+#include "core/inputsearch.hpp"
 #include "core/instance.hpp"
 #include "core/mainloop.hpp"
 #include "core/messages.hpp"
@@ -235,6 +237,7 @@ lua_state::lua_state(lua::state& _L, command::group& _command, settingvar::group
 	on_post_rewind = new lua::state::callback_list(L, "post_rewind", "on_post_rewind");
 	on_set_rewind = new lua::state::callback_list(L, "set_rewind", "on_set_rewind");
 	on_latch = new lua::state::callback_list(L, "latch", "on_latch");
+	on_input_search = new lua::state::callback_list(L, "input_search", "on_input_search");
 }
 
 lua_state::~lua_state()
@@ -266,6 +269,7 @@ lua_state::~lua_state()
 	delete on_post_rewind;
 	delete on_set_rewind;
 	delete on_latch;
+	delete on_input_search;
 }
 
 void lua_state::callback_do_paint(struct lua::render_context* ctx, bool non_synthetic) throw()
@@ -374,11 +378,14 @@ bool lua_state::callback_do_button(uint32_t port, uint32_t controller, uint32_t
 namespace
 {
 	lua::_class<lua_unsaferewind> LUA_class_unsaferewind(lua_class_movie, "UNSAFEREWIND", {}, {
+		{"reuse", &lua_unsaferewind::reuse},
+		{"size", &lua_unsaferewind::size},
 	}, &lua_unsaferewind::print);
 }
 
 void lua_state::do_reset()
 {
+	rewind_reuse.clear();
 	L.reset();
 	luaL_openlibs(L.handle());
 
@@ -432,6 +439,7 @@ void init_lua(emulator_instance& core) throw()
 
 void quit_lua(emulator_instance& core) throw()
 {
+	core.lua2->rewind_reuse.clear();
 	core.lua->deinit();
 }
 
@@ -462,7 +470,7 @@ void lua_state::callback_do_unsafe_rewind(movie& mov, void* u)
 			mainloop_restore_state(u2->console_state);
 			mov.fast_load(u2->console_state.save_frame, u2->ptr, u2->console_state.lagged_frames,
 				u2->console_state.pollcounters);
-			core.mlogic->get_mfile().dyn = u2->console_state;
+			core.mlogic->get_mfile().dyn.copy_from(u2->console_state);
 			run_callback(*on_post_rewind);
 			delete reinterpret_cast<lua::objpin<lua_unsaferewind>*>(u);
 		} catch(std::bad_alloc& e) {
@@ -472,10 +480,17 @@ void lua_state::callback_do_unsafe_rewind(movie& mov, void* u)
 		}
 	} else {
 		//Save
-		run_callback(*on_set_rewind, lua::state::fn_tag([&core, &mov](lua::state& L) ->
+		run_callback(*on_set_rewind, lua::state::fn_tag([this, &core, &mov](lua::state& L) ->
 			int {
-			lua_unsaferewind* u2 = lua::_class<lua_unsaferewind>::create(*core.lua);
-			u2->console_state = core.mlogic->get_mfile().dyn;
+			lua_unsaferewind* u2;
+			if(rewind_reuse) {
+				//Overwrite the old object, reusing the memory it has.
+				u2 = rewind_reuse.object();
+				rewind_reuse.luapush(L);
+				rewind_reuse.clear();
+			} else
+				u2 = lua::_class<lua_unsaferewind>::create(*core.lua);
+			u2->console_state.copy_from(core.mlogic->get_mfile().dyn);
 			mov.fast_save(u2->console_state.save_frame, u2->ptr, u2->console_state.lagged_frames,
 				u2->console_state.pollcounters);
 			return 1;
@@ -493,10 +508,61 @@ void lua_state::callback_do_latch(std::list<std::string>& args)
 	run_callback(*on_latch, lua::state::vararg_tag(args));
 }
 
+void lua_state::callback_input_search(const input_search_result& r)
+{
+	run_callback(*on_input_search, lua::state::fn_tag([&r](lua::state& L) -> int {
+		L.newtable();
+		if(r.error != "") {
+			L.pushstring("error");
+			L.pushlstring(r.error);
+			L.rawset(-3);
+			return 1;
+		}
+		L.pushstring("score");
+		L.pushnumber(r.score);
+		L.rawset(-3);
+		L.pushstring("explored");
+		L.pushnumber(r.explored);
+		L.rawset(-3);
+		L.pushstring("duplicates");
+		L.pushnumber(r.duplicates);
+		L.rawset(-3);
+		L.pushstring("inputs");
+		L.newtable();
+		for(size_t i = 0; i < r.inputs.size(); i++) {
+			char buf[MAX_SERIALIZED_SIZE];
+			portctrl::frame f = r.inputs[i];
+			f.serialize(buf);
+			L.pushnumber(i + 1);
+			L.pushstring(buf);
+			L.rawset(-3);
+		}
+		L.rawset(-3);
+		return 1;
+	}));
+}
+
 lua_unsaferewind::lua_unsaferewind(lua::state& L)
 {
 }
 
+int lua_unsaferewind::reuse(lua::state& L, lua::parameters& P)
+{
+	lua::objpin<lua_unsaferewind> pin;
+
+	P(pin);
+
+	CORE().lua2->rewind_reuse = pin;
+	mainloop_signal_need_rewind(NULL);
+	return 0;
+}
+
+int lua_unsaferewind::size(lua::state& L, lua::parameters& P)
+{
+	L.pushnumber(console_state.get_size());
+	return 1;
+}
+
 void lua_state::run_startup_scripts()
 {
 	for(auto i : startup_scripts) {
@@ -585,6 +651,8 @@ template<typename... T> bool lua_state::run_callback(lua::state::callback_list&
 {
 	if(recursive_flag)
 		return true;
+	//Profile each callback under its own name.
+	PROFILE_SPAN(list.get_profile_name());
 	recursive_flag = true;
 	try {
 		if(!list.callback(args...)) {
@@ -0,0 +1,134 @@
+#include "lua/internal.hpp"
+#include "core/instance.hpp"
+#include "core/memorymanip.hpp"
+#include "library/memoryspace.hpp"
+#include "library/serialization.hpp"
+#include "library/int24.hpp"
+
+namespace
+{
+	struct buffer_type
+	{
+		const char* name;
+		size_t size;
+		void (*push)(lua::state& L, const char* ptr, int endian);
+	};
+
+	template<typename T> void push_element(lua::state& L, const char* ptr, int endian)
+	{
+		L.pushnumber(static_cast<T>(serialization::read_endian<T>(ptr, endian)));
+	}
+
+	buffer_type buffer_types[] = {
+		{"byte", 1, push_element<uint8_t>},
+		{"sbyte", 1, push_element<int8_t>},
+		{"word", 2, push_element<uint16_t>},
+		{"sword", 2, push_element<int16_t>},
+		{"hword", 3, push_element<ss_uint24_t>},
+		{"shword", 3, push_element<ss_int24_t>},
+		{"dword", 4, push_element<uint32_t>},
+		{"sdword", 4, push_element<int32_t>},
+		{"qword", 8, push_element<uint64_t>},
+		{"sqword", 8, push_element<int64_t>},
+		{"float", 4, push_element<float>},
+		{"double", 8, push_element<double>},
+	};
+
+	const buffer_type& lookup_type(const std::string& type)
+	{
+		for(auto& i : buffer_types)
+			if(type == i.name)
+				return i;
+		throw std::runtime_error("Bad type '" + type + "'");
+	}
+
+	class memory_buffer
+	{
+	public:
+		memory_buffer(lua::state& L, const std::string& type, uint64_t count);
+		static size_t overcommit(const std::string& type, uint64_t count)
+		{
+			return lua::overcommit_std_align + (size_t)count * lookup_type(type).size;
+		}
+		static int create(lua::state& L, lua::parameters& P);
+		int index(lua::state& L, lua::parameters& P);
+		int len(lua::state& L, lua::parameters& P);
+		int call(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			return (stringfmt() << count << " " << type->name << ((count != 1) ? " elements" :
+				" element")).str();
+		}
+	private:
+		const buffer_type* type;
+		char* data;
+		uint64_t count;
+		int endian;
+	};
+
+	memory_buffer::memory_buffer(lua::state& L, const std::string& _type, uint64_t _count)
+	{
+		type = &lookup_type(_type);
+		count = _count;
+		if(count && ((size_t)count * type->size) / type->size != count)
+			throw std::runtime_error("Buffer too large");
+		endian = 0;
+		data = lua::align_overcommit<memory_buffer, char>(this);
+		memset(data, 0, (size_t)count * type->size);
+	}
+
+	int memory_buffer::create(lua::state& L, lua::parameters& P)
+	{
+		std::string type;
+		uint64_t count;
+
+		P(type, count);
+
+		lua::_class<memory_buffer>::create(L, type, count);
+		return 1;
+	}
+
+	int memory_buffer::index(lua::state& L, lua::parameters& P)
+	{
+		uint64_t n;
+
+		P(P.skipped());
+		if(!P.is_number()) {
+			L.pushnil();
+			return 1;
+		}
+		P(n);
+		if(n >= count) {
+			L.pushnil();
+			return 1;
+		}
+		type->push(L, data + n * type->size, endian);
+		return 1;
+	}
+
+	int memory_buffer::len(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(count);
+		return 1;
+	}
+
+	int memory_buffer::call(lua::state& L, lua::parameters& P)
+	{
+		uint64_t addr, stride;
+
+		P(P.skipped());
+		addr = lua_get_read_address(P);
+		P(P.optional(stride, type->size));
+
+		endian = CORE().memory->read_strided(addr, stride, count, type->size, data);
+		return 0;
+	}
+
+	lua::_class<memory_buffer> LUA_class_memory_buffer(lua_class_memory, "MEMORY_BUFFER", {
+		{"new", memory_buffer::create},
+	}, {
+		{"__index", &memory_buffer::index},
+		{"__len", &memory_buffer::len},
+		{"__call", &memory_buffer::call},
+	}, &memory_buffer::print);
+}
@@ -14,6 +14,7 @@
 #include "library/string.hpp"
 #include "library/skein.hpp"
 #include "library/memoryspace.hpp"
+#include "library/memoryfingerprint.hpp"
 #include "library/minmax.hpp"
 #include "library/hex.hpp"
 #include "library/int24.hpp"
@@ -644,6 +645,22 @@ namespace
 		return 1;
 	}
 
+	memory_fingerprint fingerprint_incremental(true);
+
+	int state_fingerprint(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		bool incremental;
+
+		P(P.optional(incremental, false));
+
+		if(incremental)
+			L.pushlstring(fingerprint_incremental.compute(*core.memory));
+		else
+			L.pushlstring(memory_fingerprint().compute(*core.memory));
+		return 1;
+	}
+
 	template<typename H, void(*update)(H& state, const char* mem, size_t memsize),
 		std::string(*read)(H& state), bool extra>
 	int hash_core(H& state, lua::state& L, lua::parameters& P)
@@ -813,6 +830,38 @@ namespace
 		return 1;
 	}
 
+	int readregion_string(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		uint64_t addr, size;
+
+		addr = lua_get_read_address(P);
+		P(size);
+
+		std::vector<char> buffer(size);
+		if(size)
+			core.memory->read_range(addr, &buffer[0], size);
+		L.pushlstring(size ? &buffer[0] : "", size);
+		return 1;
+	}
+
+	int readstrided(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		uint64_t addr, stride, count, size;
+
+		addr = lua_get_read_address(P);
+		P(stride, count, size);
+
+		if(size && ((size_t)count * size) / size != count)
+			throw std::runtime_error("Read too large");
+		std::vector<char> buffer(count * size);
+		if(!buffer.empty())
+			core.memory->read_strided(addr, stride, count, size, &buffer[0]);
+		L.pushlstring(buffer.empty() ? "" : &buffer[0], buffer.size());
+		return 1;
+	}
+
 	int writeregion(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
@@ -846,12 +895,15 @@ namespace
 		{"read_vma", read_vma},
 		{"find_vma", find_vma},
 		{"hash_state", hash_state},
+		{"state_fingerprint", state_fingerprint},
 		{"hash_region", hash_region<false>},
 		{"hash_region2", hash_region<true>},
 		{"hash_region_skein", hash_region_skein},
 		{"store", copy_to_host<false>},
 		{"storecmp", copy_to_host<true>},
 		{"readregion", readregion},
+		{"readregion_string", readregion_string},
+		{"readstrided", readstrided},
 		{"writeregion", writeregion},
 		{"read_sg", memory_scattergather<false, false>},
 		{"sread_sg", memory_scattergather<false, true>},
@@ -1,5 +1,7 @@
 #include "lua/internal.hpp"
 #include "lua/unsaferewind.hpp"
+#include "core/controllerframe.hpp"
+#include "core/inputsearch.hpp"
 #include "core/instance.hpp"
 #include "core/moviedata.hpp"
 #include "core/mainloop.hpp"
@@ -101,6 +103,43 @@ namespace
 		return 0;
 	}
 
+	int search_inputs(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		input_search_params p;
+		int ltbl;
+
+		P(P.table(ltbl), p.score, p.depth, P.optional(p.beam, 0), P.optional(p.max_nodes, 0),
+			P.optional(p.workers, 0));
+
+		for(uint64_t i = 1;; i++) {
+			L.pushnumber(i);
+			L.gettable(ltbl);
+			if(L.type(-1) == LUA_TNIL) {
+				L.pop(1);
+				break;
+			}
+			const char* f = L.tostring(-1);
+			if(!f) {
+				L.pop(1);
+				(stringfmt() << P.get_fname() << ": Candidates must be strings").throwex();
+			}
+			portctrl::frame c = core.controls->get_blank();
+			try {
+				c.deserialize(f);
+			} catch(...) {
+				L.pop(1);
+				throw;
+			}
+			L.pop(1);
+			p.candidates.push_back(c);
+		}
+		input_search_queue(p, [&core](const input_search_result& r) {
+			core.lua2->callback_input_search(r);
+		});
+		return 0;
+	}
+
 	int to_rewind(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
@@ -240,6 +279,7 @@ namespace
 		{"read_rtc", read_rtc},
 		{"unsafe_rewind", unsafe_rewind},
 		{"to_rewind", to_rewind},
+		{"search_inputs", search_inputs},
 		{"rom_loaded", rom_loaded},
 		{"get_rom_info", get_rom_info},
 		{"get_game_info", get_game_info},
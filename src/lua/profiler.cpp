@@ -0,0 +1,95 @@
+#include "lua/internal.hpp"
+#include "core/profiler.hpp"
+#include "library/profiler.hpp"
+
+namespace
+{
+	//Spans opened by profiler.push() and not yet closed.
+	std::vector<std::pair<const char*, uint64_t>> open_spans;
+
+	int start(lua::state& L, lua::parameters& P)
+	{
+		profiler::clear();
+		profiler::set_enabled(true);
+		open_spans.clear();
+		return 0;
+	}
+
+	int stop(lua::state& L, lua::parameters& P)
+	{
+		profiler::set_enabled(false);
+		return 0;
+	}
+
+	int enabled(lua::state& L, lua::parameters& P)
+	{
+		L.pushboolean(profiler::enabled());
+		return 1;
+	}
+
+	int push(lua::state& L, lua::parameters& P)
+	{
+		std::string name;
+
+		P(name);
+
+		//Push even if disabled, so pushes and pops stay balanced.
+		const char* iname = profiler::enabled() ? profiler::intern(name) : NULL;
+		open_spans.push_back(std::make_pair(iname, profiler::now()));
+		return 0;
+	}
+
+	int pop(lua::state& L, lua::parameters& P)
+	{
+		if(open_spans.empty())
+			throw std::runtime_error("No span open");
+		auto s = open_spans.back();
+		open_spans.pop_back();
+		if(s.first && profiler::enabled())
+			profiler::record(s.first, s.second, profiler::now());
+		return 0;
+	}
+
+	int summary(lua::state& L, lua::parameters& P)
+	{
+		uint64_t frames;
+		auto s = profiler::summary(&frames);
+		L.newtable();
+		for(auto& i : s) {
+			L.pushlstring(i.first);
+			L.newtable();
+			L.pushstring("count");
+			L.pushnumber(i.second.count);
+			L.settable(-3);
+			L.pushstring("total");
+			L.pushnumber(i.second.total / 1e3);
+			L.settable(-3);
+			L.pushstring("max");
+			L.pushnumber(i.second.max / 1e3);
+			L.settable(-3);
+			L.settable(-3);
+		}
+		L.pushnumber(frames);
+		return 2;
+	}
+
+	int write(lua::state& L, lua::parameters& P)
+	{
+		std::string filename;
+
+		P(filename);
+
+		profiler_write_trace(filename);
+		return 0;
+	}
+
+	lua::functions LUA_profiler_fns(lua_func_misc, "profiler", {
+		{"start", start},
+		{"stop", stop},
+		{"enabled", enabled},
+		{"push", push},
+		{"pop", pop},
+		{"summary", summary},
+		{"write", write},
+	});
+}
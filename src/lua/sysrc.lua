@@ -15,6 +15,58 @@ loopwrapper = function(fn, ...)
 	resume(yield, ...);
 	return resume;
 end;
+local _wait_lists = {};
+local _wait_hooks = {};
+local _wait_dispatch = function(name, ...)
+	local waiting = _wait_lists[name];
+	if #waiting == 0 then
+		return;
+	end
+	--Routines waiting again go to the new list, and are resumed on the next callback.
+	_wait_lists[name] = {};
+	local err;
+	local i;
+	for i=1,#waiting do
+		local x, y = coroutine.resume(waiting[i], ...);
+		if not x and not err then
+			err = y;
+		end
+	end
+	--Nobody waits anymore, so drop the hook until the next wait.
+	if #_wait_lists[name] == 0 then
+		callback.unregister(name, _wait_hooks[name]);
+		_wait_hooks[name] = nil;
+		_wait_lists[name] = nil;
+	end
+	if err then
+		error(err);
+	end
+end;
+spawn = function(fn, ...)
+	local routine = coroutine.create(fn);
+	local x, y = coroutine.resume(routine, ...);
+	if not x then
+		error(y);
+	end
+	return routine;
+end;
+wait_for = function(name)
+	name = name or "frame";
+	local routine, main = coroutine.running();
+	if not routine or main then
+		error("wait_for: Must be called from a coroutine");
+	end
+	if not _wait_hooks[name] then
+		local hook = function(...)
+			_wait_dispatch(name, ...);
+		end;
+		callback.register(name, hook);
+		_wait_hooks[name] = hook;
+		_wait_lists[name] = {};
+	end
+	table.insert(_wait_lists[name], routine);
+	return coroutine.yield();
+end;
 print=print2;
 loadfile=loadfile2;
 dofile=dofile2;
@@ -76,9 +128,11 @@ callback=classes.CALLBACKS_LIST.new();
 memory.mkaddr = classes.ADDRESS.new;
 memory.map_structure=classes.MMAP_STRUCT.new;
 memory.compare_new=classes.COMPARE_OBJ.new;
+memory.buffer_new=classes.MEMORY_BUFFER.new;
 zip.create=classes.ZIPWRITER.new;
 gui.tilemap=classes.TILEMAP.new;
 gui.renderq_new=classes.RENDERCTX.new;
+gui.retained_new=classes.RETAINED.new;
 gui.palette_new=classes.PALETTE.new;
 gui.font_new = classes.CUSTOMFONT.new;
 gui.loadfont = classes.CUSTOMFONT.load;
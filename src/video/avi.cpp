@@ -7,6 +7,7 @@
 #include "core/dispatch.hpp"
 #include "lua/lua.hpp"
 #include "library/minmax.hpp"
+#include "library/sincresample.hpp"
 #include "library/workthread.hpp"
 #include "core/messages.hpp"
 #include "core/instance.hpp"
@@ -97,16 +98,10 @@ namespace
 		"AVI‣Right padding", 0);
 	settingvar::supervariable<settingvar::model_int<0, 999999999>> max_frames_per_segment(lsnes_setgrp,
 		"avi-maxframes", "AVI‣Max frames per segment", 0);
-#ifdef WITH_SECRET_RABBIT_CODE
 	settingvar::enumeration soundrates {"nearest-common", "round-down", "round-up", "multiply",
 		"High quality 44.1kHz", "High quality 48kHz"};
 	settingvar::supervariable<settingvar::model_enumerated<&soundrates>> soundrate_setting(lsnes_setgrp,
 		"avi-soundrate", "AVI‣Sound mode", 5);
-#else
-	settingvar::enumeration soundrates {"nearest-common", "round-down", "round-up", "multiply"};
-	settingvar::supervariable<settingvar::model_enumerated<&soundrates>> soundrate_setting(lsnes_setgrp,
-		"avi-soundrate", "AVI‣Sound mode", 2);
-#endif
 
 	std::pair<avi_video_codec_type*, avi_audio_codec_type*> find_codecs(const std::string& mode)
 	{
@@ -144,6 +139,7 @@ namespace
 		void sendend();
 		void set_ratio(double _ratio);
 	private:
+		void sinc_process(const float* in, size_t frames);
 		std::vector<short> buffers;
 		std::vector<float> buffers2;
 		std::vector<float> buffers3;
@@ -152,6 +148,7 @@ namespace
 		double ratio;
 		uint32_t nch;
 		void* resampler;
+		sincresample::resampler sinc;
 		avi_worker* worker;
 	};
 
@@ -271,7 +268,7 @@ namespace
 	}
 
 	resample_worker::resample_worker(avi_worker* _worker, double _ratio, uint32_t _nch)
-		: worker(_worker)
+		: sinc(sincresample::QUALITY_BEST), worker(_worker)
 	{
 		ratio = _ratio;
 		nch = _nch;
@@ -287,7 +284,8 @@ namespace
 			throw std::runtime_error(std::string("Error initing libsamplerate: ") +
 				src_strerror(errc));
 #else
-		throw std::runtime_error("HQ sample rate conversion not available");
+		if(nch > 2)
+			throw std::runtime_error("HQ sample rate conversion only supports mono and stereo");
 #endif
 		fire();
 	}
@@ -306,6 +304,19 @@ namespace
 		buffers4.resize((RESAMPLE_BUFFER * nch * ratio) + 128 * nch);
 	}
 
+	void resample_worker::sinc_process(const float* in, size_t frames)
+	{
+		while(frames) {
+			float* out = &buffers3[0];
+			size_t outsize = buffers3.size() / nch;
+			sinc.resample(in, frames, out, outsize, ratio, nch == 2);
+			size_t gen = buffers3.size() / nch - outsize;
+			for(size_t i = 0; i < gen * nch; i++)
+				buffers4[i] = clip(buffers3[i] * 32768.0f, -32768.0f, 32767.0f);
+			worker->queue_audio(&buffers4[0], gen * nch);
+		}
+	}
+
 	void resample_worker::sendend()
 	{
 		rethrow();
@@ -558,6 +569,16 @@ again:
 				bufused -= block.input_frames_used;
 				if(block.output_frames_gen > 0 && work & WORKFLAG_END)
 					goto again;	//Try again to get all the samples.
+#else
+				for(size_t i = 0; i < bufused * nch; i++)
+					buffers2[i] = buffers[i] / 32768.0f;
+				sinc_process(&buffers2[0], bufused);
+				bufused = 0;
+				if(work & WORKFLAG_END) {
+					//Flush the rest of the samples out.
+					std::vector<float> silence(sinc.latency() * nch);
+					sinc_process(&silence[0], sinc.latency());
+				}
 #endif
 				clear_workflag(WORKFLAG_END | WORKFLAG_FLUSH | WORKFLAG_QUEUE_FRAME);
 				clear_busy();
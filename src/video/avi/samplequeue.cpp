@@ -4,53 +4,51 @@
 
 sample_queue::sample_queue()
 {
-	rptr = wptr = 0;
-	size = 0;
-	blank = true;
+	head = tail = new segment(BLOCKSIZE);
 }
 
-void sample_queue::push(const int16_t* samples, size_t count)
+sample_queue::~sample_queue()
 {
-	threads::alock h(mlock);
-	size_t dsize = _available();
-	if(dsize + count > size) {
-		//Expand the buffer.
-		std::vector<int16_t> newbuffer;
-		newbuffer.resize((dsize + count + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE);
-		size_t trptr = rptr;
-		for(size_t i = 0; i < dsize; i++) {
-			newbuffer[i] = data[trptr++];
-			if(trptr == size)
-				trptr = 0;
-		}
-		data.swap(newbuffer);
-		size = data.size();
-		rptr = 0;
-		wptr = dsize;
+	while(head) {
+		segment* next = head->next;
+		delete head;
+		head = next;
 	}
+}
 
-	while(count) {
-		data[wptr++] = *samples;
-		if(wptr == size)
-			wptr = 0;
-		blank = false;
-		samples++;
-		count--;
+void sample_queue::push(const int16_t* samples, size_t count)
+{
+	size_t done = tail->ring.push(samples, count);
+	if(done < count) {
+		//Expand the buffer. The old segment is freed by the puller once it has been drained.
+		segment* s = new segment((tail->ring.capacity() + count - done + BLOCKSIZE - 1) / BLOCKSIZE *
+			BLOCKSIZE);
+		s->ring.push(samples + done, count - done);
+		tail->next.store(s, std::memory_order_release);
+		tail = s;
 	}
 }
 
 void sample_queue::pull(int16_t* samples, size_t count)
 {
-	threads::alock h(mlock);
 	while(count) {
-		if(!blank) {
-			*samples = data[rptr++];
-			if(rptr == size)
-				rptr = 0;
-			if(rptr == wptr)
-				blank = true;
-		} else
-			*samples = 0;
+		size_t done = head->ring.pull(samples, count);
+		samples += done;
+		count -= done;
+		if(!count)
+			break;
+		segment* next = head->next.load(std::memory_order_acquire);
+		if(!next)
+			break;
+		//Nothing is pushed into a segment after next one has been linked, but something might have been
+		//pushed before.
+		if(head->ring.available())
+			continue;
+		delete head;
+		head = next;
+	}
+	while(count) {
+		*samples = 0;
 		samples++;
 		count--;
 	}
@@ -58,16 +56,8 @@ void sample_queue::pull(int16_t* samples, size_t count)
 
 size_t sample_queue::available()
 {
-	threads::alock h(mlock);
-	return _available();
-}
-
-size_t sample_queue::_available()
-{
-	if(blank)
-		return 0;
-	else if(rptr < wptr)
-		return wptr - rptr;
-	else
-		return size - (rptr - wptr);
+	size_t total = 0;
+	for(segment* s = head; s; s = s->next.load(std::memory_order_acquire))
+		total += s->ring.available();
+	return total;
 }